@@ -0,0 +1,117 @@
+/* times the hash operations on fixnum or string keys, in ns per operation
+ * usage: bench/hash [entries] [i|s] [runs], the best of the runs is printed
+ *
+ * build from the top directory once ./build.sh has made parser.c and city.o:
+ * gcc -D_POSIX_C_SOURCE=200809L -O2 -DNDEBUG -std=c99 -I. -o bench/hash bench/hash.c \
+ *   quuz-object.c quuz-collector.c quuz-read.c quuz-write.c quuz-hash.c city.o \
+ *   quuz-state.c quuz-analyze.c quuz-vm.c quuz-lib.c quuz-util.c -lm */
+#include "quuz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* quuz-lib.c wants the command line */
+int g_argc = 0;
+char** g_argv = NULL;
+
+enum { INSERT, HIT, MISS, DELETE, OPS };
+static const char* const OP_NAMES[OPS] = { "insert", "hit", "miss", "delete" };
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* keys from a xorshift generator, so every run sees the same ones */
+static qz_obj_t* make_keys(qz_state_t* st, size_t n, int strings)
+{
+  qz_obj_t* keys = (qz_obj_t*)malloc(n*sizeof(qz_obj_t));
+  uint64_t x = UINT64_C(88172645463325252);
+
+  for(size_t i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    if(strings) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "key-%llx", (unsigned long long)x);
+      keys[i] = qz_make_string(st, buf);
+    }
+    else {
+      keys[i] = qz_from_fixnum((intptr_t)(x >> 20));
+    }
+  }
+
+  return keys;
+}
+
+static void run(qz_state_t* st, qz_obj_t* keys, size_t n, int strings, double* ns)
+{
+  qz_obj_t hash = qz_make_hash(st);
+  size_t count = 0;
+
+  double start = now();
+  for(size_t i = 0; i < n; i++)
+    qz_hash_set(st, &hash, qz_ref(st, keys[i]), QZ_TRUE);
+  ns[INSERT] = (now() - start)/n*1e9;
+
+  /* hits in an order unrelated to insertion, so the cache doesn't help */
+  start = now();
+  for(size_t i = 0; i < n; i++)
+    count += qz_hash_get(st, hash, keys[(i*7919) % n]) != NULL;
+  ns[HIT] = (now() - start)/n*1e9;
+
+  start = now();
+  for(size_t i = 0; i < n; i++) {
+    if(strings)
+      count += qz_hash_find_chars(hash, "no-such-key", 11 + (i & 3)) != NULL;
+    else
+      count += qz_hash_get(st, hash, qz_from_fixnum((intptr_t)i*2 + 1 + ((intptr_t)1 << 50))) != NULL;
+  }
+  ns[MISS] = (now() - start)/n*1e9;
+
+  start = now();
+  for(size_t i = 0; i < n; i += 2)
+    count += qz_hash_delete(st, &hash, keys[i]);
+  ns[DELETE] = (now() - start)/((n + 1)/2)*1e9;
+
+  /* every key was found once and deleted once, none was missed */
+  if(count != n + (n + 1)/2)
+    fprintf(stderr, "wrong count %zu\n", count);
+
+  qz_unref(st, hash);
+}
+
+int main(int argc, char** argv)
+{
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  int strings = argc > 2 && argv[2][0] == 's';
+  int runs = argc > 3 ? atoi(argv[3]) : 5;
+
+  qz_state_t* st = qz_alloc();
+  qz_obj_t* keys = make_keys(st, n, strings);
+
+  double best[OPS];
+  for(int r = 0; r < runs; r++) {
+    double ns[OPS];
+    run(st, keys, n, strings, ns);
+    for(size_t op = 0; op < OPS; op++) {
+      if(r == 0 || ns[op] < best[op])
+        best[op] = ns[op];
+    }
+  }
+
+  printf("%zu %s keys:", n, strings ? "string" : "fixnum");
+  for(size_t op = 0; op < OPS; op++)
+    printf(" %s %.1f", OP_NAMES[op], best[op]);
+  printf("\n");
+
+  for(size_t i = 0; i < n; i++)
+    qz_unref(st, keys[i]);
+  free(keys);
+  qz_free(st);
+  return 0;
+}
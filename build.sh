@@ -20,6 +20,8 @@ gcc -D_POSIX_C_SOURCE=200809L $flags -std=c99 -o quuz \
   quuz-hash.c \
   city.o \
   quuz-state.c \
+  quuz-analyze.c \
+  quuz-vm.c \
   quuz-lib.c \
   quuz-util.c || exit 1
 
@@ -0,0 +1,755 @@
+#include "quuz.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* quuz-lib.c */
+extern const qz_named_cfun_t QZ_LIB_FUNCTIONS[];
+
+/* a frame the analyzed code will run with, innermost first */
+typedef struct scope {
+  qz_obj_t names; /* vector naming the frame's slots, see make_names() */
+  size_t nvisible; /* names visible so far, let* inits only see the bindings before them */
+  struct scope* outer;
+} scope_t;
+
+typedef struct analyzer {
+  qz_state_t* st;
+  qz_obj_t code; /* owns every node allocated */
+  int dynamic; /* frames outside the code are only known at runtime */
+} analyzer_t;
+
+typedef qz_node_t* (*syntax_fun)(analyzer_t* a, scope_t* sc, qz_obj_t args);
+
+static qz_node_t* analyze(analyzer_t* a, scope_t* sc, qz_obj_t expr);
+static qz_node_t* analyze_body(analyzer_t* a, scope_t* sc, qz_obj_t body);
+static void analyze_code(qz_state_t* st, qz_obj_t code, scope_t* outer, int dynamic);
+
+static qz_code_t* code_of(qz_obj_t code)
+{
+  return QZ_CELL_DATA(qz_to_cell(code), qz_code_t);
+}
+
+static qz_obj_t make_code(qz_state_t* st, qz_obj_t formals, qz_obj_t body)
+{
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_CODE, sizeof(qz_code_t));
+  cell->value.pair.first = qz_make_pair(st, qz_ref(st, formals), qz_ref(st, body));
+  cell->value.pair.rest = QZ_NULL;
+
+  qz_code_t* code = QZ_CELL_DATA(cell, qz_code_t);
+  code->body = NULL;
+  code->names = QZ_NONE;
+  code->nodes = NULL;
+  code->insns = NULL;
+
+  return qz_from_cell(cell);
+}
+
+void qz_free_code(qz_cell_t* cell)
+{
+  free(QZ_CELL_DATA(cell, qz_code_t)->insns);
+
+  qz_node_t* node = QZ_CELL_DATA(cell, qz_code_t)->nodes;
+
+  while(node) {
+    qz_node_t* next = node->next;
+    free(node);
+    node = next;
+  }
+}
+
+static qz_node_t* new_node(analyzer_t* a, qz_node_type_t type, size_t nkids)
+{
+  qz_node_t* node = (qz_node_t*)malloc(sizeof(qz_node_t) + nkids*sizeof(qz_node_t*));
+  node->type = type;
+  node->depth = 0;
+  node->index = 0;
+  node->sym = QZ_NONE;
+  node->obj = QZ_NONE;
+  node->names = QZ_NONE;
+  node->nkids = nkids;
+
+  for(size_t i = 0; i < nkids; i++)
+    node->kids[i] = NULL;
+
+  /* chain onto the code, which frees it */
+  qz_code_t* code = code_of(a->code);
+  node->next = code->nodes;
+  code->nodes = node;
+
+  return node;
+}
+
+static size_t list_length(analyzer_t* a, qz_obj_t list)
+{
+  size_t n = 0;
+
+  for(qz_obj_t elem = list; !qz_is_null(elem); elem = qz_rest(elem)) {
+    if(!qz_is_pair(elem))
+      qz_error(a->st, "improper list", &list, NULL);
+    n++;
+  }
+
+  return n;
+}
+
+/******************************************************************************
+ * variables
+ ******************************************************************************/
+
+/* give the code an object to own, it's released with the code */
+static void own(analyzer_t* a, qz_obj_t obj)
+{
+  qz_cell_t* cell = qz_to_cell(a->code);
+  cell->value.pair.rest = qz_make_pair(a->st, obj, cell->value.pair.rest);
+}
+
+/* append sym to names, unless unique is set and it's already there
+ * names must have room */
+static void add_name(qz_cell_t* names, qz_obj_t sym, int unique)
+{
+  qz_obj_t* data = QZ_CELL_DATA(names, qz_obj_t);
+
+  if(unique) {
+    for(size_t i = 0; i < names->value.array.size; i++) {
+      if(qz_eq(data[i], sym))
+        return;
+    }
+  }
+
+  data[names->value.array.size++] = sym;
+}
+
+/* add the names body defines at its start to names
+ * if names is NULL, only counts them
+ * returns the number of definitions seen */
+static size_t body_defines(analyzer_t* a, qz_obj_t body, qz_cell_t* names)
+{
+  size_t n = 0;
+
+  for(/**/; qz_is_pair(body); body = qz_rest(body)) {
+    qz_obj_t form = qz_first(body);
+
+    if(!qz_is_pair(form) || !qz_is_pair(qz_rest(form)))
+      continue;
+
+    qz_obj_t head = qz_first(form);
+
+    if(qz_eq(head, a->st->begin_sym)) {
+      n += body_defines(a, qz_rest(form), names);
+      continue;
+    }
+
+    if(!qz_eq(head, a->st->define_sym))
+      continue;
+
+    /* (define sym expr) or (define (sym . formals) body...) */
+    qz_obj_t header = qz_first(qz_rest(form));
+
+    if(qz_is_pair(header))
+      header = qz_first(header);
+
+    if(!qz_is_sym(header))
+      continue;
+
+    if(names)
+      add_name(names, header, 1);
+    n++;
+  }
+
+  return n;
+}
+
+/* build the vector naming a frame's slots, owned by the code
+ * vars is a list of formals, or let bindings if bindings is set, followed by what body defines
+ * malformed vars are skipped, they're reported when analyzed */
+static qz_obj_t make_names(analyzer_t* a, qz_obj_t vars, int bindings, qz_obj_t body)
+{
+  size_t capacity = body_defines(a, body, NULL) + 1;
+  qz_obj_t elem;
+
+  for(elem = vars; qz_is_pair(elem); elem = qz_rest(elem))
+    capacity++;
+
+  qz_cell_t* names = qz_make_cell(a->st, QZ_CT_VECTOR, capacity*sizeof(qz_obj_t));
+  names->value.array.size = 0;
+  names->value.array.capacity = capacity;
+
+  for(elem = vars; qz_is_pair(elem); elem = qz_rest(elem)) {
+    qz_obj_t var = qz_first(elem);
+
+    if(bindings)
+      var = qz_is_pair(var) ? qz_first(var) : QZ_NONE;
+
+    /* let* may bind a name more than once, the later one shadows */
+    if(qz_is_sym(var))
+      add_name(names, var, !bindings);
+  }
+
+  if(qz_is_sym(elem))
+    add_name(names, elem, 1); /* variable parameter */
+
+  body_defines(a, body, names);
+
+  own(a, qz_from_cell(names));
+  return qz_from_cell(names);
+}
+
+static size_t names_size(qz_obj_t names)
+{
+  return qz_to_cell(names)->value.array.size;
+}
+
+/* returns the slot of sym among the first nvisible names of a frame, or 0 if it's not there
+ * slot 0 of a frame holds its size, so names[i] is in slot i + 1 */
+static size_t frame_slot(const scope_t* sc, size_t nvisible, qz_obj_t sym)
+{
+  const qz_obj_t* names = QZ_CELL_DATA(qz_to_cell(sc->names), qz_obj_t);
+
+  for(size_t i = nvisible; i > 0; i--) {
+    if(qz_eq(names[i - 1], sym))
+      return i;
+  }
+
+  return 0;
+}
+
+/* find the frame binding sym
+ * returns the node type referencing it and sets *depth and *index */
+static qz_node_type_t resolve(const analyzer_t* a, const scope_t* sc, qz_obj_t sym, size_t* depth, size_t* index)
+{
+  size_t d = 0;
+
+  for(/**/; sc; sc = sc->outer, d++) {
+    size_t slot = frame_slot(sc, sc->nvisible, sym);
+
+    if(slot) {
+      *depth = d;
+      *index = slot;
+      return QZ_NT_LOCAL_REF;
+    }
+  }
+
+  *depth = d;
+  *index = 0;
+  return a->dynamic ? QZ_NT_FREE_REF : QZ_NT_GLOBAL_REF;
+}
+
+static qz_obj_t expect_sym(analyzer_t* a, qz_obj_t obj)
+{
+  if(!qz_is_sym(obj))
+    qz_error(a->st, "expected symbol", &obj, NULL);
+  return obj;
+}
+
+/******************************************************************************
+ * syntax
+ ******************************************************************************/
+
+static qz_node_t* analyze_quote(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  QZ_UNUSED(sc);
+  qz_node_t* node = new_node(a, QZ_NT_CONST, 0);
+  node->obj = qz_required_arg(a->st, &args);
+  return node;
+}
+
+/* analyze a nested lambda expression, the code is owned by ours */
+static qz_obj_t nested_code(analyzer_t* a, scope_t* sc, qz_obj_t formals, qz_obj_t body)
+{
+  qz_obj_t code = make_code(a->st, formals, body);
+  own(a, code);
+
+  analyze_code(a->st, code, sc, a->dynamic);
+  return code;
+}
+
+static qz_node_t* analyze_lambda_parts(analyzer_t* a, scope_t* sc, qz_obj_t formals, qz_obj_t body)
+{
+  qz_node_t* node = new_node(a, QZ_NT_LAMBDA, 0);
+  node->obj = nested_code(a, sc, formals, body);
+  return node;
+}
+
+static qz_node_t* analyze_lambda(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t formals = qz_required_arg(a->st, &args);
+  return analyze_lambda_parts(a, sc, formals, args);
+}
+
+static qz_node_t* analyze_if(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t test = qz_required_arg(a->st, &args);
+  qz_obj_t consequent = qz_required_arg(a->st, &args);
+  qz_obj_t alternate = qz_optional_arg(a->st, &args);
+
+  qz_node_t* node = new_node(a, QZ_NT_IF, 3);
+  node->kids[0] = analyze(a, sc, test);
+  node->kids[1] = analyze(a, sc, consequent);
+  if(!qz_is_none(alternate))
+    node->kids[2] = analyze(a, sc, alternate);
+
+  return node;
+}
+
+static qz_node_t* analyze_set_b(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t var = expect_sym(a, qz_required_arg(a->st, &args));
+  qz_obj_t expr = qz_required_arg(a->st, &args);
+
+  size_t depth, index;
+  /* the set types parallel the ref types */
+  qz_node_type_t type = resolve(a, sc, var, &depth, &index) + (QZ_NT_LOCAL_SET - QZ_NT_LOCAL_REF);
+
+  qz_node_t* node = new_node(a, type, 1);
+  node->sym = var;
+  node->depth = depth;
+  node->index = index;
+  node->kids[0] = analyze(a, sc, expr);
+  return node;
+}
+
+/* (cond (test => fun)) is left to the special form */
+static qz_node_t* analyze_clauses(analyzer_t* a, scope_t* sc, qz_obj_t clauses, int* arrow)
+{
+  if(qz_is_null(clauses))
+    return NULL;
+
+  qz_obj_t clause = qz_required_arg(a->st, &clauses);
+  qz_obj_t test = qz_required_arg(a->st, &clause);
+
+  if(qz_eq(test, a->st->else_sym))
+    return analyze_body(a, sc, clause);
+
+  if(qz_is_pair(clause) && qz_eq(qz_first(clause), a->st->arrow_sym)) {
+    *arrow = 1;
+    return NULL;
+  }
+
+  qz_node_t* rest = analyze_clauses(a, sc, clauses, arrow);
+
+  if(qz_is_null(clause)) {
+    /* clause with only test */
+    qz_node_t* node = new_node(a, QZ_NT_OR, rest ? 2 : 1);
+    node->kids[0] = analyze(a, sc, test);
+    if(rest)
+      node->kids[1] = rest;
+    return node;
+  }
+
+  qz_node_t* node = new_node(a, QZ_NT_IF, 3);
+  node->kids[0] = analyze(a, sc, test);
+  node->kids[1] = analyze_body(a, sc, clause);
+  node->kids[2] = rest;
+  return node;
+}
+
+static qz_node_t* analyze_cond(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  int arrow = 0;
+  qz_node_t* node = analyze_clauses(a, sc, args, &arrow);
+
+  if(arrow)
+    return NULL;
+
+  if(!node)
+    node = new_node(a, QZ_NT_SEQ, 0); /* ran out of clauses */
+
+  return node;
+}
+
+static qz_node_t* analyze_tests(analyzer_t* a, scope_t* sc, qz_obj_t args, qz_node_type_t type)
+{
+  qz_node_t* node = new_node(a, type, list_length(a, args));
+
+  for(size_t i = 0; i < node->nkids; i++)
+    node->kids[i] = analyze(a, sc, qz_required_arg(a->st, &args));
+
+  return node;
+}
+
+static qz_node_t* analyze_and(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  return analyze_tests(a, sc, args, QZ_NT_AND);
+}
+
+static qz_node_t* analyze_or(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  return analyze_tests(a, sc, args, QZ_NT_OR);
+}
+
+/* (case key ((datum...) expr...) ... (else expr...))
+ * clauses with => are left to the special form */
+static qz_node_t* analyze_case(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t key = qz_required_arg(a->st, &args);
+  size_t nclauses = list_length(a, args);
+
+  for(qz_obj_t elem = args; !qz_is_null(elem); elem = qz_rest(elem)) {
+    qz_obj_t clause = qz_first(elem);
+    qz_obj_t data = qz_required_arg(a->st, &clause);
+
+    if(qz_is_pair(clause) && qz_eq(qz_first(clause), a->st->arrow_sym))
+      return NULL;
+
+    if(!qz_eq(data, a->st->else_sym))
+      list_length(a, data);
+  }
+
+  qz_node_t* node = new_node(a, QZ_NT_CASE, nclauses + 1);
+  node->kids[0] = analyze(a, sc, key);
+  node->obj = args;
+
+  for(size_t i = 1; i <= nclauses; i++)
+    node->kids[i] = analyze_body(a, sc, qz_rest(qz_required_arg(a->st, &args)));
+
+  return node;
+}
+
+static qz_node_t* analyze_when(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t test = qz_required_arg(a->st, &args);
+
+  qz_node_t* node = new_node(a, QZ_NT_IF, 3);
+  node->kids[0] = analyze(a, sc, test);
+  node->kids[1] = analyze_body(a, sc, args);
+  return node;
+}
+
+static qz_node_t* analyze_unless(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t test = qz_required_arg(a->st, &args);
+
+  qz_node_t* node = new_node(a, QZ_NT_IF, 3);
+  node->kids[0] = analyze(a, sc, test);
+  node->kids[2] = analyze_body(a, sc, args);
+  return node;
+}
+
+/* named let, ex. (let loop ((i 0)) (loop (+ i 1))) */
+static qz_node_t* analyze_named_let(analyzer_t* a, scope_t* sc, qz_obj_t name, qz_obj_t args)
+{
+  qz_obj_t bindings = qz_required_arg(a->st, &args);
+  size_t nbindings = list_length(a, bindings);
+
+  qz_node_t* node = new_node(a, QZ_NT_NAMED_LET, nbindings);
+  node->sym = expect_sym(a, name);
+
+  /* inits are evaluated outside, collecting formals along the way */
+  qz_obj_t formals = QZ_NULL;
+  qz_obj_t elem = QZ_NULL;
+
+  for(size_t i = 0; i < nbindings; i++) {
+    qz_obj_t binding = qz_required_arg(a->st, &bindings);
+    qz_obj_t sym = qz_required_arg(a->st, &binding);
+    qz_obj_t expr = qz_required_arg(a->st, &binding);
+
+    expect_sym(a, sym);
+
+    qz_push_safety(a->st, formals);
+    node->kids[i] = analyze(a, sc, expr);
+    qz_pop_safety(a->st, 1);
+
+    qz_obj_t inner_elem = qz_make_pair(a->st, sym, QZ_NULL);
+    if(qz_is_null(formals)) {
+      formals = elem = inner_elem;
+    }
+    else {
+      qz_to_pair(elem)->rest = inner_elem;
+      elem = inner_elem;
+    }
+  }
+
+  /* the function gets a frame of its own binding name, so it can call itself */
+  qz_push_safety(a->st, formals);
+  qz_obj_t self = qz_make_pair(a->st, name, QZ_NULL);
+  node->names = make_names(a, self, 0, QZ_NULL);
+  qz_unref(a->st, self);
+
+  scope_t fun_scope = {node->names, 1, sc};
+  node->obj = nested_code(a, &fun_scope, formals, args);
+  qz_pop_safety(a->st, 1);
+  qz_unref(a->st, formals);
+
+  return node;
+}
+
+static qz_node_t* analyze_let(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t bindings = qz_required_arg(a->st, &args);
+
+  if(qz_is_sym(bindings))
+    return analyze_named_let(a, sc, bindings, args);
+
+  size_t nbindings = list_length(a, bindings);
+  qz_node_t* node = new_node(a, QZ_NT_LET, nbindings + 1);
+  node->names = make_names(a, bindings, 1, args);
+
+  for(size_t i = 0; i < nbindings; i++) {
+    qz_obj_t binding = qz_required_arg(a->st, &bindings);
+    expect_sym(a, qz_required_arg(a->st, &binding));
+    node->kids[i] = analyze(a, sc, qz_required_arg(a->st, &binding));
+  }
+
+  scope_t frame = {node->names, names_size(node->names), sc};
+  node->kids[nbindings] = analyze_body(a, &frame, args);
+  return node;
+}
+
+static qz_node_t* analyze_let_s(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t bindings = qz_required_arg(a->st, &args);
+
+  size_t nbindings = list_length(a, bindings);
+  qz_node_t* node = new_node(a, QZ_NT_LET_S, nbindings + 1);
+  node->names = make_names(a, bindings, 1, args);
+
+  /* each init sees the bindings before it */
+  scope_t frame = {node->names, 0, sc};
+
+  for(size_t i = 0; i < nbindings; i++) {
+    qz_obj_t binding = qz_required_arg(a->st, &bindings);
+    expect_sym(a, qz_required_arg(a->st, &binding));
+    node->kids[i] = analyze(a, &frame, qz_required_arg(a->st, &binding));
+    frame.nvisible++;
+  }
+
+  frame.nvisible = names_size(node->names);
+  node->kids[nbindings] = analyze_body(a, &frame, args);
+  return node;
+}
+
+static qz_node_t* analyze_begin(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  return analyze_body(a, sc, args);
+}
+
+static qz_node_t* analyze_define(analyzer_t* a, scope_t* sc, qz_obj_t args)
+{
+  qz_obj_t header = qz_required_arg(a->st, &args);
+  qz_obj_t var;
+  qz_node_t* value;
+
+  if(qz_is_sym(header))
+  {
+    /* plain variable creation and assignment */
+    var = header;
+    value = analyze(a, sc, qz_required_arg(a->st, &args));
+  }
+  else if(qz_is_pair(header))
+  {
+    /* function creation and assignment */
+    var = qz_first(header);
+    if(!qz_is_sym(var))
+      qz_error(a->st, "function variant of define not given symbol", &var, NULL);
+
+    value = analyze_lambda_parts(a, sc, qz_rest(header), args);
+  }
+  else
+  {
+    qz_error(a->st, "first argument to define must be a symbol or list", &header, NULL);
+    return NULL;
+  }
+
+  /* only bodies are scanned for definitions */
+  size_t index = frame_slot(sc, names_size(sc->names), var);
+
+  if(!index)
+    qz_error(a->st, "definition not at start of body", &var, NULL);
+
+  qz_node_t* node = new_node(a, QZ_NT_DEFINE, 1);
+  node->sym = var;
+  node->index = index;
+  node->kids[0] = value;
+  return node;
+}
+
+static const struct {
+  const char* name;
+  syntax_fun fun;
+} SYNTAX[] = {
+  {"quote", analyze_quote},
+  {"lambda", analyze_lambda},
+  {"if", analyze_if},
+  {"set!", analyze_set_b},
+  {"cond", analyze_cond},
+  {"case", analyze_case},
+  {"and", analyze_and},
+  {"or", analyze_or},
+  {"when", analyze_when},
+  {"unless", analyze_unless},
+  {"let", analyze_let},
+  {"let*", analyze_let_s},
+  {"begin", analyze_begin},
+  {"define", analyze_define},
+  {NULL, NULL}
+};
+
+/* returns the analyzer for a special form, or NULL if it's left to the cfun */
+static syntax_fun find_syntax(qz_cfun_t cfun)
+{
+  for(const qz_named_cfun_t* ncf = QZ_LIB_FUNCTIONS; ncf->cfun; ncf++)
+  {
+    if(ncf->cfun != cfun)
+      continue;
+
+    for(size_t i = 0; SYNTAX[i].name; i++) {
+      if(!strcmp(SYNTAX[i].name, ncf->name))
+        return SYNTAX[i].fun;
+    }
+
+    return NULL;
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ * expressions
+ ******************************************************************************/
+
+/* returns the global value of sym, or none if unbound */
+static qz_obj_t global_value(analyzer_t* a, qz_obj_t sym)
+{
+  qz_obj_t* slot = qz_lookup_global(a->st, sym);
+  return slot ? *slot : QZ_NONE;
+}
+
+static qz_node_t* analyze_call(analyzer_t* a, scope_t* sc, qz_obj_t expr)
+{
+  qz_obj_t op = qz_first(expr);
+  qz_obj_t args = qz_rest(expr);
+  qz_node_t* op_node = analyze(a, sc, op);
+
+  /* cfuns receive their arguments unevaluated */
+  int fexpr = 0;
+
+  if(op_node->type == QZ_NT_CONST)
+    fexpr = qz_is_cfun(op_node->obj);
+  else if(qz_is_sym(op) && op_node->type != QZ_NT_LOCAL_REF) /* compound operators are only known once evaluated */
+    fexpr = qz_is_cfun(global_value(a, op));
+
+  if(fexpr) {
+    qz_node_t* node = new_node(a, QZ_NT_FEXPR, 1);
+    node->kids[0] = op_node;
+    node->obj = args;
+    return node;
+  }
+
+  qz_node_t* node = new_node(a, QZ_NT_CALL, list_length(a, args) + 1);
+  node->kids[0] = op_node;
+  node->obj = args;
+
+  for(size_t i = 1; i < node->nkids; i++)
+    node->kids[i] = analyze(a, sc, qz_required_arg(a->st, &args));
+
+  return node;
+}
+
+static qz_node_t* analyze(analyzer_t* a, scope_t* sc, qz_obj_t expr)
+{
+  if(qz_is_sym(expr))
+  {
+    size_t depth, index;
+    qz_node_t* node = new_node(a, resolve(a, sc, expr, &depth, &index), 0);
+    node->sym = expr;
+    node->depth = depth;
+    node->index = index;
+    return node;
+  }
+
+  if(qz_is_pair(expr))
+  {
+    qz_obj_t op = qz_first(expr);
+    size_t depth, index;
+
+    /* special forms, unless shadowed */
+    if(qz_is_sym(op) && resolve(a, sc, op, &depth, &index) != QZ_NT_LOCAL_REF)
+    {
+      qz_obj_t value = global_value(a, op);
+      syntax_fun fun = qz_is_cfun(value) ? find_syntax(qz_to_cfun(value)) : NULL;
+
+      if(fun) {
+        qz_node_t* node = fun(a, sc, qz_rest(expr));
+        if(node)
+          return node;
+      }
+    }
+
+    return analyze_call(a, sc, expr);
+  }
+
+  if(qz_is_null(expr))
+    qz_error(a->st, "cannot evaluate null", NULL);
+
+  qz_node_t* node = new_node(a, QZ_NT_CONST, 0);
+  node->obj = expr;
+  return node;
+}
+
+static qz_node_t* analyze_body(analyzer_t* a, scope_t* sc, qz_obj_t body)
+{
+  qz_node_t* node = new_node(a, QZ_NT_SEQ, list_length(a, body));
+
+  for(size_t i = 0; i < node->nkids; i++)
+    node->kids[i] = analyze(a, sc, qz_required_arg(a->st, &body));
+
+  /* a lone expression needs no sequence */
+  if(node->nkids == 1)
+    return node->kids[0];
+
+  return node;
+}
+
+static void analyze_code(qz_state_t* st, qz_obj_t code, scope_t* outer, int dynamic)
+{
+  qz_obj_t source = qz_first(code);
+  qz_obj_t formals = qz_first(source);
+
+  /* check formals */
+  qz_obj_t params = formals;
+
+  for(/**/; qz_is_pair(params); params = qz_rest(params)) {
+    qz_obj_t param = qz_first(params);
+    if(!qz_is_sym(param))
+      qz_error(st, "function parameter is not a symbol", &param, NULL);
+  }
+
+  if(!qz_is_null(params) && !qz_is_sym(params))
+    qz_error(st, "invalid function formals", &params, NULL);
+
+  analyzer_t a = {st, code, dynamic};
+  qz_obj_t names = make_names(&a, formals, 0, qz_rest(source));
+  scope_t frame = {names, names_size(names), outer};
+
+  code_of(code)->names = names;
+  code_of(code)->body = analyze_body(&a, &frame, qz_rest(source));
+}
+
+qz_obj_t qz_make_fun(qz_state_t* st, qz_obj_t scope, qz_obj_t formals, qz_obj_t body)
+{
+  qz_obj_t code = make_code(st, formals, body);
+
+  /* only closures over the toplevel know every frame they run with */
+  qz_push_safety(st, code);
+  analyze_code(st, code, NULL, !qz_is_null(scope));
+  qz_pop_safety(st, 1);
+
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_FUN, 0);
+  cell->value.pair.first = qz_ref(st, scope);
+  cell->value.pair.rest = code;
+
+  return qz_from_cell(cell);
+}
+
+qz_code_t* qz_fun_code(qz_obj_t obj)
+{
+  assert(qz_is_fun(obj));
+  return code_of(qz_rest(obj));
+}
+
+qz_obj_t qz_fun_formals(qz_obj_t obj)
+{
+  assert(qz_is_fun(obj));
+  return qz_first(qz_first(qz_rest(obj)));
+}
@@ -2,6 +2,9 @@
 #include <assert.h>
 #include <stdlib.h>
 
+/* quuz-analyze.c */
+void qz_free_code(qz_cell_t* cell);
+
 #ifdef DEBUG_COLLECTOR
 void describe(qz_state_t*, qz_cell_t*); /* quuz-write.c */
 void logit(qz_state_t* st, const char* fn, qz_cell_t* cell)
@@ -17,6 +20,13 @@ void logit(qz_state_t* st, const char* fn, qz_cell_t* cell)
 #define D_PRINTF(...) ((void)0)
 #endif
 
+/* scanning the C stack reads memory asan guards, and stays out of line so every caller's frame is above it */
+#ifdef __GNUC__
+#define QZ_STACK_SCANNER __attribute__((noinline, no_sanitize_address))
+#else
+#define QZ_STACK_SCANNER
+#endif
+
 /* The algorithm here is an implementation of "Synchronous Cycle Collection" described in
  * http://www.research.ibm.com/people/d/dfb/papers/Bacon01Concurrent.pdf */
 
@@ -28,56 +38,122 @@ void call_if_valid_cell(qz_state_t* st, qz_obj_t obj, child_func func)
     func(st, qz_to_cell(obj));
 }
 
-void all_children(qz_state_t* st, qz_cell_t* cell, child_func func)
+/* the objects a cell references lie in runs a fixed number of objects apart
+ * a hash has one run for its keys and one for its values */
+typedef struct {
+  qz_obj_t* objs[2];
+  size_t counts[2];
+  size_t strides[2];
+  size_t runs;
+  size_t run; /* where children_next() is */
+  size_t i;
+} children_t;
+
+static void children_run(children_t* ch, qz_obj_t* objs, size_t count, size_t stride)
+{
+  ch->objs[ch->runs] = objs;
+  ch->counts[ch->runs] = count;
+  ch->strides[ch->runs] = stride;
+  ch->runs++;
+}
+
+static void children_begin(children_t* ch, qz_cell_t* cell)
 {
+  ch->runs = 0;
+  ch->run = 0;
+  ch->i = 0;
+
   switch(qz_type(cell)) {
   case QZ_CT_PAIR:
   case QZ_CT_FUN:
   case QZ_CT_PROMISE:
   case QZ_CT_ERROR:
-    call_if_valid_cell(st, cell->value.pair.first, func);
-    call_if_valid_cell(st, cell->value.pair.rest, func);
+  case QZ_CT_CODE:
+  case QZ_CT_TABLE:
+    children_run(ch, &cell->value.pair.first, 2, 1);
     break;
   case QZ_CT_VECTOR:
-    for(size_t i = 0; i < cell->value.array.size; i++) {
-      qz_obj_t* obj = QZ_CELL_DATA(cell, qz_obj_t) + i;
-      call_if_valid_cell(st, *obj, func);
-    }
+    children_run(ch, QZ_CELL_DATA(cell, qz_obj_t), cell->value.array.size, 1);
     break;
   case QZ_CT_HASH:
-    for(size_t i = 0; i < cell->value.array.capacity; i++) {
-      qz_pair_t* pair = QZ_CELL_DATA(cell, qz_pair_t) + i;
-      call_if_valid_cell(st, pair->first, func);
-      call_if_valid_cell(st, pair->rest, func);
-    }
+  {
+    /* the weak parts of a weak table's entries aren't references */
+    qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+    size_t stride = sizeof(qz_hash_slot_t)/sizeof(qz_obj_t);
+    if(!(qz_weak(cell) & QZ_WEAK_KEYS))
+      children_run(ch, &slots->key, cell->value.array.capacity, stride);
+    if(!(qz_weak(cell) & QZ_WEAK_VALUES))
+      children_run(ch, &slots->value, cell->value.array.capacity, stride);
+    break;
+  }
+  case QZ_CT_HAMT:
+    children_run(ch, &QZ_CELL_DATA(cell, qz_hamt_entry_t)->key, 2*qz_hamt_entries(cell), 1);
     break;
   default:
     break;
   }
 }
 
-void qz_collect(qz_state_t* st);
-static void mark_gray(qz_state_t* st, qz_cell_t* cell);
-static void scan_black(qz_state_t* st, qz_cell_t* cell);
-static void release_cell(qz_state_t* st, qz_cell_t* cell);
-static void free_cell(qz_state_t* st, qz_cell_t* cell);
+/* returns the next cell referenced, NULL once there are no more */
+static qz_cell_t* children_next(children_t* ch)
+{
+  for(/**/; ch->run < ch->runs; ch->run++, ch->i = 0) {
+    while(ch->i < ch->counts[ch->run]) {
+      qz_obj_t obj = ch->objs[ch->run][ch->strides[ch->run]*ch->i++];
+      if(qz_is_cell(obj) && !qz_is_null(obj))
+        return qz_to_cell(obj);
+    }
+  }
+  return NULL;
+}
 
-/* mark_roots related */
-static void decr_and_mark_gray(qz_state_t* st, qz_cell_t* cell)
+void all_children(qz_state_t* st, qz_cell_t* cell, child_func func)
 {
-  D_LOG;
-  assert(qz_refcount(cell) != 0);
-  qz_set_refcount(cell, qz_refcount(cell) - 1);
-  mark_gray(st, cell);
+  children_t ch;
+  children_begin(&ch, cell);
+  for(qz_cell_t* child; (child = children_next(&ch)); /**/)
+    func(st, child);
 }
 
+/* the traversals keep the cells they have left to visit on the work stack, not the C stack */
+static void push_work(qz_state_t* st, qz_cell_t* cell)
+{
+  if(st->work_stack_size == st->work_stack_capacity) {
+    st->work_stack_capacity = st->work_stack_capacity ? st->work_stack_capacity*2 : 64;
+    st->work_stack = (qz_cell_t**)realloc(st->work_stack, st->work_stack_capacity*sizeof(qz_cell_t*));
+  }
+  st->work_stack[st->work_stack_size++] = cell;
+}
+
+static void release_cell(qz_state_t* st, qz_cell_t* cell);
+static void free_cell(qz_state_t* st, qz_cell_t* cell);
+static void close_port(qz_cell_t* cell);
+static void free_garbage(qz_state_t* st);
+
+/* mark_roots related */
 static void mark_gray(qz_state_t* st, qz_cell_t* cell)
 {
   D_LOG;
-  if(qz_color(cell) != QZ_CC_GRAY)
-  {
-    qz_set_color(cell, QZ_CC_GRAY);
-    all_children(st, cell, decr_and_mark_gray);
+  if(qz_color(cell) == QZ_CC_GRAY)
+    return;
+
+  size_t base = st->work_stack_size;
+  qz_set_color(cell, QZ_CC_GRAY);
+  push_work(st, cell);
+
+  while(st->work_stack_size > base) {
+    children_t ch;
+    children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      assert(qz_refcount(child) != 0);
+      qz_set_refcount(child, qz_refcount(child) - 1);
+
+      if(qz_color(child) != QZ_CC_GRAY) {
+        qz_set_color(child, QZ_CC_GRAY);
+        push_work(st, child);
+      }
+    }
   }
 }
 
@@ -89,7 +165,7 @@ static void mark_roots(qz_state_t* st)
     qz_cell_t* cell = st->root_buffer[i];
     D_LOG;
 
-    if(qz_color(cell) == QZ_CC_PURPLE)
+    if(qz_color(cell) == QZ_CC_PURPLE && qz_refcount(cell) > 0)
     {
       mark_gray(st, cell);
 
@@ -110,35 +186,55 @@ static void mark_roots(qz_state_t* st)
 }
 
 /* scan_roots related */
-static void incr_and_scan_black(qz_state_t* st, qz_cell_t* cell)
+static void scan_black(qz_state_t* st, qz_cell_t* cell)
 {
   D_LOG;
-  qz_set_refcount(cell, qz_refcount(cell) + 1);
-  if(qz_color(cell) != QZ_CC_BLACK)
-    scan_black(st, cell);
+  size_t base = st->work_stack_size;
+  qz_set_color(cell, QZ_CC_BLACK);
+  push_work(st, cell);
+
+  while(st->work_stack_size > base) {
+    children_t ch;
+    children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      qz_set_refcount(child, qz_refcount(child) + 1);
+
+      if(qz_color(child) != QZ_CC_BLACK) {
+        qz_set_color(child, QZ_CC_BLACK);
+        push_work(st, child);
+      }
+    }
+  }
 }
 
-static void scan_black(qz_state_t* st, qz_cell_t* cell)
+/* a gray cell still counted is alive, otherwise it's white until scan_black() says otherwise */
+static void scan_gray(qz_state_t* st, qz_cell_t* cell)
 {
-  D_LOG;
-  qz_set_color(cell, QZ_CC_BLACK);
-  all_children(st, cell, incr_and_scan_black);
+  if(qz_color(cell) != QZ_CC_GRAY)
+    return;
+
+  if(qz_refcount(cell) > 0) {
+    scan_black(st, cell);
+  }
+  else {
+    qz_set_color(cell, QZ_CC_WHITE);
+    push_work(st, cell);
+  }
 }
 
 static void scan(qz_state_t* st, qz_cell_t* cell)
 {
   D_LOG;
-  if(qz_color(cell) == QZ_CC_GRAY)
-  {
-    if(qz_refcount(cell) > 0)
-    {
-      scan_black(st, cell);
-    }
-    else
-    {
-      qz_set_color(cell, QZ_CC_WHITE);
-      all_children(st, cell, scan);
-    }
+  size_t base = st->work_stack_size;
+  scan_gray(st, cell);
+
+  while(st->work_stack_size > base) {
+    children_t ch;
+    children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/)
+      scan_gray(st, child);
   }
 }
 
@@ -149,14 +245,35 @@ static void scan_roots(qz_state_t* st)
 }
 
 /* collect_roots related */
+
+/* other white cells may still point here, so freeing waits */
+static void push_white(qz_state_t* st, qz_cell_t* cell)
+{
+  if(st->white_cells_size == st->white_cells_capacity) {
+    st->white_cells_capacity = st->white_cells_capacity ? st->white_cells_capacity*2 : 64;
+    st->white_cells = (qz_cell_t**)realloc(st->white_cells, st->white_cells_capacity*sizeof(qz_cell_t*));
+  }
+  st->white_cells[st->white_cells_size++] = cell;
+}
+
+/* gather the white cells reachable from a white root, which has already been taken care of */
 static void collect_white(qz_state_t* st, qz_cell_t* cell)
 {
   D_LOG;
-  if(qz_color(cell) == QZ_CC_WHITE && !qz_buffered(cell))
-  {
-    qz_set_color(cell, QZ_CC_BLACK);
-    all_children(st, cell, collect_white);
-    free_cell(st, cell);
+  size_t base = st->work_stack_size;
+  push_work(st, cell);
+
+  while(st->work_stack_size > base) {
+    children_t ch;
+    children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      if(qz_color(child) == QZ_CC_WHITE && !qz_buffered(child)) {
+        qz_set_color(child, QZ_CC_BLACK);
+        push_white(st, child);
+        push_work(st, child);
+      }
+    }
   }
 }
 
@@ -174,9 +291,46 @@ static void collect_roots(qz_state_t* st)
     qz_set_buffered(cell, 0);
     if(qz_color(cell) == QZ_CC_WHITE) {
       qz_set_color(cell, QZ_CC_BLACK);
-      all_children(st, cell, collect_white);
+      collect_white(st, cell);
+    }
+  }
+
+  free_garbage(st);
+}
+
+/* garbage weak tables are forgotten before anything is freed, then entries holding garbage are removed
+ * the other parts of those entries belong to live tables, they're unrefed once the collection is done */
+static void forget_white(qz_state_t* st)
+{
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    if(qz_type(st->white_cells[i]) == QZ_CT_TABLE)
+      qz_weak_release(st, st->white_cells[i]);
+  }
+  for(size_t i = 0; i < st->white_cells_size; i++)
+    qz_weak_release(st, st->white_cells[i]);
+}
+
+/* a white cell still buffered is only released, the collection that unbuffers it frees it */
+static void free_white(qz_state_t* st)
+{
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    qz_cell_t* cell = st->white_cells[i];
+    if(qz_buffered(cell)) {
+      qz_set_refcount(cell, 0);
+      qz_set_color(cell, QZ_CC_BLACK);
+      close_port(cell);
+    }
+    else {
+      free_cell(st, cell);
     }
   }
+  st->white_cells_size = 0;
+}
+
+/* free the white cells, and the possible roots released while they were buffered */
+static void free_garbage(qz_state_t* st)
+{
+  forget_white(st);
 
   for(size_t i = 0; i < st->root_buffer_size; i++)
   {
@@ -186,6 +340,119 @@ static void collect_roots(qz_state_t* st)
   }
 
   st->root_buffer_size = 0;
+
+  free_white(st);
+}
+
+/* Backup tracing, for when the possible roots' subgraphs are likely most of the heap anyway.
+ * Nothing outside the heap is known besides the counts, so as in trial deletion, each cell's count
+ * loses its references from other cells. The cells still counted are referenced from outside,
+ * and marking from them restores the counts of everything reachable. What's left is garbage. */
+
+static void whiten(qz_state_t* st, qz_cell_t* cell)
+{
+  QZ_UNUSED(st);
+  /* possible roots already released have no references left to subtract */
+  if(qz_refcount(cell) > 0)
+    qz_set_color(cell, QZ_CC_WHITE);
+}
+
+static void subtract_children(qz_state_t* st, qz_cell_t* cell)
+{
+  QZ_UNUSED(st);
+  if(qz_color(cell) != QZ_CC_WHITE)
+    return;
+
+  children_t ch;
+  children_begin(&ch, cell);
+
+  for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+    assert(qz_refcount(child) != 0);
+    qz_set_refcount(child, qz_refcount(child) - 1);
+  }
+}
+
+/* like scan_black(), but only white cells are left unmarked */
+static void mark_external(qz_state_t* st, qz_cell_t* cell)
+{
+  if(qz_color(cell) != QZ_CC_WHITE || qz_refcount(cell) == 0)
+    return;
+
+  size_t base = st->work_stack_size;
+  qz_set_color(cell, QZ_CC_BLACK);
+  push_work(st, cell);
+
+  while(st->work_stack_size > base) {
+    children_t ch;
+    children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      qz_set_refcount(child, qz_refcount(child) + 1);
+
+      if(qz_color(child) == QZ_CC_WHITE) {
+        qz_set_color(child, QZ_CC_BLACK);
+        push_work(st, child);
+      }
+    }
+  }
+}
+
+static void sweep(qz_state_t* st, qz_cell_t* cell)
+{
+  if(qz_color(cell) == QZ_CC_WHITE) {
+    qz_set_color(cell, QZ_CC_BLACK);
+    push_white(st, cell);
+  }
+}
+
+static void trace_heap(qz_state_t* st)
+{
+  /* only released cells stay buffered, to be freed with the garbage */
+  size_t j = 0;
+  for(size_t i = 0; i < st->root_buffer_size; i++) {
+    qz_cell_t* cell = st->root_buffer[i];
+    qz_set_buffered(cell, 0);
+    if(qz_refcount(cell) == 0)
+      st->root_buffer[j++] = cell;
+  }
+  st->root_buffer_size = j;
+
+  qz_each_cell(st, whiten);
+  qz_each_cell(st, subtract_children);
+  qz_each_cell(st, mark_external);
+  qz_each_cell(st, sweep);
+
+  free_garbage(st);
+  st->traces++;
+}
+
+static int should_trace(qz_state_t* st)
+{
+  return st->trace_ratio > 0 && st->root_buffer_size*st->trace_ratio >= st->cells_allocated - st->cells_freed;
+}
+
+/* check the collection policy after buffering a possible root */
+static int should_collect(qz_state_t* st)
+{
+  switch(st->collect_policy) {
+  case QZ_COLLECT_COUNT:
+    return st->root_buffer_size >= st->collect_threshold;
+  case QZ_COLLECT_BYTES:
+    return st->bytes_allocated - st->collect_bytes >= st->collect_threshold;
+  default:
+    return 0;
+  }
+}
+
+static void buffer_root(qz_state_t* st, qz_cell_t* cell)
+{
+  if(st->root_buffer_size == st->root_buffer_capacity) {
+    st->root_buffer_capacity = st->root_buffer_capacity ? st->root_buffer_capacity*2 : 64;
+    st->root_buffer = (qz_cell_t**)realloc(st->root_buffer, st->root_buffer_capacity*sizeof(qz_cell_t*));
+  }
+
+  qz_set_buffered(cell, 1);
+  st->root_buffer[st->root_buffer_size++] = cell;
 }
 
 static void possible_root(qz_state_t* st, qz_cell_t* cell)
@@ -197,15 +464,88 @@ static void possible_root(qz_state_t* st, qz_cell_t* cell)
 
     if(!qz_buffered(cell))
     {
-      qz_set_buffered(cell, 1);
-      st->root_buffer[st->root_buffer_size++] = cell;
+      buffer_root(st, cell);
 
-      if(st->root_buffer_size == QZ_ROOT_BUFFER_CAPACITY)
-        qz_collect(st);
+      /* while a reference is being dropped, a cell may still point at what it was
+       * tracing the whole heap would count that, so it waits for qz_call_prim(), as incremental steps do */
+      if(!st->collecting && !st->trace_pending && st->collect_phase == QZ_PHASE_IDLE && should_collect(st)) {
+        if(st->collect_budget > 0)
+          st->collect_phase = QZ_PHASE_START;
+        else if(should_trace(st))
+          st->trace_pending = 1;
+        else
+          qz_collect(st);
+      }
     }
   }
 }
 
+/* deferred reference counting, after Deutsch and Bobrow
+ * the stack and the frames' functions change too often to count, so a cell whose count
+ * reaches zero while they may hold it waits in the zero count table instead of being released
+ * reconciling counts them for a moment, and releases the waiting cells still at zero */
+
+static int stack_in_use(qz_state_t* st)
+{
+  return (st->stack_size > 0 || st->frames_size > 0) && !st->stack_counted;
+}
+
+static void defer(qz_state_t* st, qz_cell_t* cell)
+{
+  D_LOG;
+  if(qz_deferred(cell))
+    return;
+
+  if(st->zct_size == st->zct_capacity) {
+    st->zct_capacity = st->zct_capacity ? st->zct_capacity*2 : 64;
+    st->zct = (qz_cell_t**)realloc(st->zct, st->zct_capacity*sizeof(qz_cell_t*));
+  }
+
+  qz_set_deferred(cell, 1);
+  st->zct[st->zct_size++] = cell;
+
+  /* reconciling counts the whole stack, a deep one waits for as many cells so each pays the same */
+  if(st->zct_size >= QZ_ZCT_THRESHOLD && st->zct_size >= st->stack_size + st->frames_size
+     && !st->collecting && !st->stack_counted)
+    qz_reconcile(st);
+}
+
+static void count_stack_cell(qz_state_t* st, qz_cell_t* cell)
+{
+  QZ_UNUSED(st);
+  qz_set_refcount(cell, qz_refcount(cell) + 1);
+}
+
+static void uncount_stack_cell(qz_state_t* st, qz_cell_t* cell)
+{
+  size_t refcount = qz_refcount(cell) - 1;
+  qz_set_refcount(cell, refcount);
+  if(refcount == 0)
+    defer(st, cell);
+}
+
+/* count or stop counting the stack's references, without buffering anything as a possible root */
+static void count_stack(qz_state_t* st, child_func func)
+{
+  for(size_t i = 0; i < st->stack_size; i++)
+    call_if_valid_cell(st, st->stack[i], func);
+
+  for(size_t i = 0; i < st->frames_size; i++)
+    call_if_valid_cell(st, st->frames[i].fun, func);
+}
+
+/* release the waiting cells nothing counted holds, the stack has to be counted
+ * cells reaching zero meanwhile are garbage and are released right away */
+static void release_deferred(qz_state_t* st)
+{
+  while(st->zct_size > 0) {
+    qz_cell_t* cell = st->zct[--st->zct_size];
+    qz_set_deferred(cell, 0);
+    if(qz_refcount(cell) == 0)
+      release_cell(st, cell);
+  }
+}
+
 static void increment(qz_state_t* st, qz_cell_t* cell)
 {
   QZ_UNUSED(st);
@@ -220,28 +560,703 @@ static void decrement(qz_state_t* st, qz_cell_t* cell)
   assert(qz_refcount(cell) != 0);
   size_t refcount = qz_refcount(cell) - 1;
   qz_set_refcount(cell, refcount);
-  if(refcount == 0)
+  if(refcount == 0 && (stack_in_use(st) || qz_deferred(cell)))
+    defer(st, cell);
+  else if(refcount == 0)
     release_cell(st, cell);
   else
     possible_root(st, cell);
 }
 
+/* close a port as soon as it's unreachable, even if freeing it waits for a collection */
+static void close_port(qz_cell_t* cell)
+{
+  if(qz_type(cell) == QZ_CT_PORT && cell->value.port.fp) {
+    qz_forget_read_ahead(cell->value.port.fp);
+    fclose(cell->value.port.fp);
+    cell->value.port.fp = NULL;
+  }
+}
+
+/* release a cell and whatever only it held
+ * a cell waiting on the work stack keeps the last reference to it until its turn,
+ * so a collection meanwhile sees it as alive, and its contents intact */
 static void release_cell(qz_state_t* st, qz_cell_t* cell)
 {
-  D_LOG;
-  all_children(st, cell, decrement);
-  qz_set_color(cell, QZ_CC_BLACK);
-  if(!qz_buffered(cell))
-    free_cell(st, cell);
+  size_t base = st->work_stack_size;
+  push_work(st, cell);
+
+  while(st->work_stack_size > base) {
+    cell = st->work_stack[--st->work_stack_size];
+    D_LOG;
+    qz_set_refcount(cell, 0);
+    qz_weak_release(st, cell);
+
+    children_t ch;
+    children_begin(&ch, cell);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      if(qz_refcount(child) == 1 && !stack_in_use(st) && !qz_deferred(child))
+        push_work(st, child);
+      else
+        decrement(st, child);
+    }
+
+    qz_set_color(cell, QZ_CC_BLACK);
+    if(qz_buffered(cell))
+      close_port(cell);
+    else
+      free_cell(st, cell);
+  }
 }
 
 static void free_cell(qz_state_t* st, qz_cell_t* cell) /* I never liked that game */
 {
-  QZ_UNUSED(st);
   D_LOG;
-  if(qz_type(cell) == QZ_CT_PORT && cell->value.port.fp)
-    fclose(cell->value.port.fp);
-  free(cell);
+  close_port(cell);
+  qz_weak_release(st, cell);
+  if(qz_type(cell) == QZ_CT_CODE)
+    qz_free_code(cell);
+  qz_free_cell(st, cell);
+}
+
+/* Incremental collection. Marking and scanning the possible roots' subgraphs are done as above,
+ * a budget of cells at a time whenever a prim call returns, but the counts less the references
+ * between the cells visited are kept in st->trial, as the mutator goes on counting meanwhile.
+ * Its changes make those counts stale, so the cells found white are only candidates. Once scanning
+ * is done, their counts are checked against each other at once, with the stack counted, and only
+ * those referenced by nothing else are freed. That's the one part of the work not split in steps,
+ * and it's bounded by the garbage found.
+ * The counts are the barrier: a cell visited has a reference more until the collection is done,
+ * so the mutator can't free it under the collection, and one losing a reference meanwhile turns
+ * purple and is buffered, for the next collection to look again. */
+
+static size_t trial_hash(qz_cell_t* cell)
+{
+  /* fibonacci hashing, as for immediates in quuz-hash.c */
+  return (size_t)(((uint64_t)(uintptr_t)cell * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+}
+
+static qz_trial_t* probe_trial(qz_trial_t* trial, size_t capacity, qz_cell_t* cell)
+{
+  size_t mask = capacity - 1;
+  for(size_t i = trial_hash(cell) & mask; trial[i].cell; i = (i + 1) & mask) {
+    if(trial[i].cell == cell)
+      return &trial[i];
+  }
+  return NULL;
+}
+
+static qz_trial_t* find_trial(qz_state_t* st, qz_cell_t* cell)
+{
+  if(st->trial_capacity == 0)
+    return NULL;
+
+  qz_trial_t* trial = probe_trial(st->trial, st->trial_capacity, cell);
+  if(trial || !st->old_trial)
+    return trial;
+
+  /* the old slots moved already, or whose cell qz_move_cell() moved, are only kept for the probes through them */
+  trial = probe_trial(st->old_trial, st->old_trial_capacity, cell);
+  if(trial && ((size_t)(trial - st->old_trial) < st->trial_moved || trial->color == QZ_CC_PURPLE))
+    return NULL;
+  return trial;
+}
+
+static qz_trial_t* empty_trial(qz_trial_t* trial, size_t capacity, qz_cell_t* cell)
+{
+  size_t mask = capacity - 1;
+  size_t i = trial_hash(cell) & mask;
+  while(trial[i].cell)
+    i = (i + 1) & mask;
+  return &trial[i];
+}
+
+static qz_trial_t* insert_trial(qz_state_t* st, qz_cell_t* cell)
+{
+  qz_trial_t* trial = empty_trial(st->trial, st->trial_capacity, cell);
+  trial->cell = cell;
+  st->trial_size++;
+  return trial;
+}
+
+/* shift back the entries after it until one is home or a slot is empty, as in quuz-hash.c
+ * one in the old table is only flagged purple instead, the entries after it may not be moved yet */
+static void remove_trial(qz_state_t* st, qz_trial_t* trial)
+{
+  st->trial_size--;
+  if(st->old_trial && trial >= st->old_trial && trial < st->old_trial + st->old_trial_capacity) {
+    trial->color = QZ_CC_PURPLE;
+    return;
+  }
+
+  size_t mask = st->trial_capacity - 1;
+  size_t i = trial - st->trial;
+
+  for(size_t j = (i + 1) & mask; st->trial[j].cell; j = (j + 1) & mask) {
+    /* the entry at j can move to i unless its home is after i */
+    size_t home = trial_hash(st->trial[j].cell) & mask;
+    if(((j - home) & mask) >= ((j - i) & mask)) {
+      st->trial[i] = st->trial[j];
+      i = j;
+    }
+  }
+
+  st->trial[i].cell = NULL;
+}
+
+/* move the entries of some slots of the old table to the new one */
+static void move_trial(qz_state_t* st, size_t slots)
+{
+  while(st->old_trial && slots-- > 0) {
+    qz_trial_t* trial = &st->old_trial[st->trial_moved++];
+    if(trial->cell && trial->color != QZ_CC_PURPLE)
+      *empty_trial(st->trial, st->trial_capacity, trial->cell) = *trial;
+
+    if(st->trial_moved == st->old_trial_capacity) {
+      free(st->old_trial);
+      st->old_trial = NULL;
+      st->old_trial_capacity = 0;
+    }
+  }
+}
+
+/* rehashing every entry at once would be the longest pause by far, so the table doubles,
+ * and visit() moves two old slots for each cell it adds, all are moved by the time it's half full again */
+static void grow_trial(qz_state_t* st)
+{
+  assert(!st->old_trial);
+  if(st->trial_size > 0) {
+    st->old_trial = st->trial;
+    st->old_trial_capacity = st->trial_capacity;
+    st->trial_moved = 0;
+  }
+  else {
+    free(st->trial);
+  }
+
+  st->trial_capacity = st->trial_capacity ? st->trial_capacity*2 : 64;
+  st->trial = (qz_trial_t*)calloc(st->trial_capacity, sizeof(qz_trial_t));
+}
+
+/* hold a cell and leave its children to mark_trial() */
+static qz_trial_t* visit(qz_state_t* st, qz_cell_t* cell)
+{
+  move_trial(st, 2);
+  if((st->trial_size + 1)*2 > st->trial_capacity)
+    grow_trial(st);
+
+  qz_trial_t* trial = insert_trial(st, cell);
+  trial->count = qz_refcount(cell);
+  trial->color = QZ_CC_GRAY;
+
+  qz_set_refcount(cell, qz_refcount(cell) + 1);
+  qz_set_color(cell, QZ_CC_GRAY);
+  push_work(st, cell);
+  return trial;
+}
+
+/* let go of a cell visited, what the mutator dropped meanwhile is released */
+static void drop_hold(qz_state_t* st, qz_cell_t* cell)
+{
+  if(qz_color(cell) == QZ_CC_GRAY)
+    qz_set_color(cell, QZ_CC_BLACK);
+
+  size_t refcount = qz_refcount(cell);
+  if(refcount == 1) {
+    decrement(st, cell);
+  }
+  else {
+    qz_set_refcount(cell, refcount - 1);
+    /* a possible root still buffered for this collection when it turned purple again */
+    if(qz_color(cell) == QZ_CC_PURPLE && !qz_buffered(cell))
+      buffer_root(st, cell);
+  }
+}
+
+static void spend(size_t* budget, size_t work)
+{
+  *budget = *budget > work ? *budget - work : 0;
+}
+
+/* the roots still purple are visited, the others dropped as in mark_roots() */
+static void mark_trial_root(qz_state_t* st, size_t i)
+{
+  qz_cell_t* cell = st->trial_roots[i];
+  qz_set_buffered(cell, 0);
+
+  if(qz_color(cell) == QZ_CC_PURPLE && qz_refcount(cell) > 0 && !find_trial(st, cell)) {
+    visit(st, cell);
+    return;
+  }
+
+  if(qz_color(cell) == QZ_CC_BLACK && qz_refcount(cell) == 0)
+    free_cell(st, cell);
+  st->trial_roots[i] = NULL;
+}
+
+/* like mark_gray() on each root, returns nonzero once done */
+static int mark_trial(qz_state_t* st, size_t* budget)
+{
+  while(*budget > 0) {
+    if(st->work_stack_size > 0) {
+      children_t ch;
+      children_begin(&ch, st->work_stack[--st->work_stack_size]);
+      spend(budget, 1);
+
+      for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+        qz_trial_t* trial = find_trial(st, child);
+        if(!trial)
+          trial = visit(st, child);
+
+        /* counts already stale could go below zero */
+        if(trial->count > 0)
+          trial->count--;
+        spend(budget, 1);
+      }
+    }
+    else if(st->collect_index < st->trial_roots_size) {
+      mark_trial_root(st, st->collect_index++);
+      spend(budget, 1);
+    }
+    else {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* like scan() on each root, the cells above black_base on the work stack are left to scan_black()
+ * the white cells are gathered as candidates, returns nonzero once done */
+static int scan_trial(qz_state_t* st, size_t* budget)
+{
+  while(*budget > 0) {
+    if(st->work_stack_size == st->black_base)
+      st->black_base = SIZE_MAX;
+
+    if(st->black_base != SIZE_MAX) {
+      children_t ch;
+      children_begin(&ch, st->work_stack[--st->work_stack_size]);
+      spend(budget, 1);
+
+      for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+        qz_trial_t* trial = find_trial(st, child);
+        if(!trial)
+          continue;
+
+        trial->count++;
+        if(trial->color != QZ_CC_BLACK) {
+          trial->color = QZ_CC_BLACK;
+          push_work(st, child);
+        }
+        spend(budget, 1);
+      }
+    }
+    else if(st->work_stack_size > 0) {
+      qz_cell_t* cell = st->work_stack[--st->work_stack_size];
+      qz_trial_t* trial = find_trial(st, cell);
+      spend(budget, 1);
+
+      if(trial->color != QZ_CC_GRAY)
+        continue;
+
+      if(trial->count > 0) {
+        trial->color = QZ_CC_BLACK;
+        st->black_base = st->work_stack_size;
+        push_work(st, cell);
+        continue;
+      }
+
+      trial->color = QZ_CC_WHITE;
+      push_white(st, cell);
+
+      children_t ch;
+      children_begin(&ch, cell);
+      for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+        trial = find_trial(st, child);
+        if(trial && trial->color == QZ_CC_GRAY)
+          push_work(st, child);
+        spend(budget, 1);
+      }
+    }
+    else if(st->collect_index < st->trial_roots_size) {
+      qz_cell_t* cell = st->trial_roots[st->collect_index++];
+      if(cell)
+        push_work(st, cell);
+      spend(budget, 1);
+    }
+    else if(st->old_trial) {
+      /* releasing goes through the new table alone */
+      move_trial(st, 1);
+      spend(budget, 1);
+    }
+    else {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int is_candidate(qz_state_t* st, qz_cell_t* cell)
+{
+  qz_trial_t* trial = find_trial(st, cell);
+  return trial && trial->color == QZ_CC_WHITE;
+}
+
+/* free the candidates that are garbage after all, done at once */
+static void collect_trial(qz_state_t* st)
+{
+  st->collecting = 1;
+  st->stack_counted++;
+  count_stack(st, count_stack_cell);
+  release_deferred(st);
+
+  /* the candidates' counts, less the references between them and the collection's own */
+  size_t j = 0;
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    qz_cell_t* cell = st->white_cells[i];
+    qz_trial_t* trial = find_trial(st, cell);
+    if(trial->color == QZ_CC_WHITE) {
+      trial->count = qz_refcount(cell) - 1;
+      st->white_cells[j++] = cell;
+    }
+  }
+  st->white_cells_size = j;
+
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    children_t ch;
+    children_begin(&ch, st->white_cells[i]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      qz_trial_t* trial = find_trial(st, child);
+      if(trial && trial->color == QZ_CC_WHITE) {
+        assert(trial->count != 0);
+        trial->count--;
+      }
+    }
+  }
+
+  /* the candidates still counted are alive, and so is what they reach */
+  size_t base = st->work_stack_size;
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    qz_trial_t* trial = find_trial(st, st->white_cells[i]);
+    if(trial->color != QZ_CC_WHITE || trial->count == 0)
+      continue;
+
+    trial->color = QZ_CC_BLACK;
+    push_work(st, st->white_cells[i]);
+
+    while(st->work_stack_size > base) {
+      children_t ch;
+      children_begin(&ch, st->work_stack[--st->work_stack_size]);
+
+      for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+        trial = find_trial(st, child);
+        if(trial && trial->color == QZ_CC_WHITE) {
+          trial->color = QZ_CC_BLACK;
+          push_work(st, child);
+        }
+      }
+    }
+  }
+
+  j = 0;
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    if(is_candidate(st, st->white_cells[i]))
+      st->white_cells[j++] = st->white_cells[i];
+  }
+  st->white_cells_size = j;
+
+  /* the garbage's references to the cells that live on are dropped once it's freed */
+  for(size_t i = 0; i < st->white_cells_size; i++) {
+    children_t ch;
+    children_begin(&ch, st->white_cells[i]);
+
+    for(qz_cell_t* child; (child = children_next(&ch)); /**/) {
+      if(!is_candidate(st, child))
+        push_work(st, child);
+    }
+  }
+
+  forget_white(st);
+  free_white(st);
+
+  while(st->work_stack_size > base)
+    decrement(st, st->work_stack[--st->work_stack_size]);
+
+  st->trial_roots_size = 0;
+  st->collect_bytes = st->bytes_allocated;
+  st->collections++;
+  st->collecting = 0;
+
+  count_stack(st, uncount_stack_cell);
+  st->stack_counted--;
+
+  while(st->weak_unrefs_size > 0)
+    qz_unref(st, st->weak_unrefs[--st->weak_unrefs_size]);
+}
+
+/* let go of the cells visited but the garbage freed, which are still white, returns nonzero once done */
+static int release_trial(qz_state_t* st, size_t* budget)
+{
+  while(*budget > 0) {
+    if(st->collect_index == st->trial_capacity) {
+      st->trial_size = 0;
+      return 1;
+    }
+
+    qz_trial_t* trial = &st->trial[st->collect_index++];
+    if(trial->cell && trial->color != QZ_CC_WHITE)
+      drop_hold(st, trial->cell);
+    trial->cell = NULL;
+    spend(budget, 1);
+  }
+  return 0;
+}
+
+/* find_trial() while releasing, when the slots before collect_index are emptied already
+ * a cell still held is in a slot after, and so is the part of its probe it hasn't passed */
+static qz_trial_t* find_released_trial(qz_state_t* st, qz_cell_t* cell)
+{
+  if(st->collect_index == st->trial_capacity)
+    return NULL;
+
+  size_t mask = st->trial_capacity - 1;
+  int skipped = 0;
+  for(size_t i = trial_hash(cell) & mask; /**/; i = (i + 1) & mask) {
+    if(i < st->collect_index) {
+      if(skipped)
+        return NULL;
+      skipped = 1;
+      i = st->collect_index;
+    }
+
+    if(!st->trial[i].cell)
+      return NULL;
+    if(st->trial[i].cell == cell)
+      return &st->trial[i];
+  }
+}
+
+static void move_cells(qz_cell_t** cells, size_t size, qz_cell_t* cell, qz_cell_t* new_cell)
+{
+  for(size_t i = 0; i < size; i++) {
+    if(cells[i] == cell)
+      cells[i] = new_cell;
+  }
+}
+
+/* a cell was copied to a new one, which takes its place wherever the collector keeps it
+ * the new cell has the old one's info, including a collection's hold on it */
+void qz_move_cell(qz_state_t* st, qz_cell_t* cell, qz_cell_t* new_cell)
+{
+  if(qz_buffered(cell))
+    move_cells(st->root_buffer, st->root_buffer_size, cell, new_cell);
+  if(qz_deferred(cell))
+    move_cells(st->zct, st->zct_size, cell, new_cell);
+
+  qz_trial_t* trial = NULL;
+  if(st->collect_phase == QZ_PHASE_MARK || st->collect_phase == QZ_PHASE_SCAN) {
+    trial = find_trial(st, cell);
+  }
+  else if(st->collect_phase == QZ_PHASE_RELEASE) {
+    /* the garbage is white by then, and so is a cell let go of as it moved */
+    trial = find_released_trial(st, cell);
+    if(trial && trial->color == QZ_CC_WHITE)
+      trial = NULL;
+  }
+
+  if(!trial) {
+    assert(qz_refcount(cell) == 1);
+    /* a root not yet marked, or dropped already */
+    if(qz_buffered(cell))
+      move_cells(st->trial_roots, st->trial_roots_size, cell, new_cell);
+    return;
+  }
+  assert(qz_refcount(cell) == 2);
+
+  /* the new cell is let go of right away, rather than rehashed in a table being emptied
+   * the slot is left for release_trial() to empty, so the probes through it stay whole */
+  if(st->collect_phase == QZ_PHASE_RELEASE) {
+    trial->color = QZ_CC_WHITE;
+    drop_hold(st, new_cell);
+    return;
+  }
+
+  qz_trial_t moved = *trial;
+  moved.cell = new_cell;
+  remove_trial(st, trial);
+  *insert_trial(st, new_cell) = moved;
+
+  move_cells(st->trial_roots, st->trial_roots_size, cell, new_cell);
+  move_cells(st->work_stack, st->work_stack_size, cell, new_cell);
+  /* blackened or not, a cell found white stays among the candidates until collect_trial() */
+  move_cells(st->white_cells, st->white_cells_size, cell, new_cell);
+}
+
+static void trial_step(qz_state_t* st, size_t budget)
+{
+  for(;;) {
+    switch(st->collect_phase) {
+    case QZ_PHASE_IDLE:
+      return;
+    case QZ_PHASE_START:
+    {
+      /* the roots buffered from now on are left to the next collection */
+      qz_cell_t** roots = st->trial_roots;
+      st->trial_roots = st->root_buffer;
+      st->root_buffer = roots;
+
+      size_t capacity = st->trial_roots_capacity;
+      st->trial_roots_capacity = st->root_buffer_capacity;
+      st->root_buffer_capacity = capacity;
+
+      st->trial_roots_size = st->root_buffer_size;
+      st->root_buffer_size = 0;
+
+      st->collect_index = 0;
+      st->collect_phase = QZ_PHASE_MARK;
+      break;
+    }
+    case QZ_PHASE_MARK:
+      if(!mark_trial(st, &budget))
+        return;
+      st->collect_index = 0;
+      st->collect_phase = QZ_PHASE_SCAN;
+      break;
+    case QZ_PHASE_SCAN:
+      if(!scan_trial(st, &budget))
+        return;
+      D_PRINTF("collect_trial starting...\n");
+      collect_trial(st);
+      st->collect_index = 0;
+      st->collect_phase = QZ_PHASE_RELEASE;
+      break;
+    case QZ_PHASE_RELEASE:
+      if(!release_trial(st, &budget))
+        return;
+      st->collect_phase = st->collect_budget > 0 && should_collect(st) ? QZ_PHASE_START : QZ_PHASE_IDLE;
+      return;
+    }
+  }
+}
+
+/* symbols are immediates with no count, one is unused once neither a cell nor a root holds it
+ * every object a cell holds is looked at, weak or not, except in the table from names to symbols */
+static void mark_sym(qz_state_t* st, qz_obj_t obj)
+{
+  if(qz_is_sym(obj) && qz_to_sym(obj) < st->next_sym)
+    st->sym_marks[qz_to_sym(obj)] = 1;
+}
+
+static void mark_syms(qz_state_t* st, qz_obj_t* objs, size_t count, size_t stride)
+{
+  for(size_t i = 0; i < count; i++)
+    mark_sym(st, objs[i*stride]);
+}
+
+static void mark_cell_syms(qz_state_t* st, qz_cell_t* cell)
+{
+  if(cell == qz_to_cell(st->name_sym))
+    return;
+
+  switch(qz_type(cell)) {
+  case QZ_CT_HASH:
+  {
+    qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+    size_t stride = sizeof(qz_hash_slot_t)/sizeof(qz_obj_t);
+    mark_syms(st, &slots->key, cell->value.array.capacity, stride);
+    mark_syms(st, &slots->value, cell->value.array.capacity, stride);
+    break;
+  }
+  case QZ_CT_RECORD:
+    mark_sym(st, cell->value.record.name);
+    mark_syms(st, QZ_CELL_DATA(cell, qz_obj_t), cell->value.record.size, 1);
+    break;
+  default:
+  {
+    children_t ch;
+    children_begin(&ch, cell);
+    for(size_t i = 0; i < ch.runs; i++)
+      mark_syms(st, ch.objs[i], ch.counts[i], ch.strides[i]);
+    break;
+  }
+  }
+}
+
+/* the interpreter keeps symbols in C variables between the outermost qz_peval() and here,
+ * so every word on the C stack that looks like a symbol is taken to be one
+ * the registers are spilled onto it first so what they hold is seen too */
+QZ_STACK_SCANNER static void mark_c_stack(qz_state_t* st)
+{
+  jmp_buf regs;
+  setjmp(regs);
+#ifdef __GNUC__
+  __builtin_unwind_init();
+#endif
+
+  uintptr_t here = (uintptr_t)&regs;
+  uintptr_t base = (uintptr_t)st->c_stack_base;
+  const size_t* begin = (const size_t*)(here < base ? here : base);
+  const size_t* end = (const size_t*)(here < base ? base : here + sizeof(regs));
+
+  for(const size_t* word = begin; word < end; word++)
+    mark_sym(st, (qz_obj_t) { *word });
+}
+
+void qz_reclaim_syms(qz_state_t* st)
+{
+  /* only once as many symbols have been made as were in use before, and a fraction of
+   * the cells in use, so walking the symbols and the heap costs each made in proportion */
+  size_t in_use = st->next_sym - st->free_syms_size;
+  size_t cells = st->cells_allocated - st->cells_freed;
+  if(st->syms_made < QZ_SYM_THRESHOLD || st->syms_made < in_use - st->syms_made
+     || st->syms_made < cells/QZ_SYM_HEAP_RATIO)
+    return;
+  st->syms_made = 0;
+
+  st->sym_marks = (unsigned char*)calloc(st->next_sym, 1);
+  for(size_t i = 0; i < st->free_syms_size; i++)
+    st->sym_marks[st->free_syms[i]] = 1;
+
+  qz_each_cell(st, mark_cell_syms);
+
+  mark_c_stack(st);
+  mark_syms(st, st->stack, st->stack_size, 1);
+  for(size_t i = 0; i < st->frames_size; i++) {
+    mark_sym(st, st->frames[i].fun);
+    mark_sym(st, st->frames[i].env);
+    mark_sym(st, st->frames[i].old_env);
+  }
+  mark_syms(st, st->safety_buffer, st->safety_buffer_size, 1);
+  mark_sym(st, st->error_handler);
+  mark_sym(st, st->error_obj);
+  mark_sym(st, st->tail_expr);
+  mark_sym(st, st->tail_scope);
+  for(size_t i = 0; i < st->next_sym; i++)
+    mark_sym(st, st->globals[i]);
+
+  for(size_t i = st->fixed_syms; i < st->next_sym; i++) {
+    if(st->sym_marks[i] || !qz_is_none(st->globals[i]))
+      continue;
+
+    qz_obj_t name = st->sym_names[i];
+    if(!qz_is_none(name)) {
+      qz_hash_delete(st, &st->name_sym, name);
+      qz_unref(st, name);
+      st->sym_names[i] = QZ_NONE;
+    }
+
+    if(st->free_syms_size == st->free_syms_capacity) {
+      st->free_syms_capacity = st->free_syms_capacity ? st->free_syms_capacity*2 : 64;
+      st->free_syms = (size_t*)realloc(st->free_syms, st->free_syms_capacity*sizeof(size_t));
+    }
+    st->free_syms[st->free_syms_size++] = i;
+    st->syms_reclaimed++;
+  }
+
+  free(st->sym_marks);
+  st->sym_marks = NULL;
 }
 
 /* public functions */
@@ -264,11 +1279,72 @@ void qz_obliterate(qz_state_t* st, qz_obj_t obj)
 
 void qz_collect(qz_state_t* st)
 {
-  D_PRINTF("mark_roots starting...\n");
-  mark_roots(st);
-  D_PRINTF("scan roots starting...\n");
-  scan_roots(st);
-  D_PRINTF("collect_roots starting...\n");
-  collect_roots(st);
+  /* an incremental collection running is finished first, one yet to start is taken over */
+  if(st->collect_phase != QZ_PHASE_START)
+    trial_step(st, SIZE_MAX);
+  st->collect_phase = QZ_PHASE_IDLE;
+
+  /* the stack's references keep what it holds from looking like garbage
+   * releasing the cells waiting on it mustn't start another collection */
+  st->collecting = 1;
+  st->stack_counted++;
+  count_stack(st, count_stack_cell);
+  release_deferred(st);
+
+  if(st->trace_pending) {
+    st->trace_pending = 0;
+    D_PRINTF("trace_heap starting...\n");
+    trace_heap(st);
+  }
+  else {
+    D_PRINTF("mark_roots starting...\n");
+    mark_roots(st);
+    D_PRINTF("scan roots starting...\n");
+    scan_roots(st);
+    D_PRINTF("collect_roots starting...\n");
+    collect_roots(st);
+  }
+  st->collect_bytes = st->bytes_allocated;
+  st->collections++;
+  st->collecting = 0;
+
+  count_stack(st, uncount_stack_cell);
+  st->stack_counted--;
+
+  /* may buffer roots or even start another collection */
+  while(st->weak_unrefs_size > 0)
+    qz_unref(st, st->weak_unrefs[--st->weak_unrefs_size]);
   D_PRINTF("qz_collect done\n");
 }
+
+void qz_set_collect_policy(qz_state_t* st, qz_collect_policy_t policy, size_t threshold)
+{
+  st->collect_policy = policy;
+  st->collect_threshold = threshold;
+}
+
+void qz_set_collect_budget(qz_state_t* st, size_t budget)
+{
+  st->collect_budget = budget;
+}
+
+void qz_collect_step(qz_state_t* st)
+{
+  if(st->collect_phase == QZ_PHASE_IDLE)
+    return;
+
+  st->collect_steps++;
+  trial_step(st, st->collect_budget ? st->collect_budget : SIZE_MAX);
+}
+
+void qz_reconcile(qz_state_t* st)
+{
+  if(st->zct_size == 0)
+    return;
+
+  st->stack_counted++;
+  count_stack(st, count_stack_cell);
+  release_deferred(st);
+  count_stack(st, uncount_stack_cell);
+  st->stack_counted--;
+}
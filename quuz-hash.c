@@ -2,118 +2,988 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* city.cc */
 uint32_t CityHash32(const char *s, size_t len);
 
-static uint32_t hash_obj(qz_obj_t obj)
+/* quuz-collector.c */
+void qz_move_cell(qz_state_t* st, qz_cell_t* cell, qz_cell_t* new_cell);
+
+/* mix the bits of an immediate, symbols and fixnums are already unique integers
+ * fibonacci hashing, the high bits of the product depend on every bit of the key */
+static uint32_t hash_immediate(qz_obj_t obj)
 {
-  if(qz_is_cell(obj))
-  {
-    qz_cell_t* cell = qz_to_cell(obj);
-    qz_cell_type_t type = qz_type(cell);
+  return (uint32_t)(((uint64_t)obj.value * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+}
+
+#define HASH_DEPTH 4
+
+/* hash an object so that objects qz_equal() to each other hash alike
+ * pairs and vectors are hashed a few elements deep, other cells only by type */
+static uint32_t hash_equal(qz_obj_t obj, int depth)
+{
+  if(!qz_is_cell(obj) || qz_is_null(obj))
+    return hash_immediate(obj);
+
+  qz_cell_t* cell = qz_to_cell(obj);
+  qz_cell_type_t type = qz_type(cell);
+
+  if(type == QZ_CT_STRING)
+    return CityHash32(QZ_CELL_DATA(cell, char), cell->value.array.size*sizeof(char));
+
+  if(type == QZ_CT_BYTEVECTOR)
+    return CityHash32(QZ_CELL_DATA(cell, char), cell->value.array.size*sizeof(uint8_t));
+
+  uint32_t hash = type;
 
-    if(type == QZ_CT_STRING)
-      return CityHash32(QZ_CELL_DATA(cell, char), cell->value.array.size*sizeof(char));
+  if(depth == 0)
+    return hash;
 
-    assert(0); /* can't hash this type */
+  if(type == QZ_CT_PAIR) {
+    hash = hash*31 + hash_equal(cell->value.pair.first, depth - 1);
+    hash = hash*31 + hash_equal(cell->value.pair.rest, depth - 1);
+  }
+  else if(type == QZ_CT_VECTOR) {
+    for(size_t i = 0; i < cell->value.array.size && i < HASH_DEPTH; i++)
+      hash = hash*31 + hash_equal(QZ_CELL_DATA(cell, qz_obj_t)[i], depth - 1);
+  }
+
+  return hash;
+}
+
+/* hash a pair or vector by its elements as immediates, so every element counts and none is looked into */
+static uint32_t hash_shallow(qz_obj_t obj)
+{
+  if(!qz_is_cell(obj) || qz_is_null(obj))
+    return hash_immediate(obj);
+
+  qz_cell_t* cell = qz_to_cell(obj);
+  qz_cell_type_t type = qz_type(cell);
+  uint32_t hash = type;
+
+  if(type == QZ_CT_PAIR) {
+    hash = hash*31 + hash_immediate(cell->value.pair.first);
+    hash = hash*31 + hash_immediate(cell->value.pair.rest);
+  }
+  else if(type == QZ_CT_VECTOR) {
+    for(size_t i = 0; i < cell->value.array.size; i++)
+      hash = hash*31 + hash_immediate(QZ_CELL_DATA(cell, qz_obj_t)[i]);
+  }
+  else {
+    hash = hash_equal(obj, 0);
   }
 
-  return CityHash32((char*)&obj, sizeof(obj));
+  return hash;
 }
 
-/* create a new hash object with the given capacity */
-static qz_cell_t* make_hash(size_t capacity)
+static uint32_t hash_obj(qz_hash_kind_t kind, qz_obj_t obj)
 {
-  qz_cell_t* cell = qz_make_cell(QZ_CT_HASH, capacity*sizeof(qz_pair_t));
+  if(kind == QZ_HASH_EQV)
+    return hash_immediate(obj);
+
+  if(kind == QZ_HASH_SHALLOW)
+    return hash_shallow(obj);
+
+  return hash_equal(obj, HASH_DEPTH);
+}
+
+static int same_elements(qz_obj_t a, qz_obj_t b)
+{
+  if(a.value == b.value)
+    return 1;
+
+  if(!qz_is_cell(a) || !qz_is_cell(b) || qz_is_null(a) || qz_is_null(b))
+    return 0;
+
+  qz_cell_t* a_cell = qz_to_cell(a);
+  qz_cell_t* b_cell = qz_to_cell(b);
+
+  if(qz_type(a_cell) != qz_type(b_cell))
+    return 0;
+
+  if(qz_type(a_cell) == QZ_CT_PAIR)
+    return a_cell->value.pair.first.value == b_cell->value.pair.first.value
+      && a_cell->value.pair.rest.value == b_cell->value.pair.rest.value;
+
+  if(qz_type(a_cell) == QZ_CT_VECTOR)
+    return a_cell->value.array.size == b_cell->value.array.size
+      && memcmp(QZ_CELL_DATA(a_cell, qz_obj_t), QZ_CELL_DATA(b_cell, qz_obj_t), a_cell->value.array.size*sizeof(qz_obj_t)) == 0;
+
+  return qz_equal(a, b);
+}
+
+/* immediates are only equal to themselves, only cells need qz_equal() */
+static int same_key(qz_hash_kind_t kind, qz_obj_t a, qz_obj_t b)
+{
+  if(kind == QZ_HASH_EQV)
+    return qz_eqv(a, b);
+
+  if(kind == QZ_HASH_SHALLOW)
+    return same_elements(a, b);
+
+  return a.value == b.value || (qz_is_cell(b) && qz_equal(a, b));
+}
+
+/* small hashes place entries by robin hood probing: an entry being inserted takes
+ * the slot of any entry nearer to its home slot, which keeps probes short
+ * capacities are powers of two, so the home slot is the hash masked
+ *
+ * large hashes probe linearly, but look at a control byte per slot first, so a probe
+ * reads a few bytes per slot instead of whole slots, GROUP_SIZE of them at a time
+ * a control byte is EMPTY, DELETED or the low seven bits of the slot's hash, the rest of the hash picks the home slot
+ * the first GROUP_SIZE control bytes are repeated after the last, so a group can be read past the end
+ * a probe stops at the first group with an EMPTY slot, a deleted entry whose slot such a probe might have
+ * gone past leaves DELETED behind, which insertions reuse, and the count of those follows the control bytes */
+
+#define MIN_CAPACITY 4
+#define GROUP_MIN_CAPACITY 1024
+#define GROUP_SIZE 16
+#define EMPTY 0x80
+#define DELETED 0xfe
+
+static int grouped(qz_cell_t* cell)
+{
+  return cell->value.array.capacity >= GROUP_MIN_CAPACITY;
+}
+
+static uint8_t* control_bytes(qz_cell_t* cell)
+{
+  return (uint8_t*)(QZ_CELL_DATA(cell, qz_hash_slot_t) + cell->value.array.capacity);
+}
+
+static size_t* deleted_slots(qz_cell_t* cell)
+{
+  return (size_t*)(control_bytes(cell) + cell->value.array.capacity + GROUP_SIZE);
+}
+
+static void set_control(qz_cell_t* cell, size_t index, uint8_t control)
+{
+  uint8_t* controls = control_bytes(cell);
+  controls[index] = control;
+  if(index < GROUP_SIZE)
+    controls[cell->value.array.capacity + index] = control;
+}
+
+/* bit i is set if the control byte at i matches */
+static uint32_t match_group(const uint8_t* group, uint8_t control)
+{
+#ifdef __SSE2__
+  __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)control)));
+#else
+  uint32_t bits = 0;
+  for(size_t i = 0; i < GROUP_SIZE; i++)
+    bits |= (uint32_t)(group[i] == control) << i;
+  return bits;
+#endif
+}
+
+static uint32_t match_empty(const uint8_t* group)
+{
+  return match_group(group, EMPTY);
+}
+
+/* EMPTY and DELETED are the only control bytes with their high bit set */
+static uint32_t match_free(const uint8_t* group)
+{
+#ifdef __SSE2__
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+  return match_group(group, EMPTY) | match_group(group, DELETED);
+#endif
+}
+
+static size_t lowest_bit(uint32_t bits)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(bits);
+#else
+  size_t i = 0;
+  while(!(bits & 1)) {
+    bits >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static size_t home_slot(qz_cell_t* cell, size_t hash)
+{
+  size_t mask = cell->value.array.capacity - 1;
+  return grouped(cell) ? (hash >> 7) & mask : hash & mask;
+}
+
+/* create a new hash object with the given capacity, a power of two */
+static qz_cell_t* make_hash(qz_state_t* st, size_t capacity)
+{
+  assert((capacity & (capacity - 1)) == 0);
+
+  size_t controls = capacity >= GROUP_MIN_CAPACITY ? capacity + GROUP_SIZE : 0;
+  size_t extra = controls ? sizeof(size_t) : 0;
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_HASH, capacity*sizeof(qz_hash_slot_t) + controls + extra);
   cell->value.array.size = 0;
   cell->value.array.capacity = capacity;
 
-  qz_pair_t* data = QZ_CELL_DATA(cell, qz_pair_t);
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
 
   for(size_t i = 0; i < capacity; i++) {
-    data[i].first = QZ_NONE;
-    data[i].rest = QZ_NONE;
+    slots[i].key = QZ_NONE;
+    slots[i].value = QZ_NONE;
+    slots[i].hash = 0;
   }
 
+  memset(control_bytes(cell), EMPTY, controls);
+  if(controls)
+    *deleted_slots(cell) = 0;
+
   return cell;
 }
 
-/* finds the pair where the given key is or would be stored */
-static qz_pair_t* get_hash(qz_cell_t* cell, qz_obj_t key)
+/* how far the slot at index is from the home slot of hash */
+static size_t probe_distance(size_t mask, size_t hash, size_t index)
+{
+  return (index - hash) & mask;
+}
+
+/* tells whether a slot holding an entry with the right hash is the one wanted */
+typedef int (*match_func)(qz_hash_slot_t* slot, const void* data);
+
+/* finds the slot with the given hash that match accepts, or NULL */
+static qz_hash_slot_t* probe(qz_cell_t* cell, size_t hash, match_func match, const void* data)
 {
   assert(qz_type(cell) == QZ_CT_HASH);
 
-  qz_pair_t* data = QZ_CELL_DATA(cell, qz_pair_t);
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+  size_t mask = cell->value.array.capacity - 1;
+
+  if(grouped(cell)) {
+    const uint8_t* controls = control_bytes(cell);
+    size_t home = home_slot(cell, hash);
+
+    /* the entry is most likely at home, fetch it while the control bytes are read */
+#ifdef __GNUC__
+    __builtin_prefetch(&slots[home]);
+#endif
 
-  for(uint32_t i = hash_obj(key); /**/; i++)
+    for(size_t i = home; /**/; i = (i + GROUP_SIZE) & mask)
+    {
+      for(uint32_t bits = match_group(controls + i, hash & 0x7f); bits; bits &= bits - 1) {
+        qz_hash_slot_t* slot = &slots[(i + lowest_bit(bits)) & mask];
+        if(slot->hash == hash && match(slot, data))
+          return slot;
+      }
+
+      /* an entry is never stored beyond an empty slot after its home */
+      if(match_empty(controls + i))
+        return NULL;
+    }
+  }
+
+  for(size_t i = hash & mask, dist = 0; /**/; i = (i + 1) & mask, dist++)
   {
-    size_t slot = i % cell->value.array.capacity;
+    qz_hash_slot_t* slot = &slots[i];
 
-    if(qz_is_none(data[slot].first) || qz_equal(data[slot].first, key))
-      return &data[slot];
+    /* the key would have displaced an entry nearer to its home */
+    if(qz_is_none(slot->key) || probe_distance(mask, slot->hash, i) < dist)
+      return NULL;
+
+    if(slot->hash == hash && match(slot, data))
+      return slot;
   }
 }
 
-/* reallocates the given hash, doubling its capacity */
-static void realloc_hash(qz_obj_t* obj)
+typedef struct key_match {
+  qz_hash_kind_t kind;
+  qz_obj_t key;
+} key_match_t;
+
+static int match_key(qz_hash_slot_t* slot, const void* data)
+{
+  const key_match_t* km = (const key_match_t*)data;
+  return same_key(km->kind, slot->key, km->key);
+}
+
+/* finds the slot where the given key is stored, or NULL */
+static qz_hash_slot_t* find_slot(qz_cell_t* cell, qz_hash_kind_t kind, qz_obj_t key, size_t hash)
+{
+  key_match_t km = { kind, key };
+  return probe(cell, hash, match_key, &km);
+}
+
+/* store an entry whose key isn't in the hash, the hash must have room */
+static void insert_slot(qz_cell_t* cell, qz_hash_slot_t entry)
+{
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+  size_t mask = cell->value.array.capacity - 1;
+
+  if(grouped(cell)) {
+    const uint8_t* controls = control_bytes(cell);
+
+    for(size_t i = home_slot(cell, entry.hash); /**/; i = (i + GROUP_SIZE) & mask)
+    {
+      uint32_t room = match_free(controls + i);
+      if(room) {
+        size_t index = (i + lowest_bit(room)) & mask;
+        if(controls[index] == DELETED)
+          (*deleted_slots(cell))--;
+        slots[index] = entry;
+        set_control(cell, index, entry.hash & 0x7f);
+        return;
+      }
+    }
+  }
+
+  for(size_t i = entry.hash & mask, dist = 0; /**/; i = (i + 1) & mask, dist++)
+  {
+    qz_hash_slot_t* slot = &slots[i];
+
+    if(qz_is_none(slot->key)) {
+      *slot = entry;
+      return;
+    }
+
+    /* take the slot and carry on inserting the entry that was there */
+    size_t slot_dist = probe_distance(mask, slot->hash, i);
+    if(slot_dist < dist) {
+      qz_hash_slot_t displaced = *slot;
+      *slot = entry;
+      entry = displaced;
+      dist = slot_dist;
+    }
+  }
+}
+
+/* reallocates the given hash with a new capacity, a power of two */
+static void realloc_hash(qz_state_t* st, qz_obj_t* obj, size_t capacity)
 {
   qz_cell_t* cell = qz_to_cell(*obj);
-  assert(qz_refcount(cell) == 1);
+  assert(capacity > cell->value.array.size);
 
   /* make new hash */
-  qz_cell_t* new_cell = make_hash(cell->value.array.capacity * 2);
+  qz_cell_t* new_cell = make_hash(st, capacity);
 
-  new_cell->info = cell->info; /* collector fields must be copied */
+  /* collector fields must be copied, the pool must not */
+  size_t pool = qz_pool(new_cell);
+  new_cell->info = cell->info;
+  qz_set_pool(new_cell, pool);
   new_cell->value.array.size = cell->value.array.size;
 
-  /* copy pairs to new hash */
+  /* move entries to new hash, their hashes are kept */
   for(size_t i = 0; i < cell->value.array.capacity; i++)
   {
-    qz_pair_t* pair = QZ_CELL_DATA(cell, qz_pair_t) + i;
-
-    if(qz_is_none(pair->first) || qz_is_none(pair->rest))
-      continue;
-
-    qz_pair_t* new_pair = get_hash(new_cell, pair->first);
+    qz_hash_slot_t* slot = QZ_CELL_DATA(cell, qz_hash_slot_t) + i;
 
-    *new_pair = *pair;
+    if(!qz_is_none(slot->key))
+      insert_slot(new_cell, *slot);
   }
 
+  /* the collector may be holding the old cell as a possible root, waiting to release it,
+   * or visiting it in an incremental collection */
+  qz_move_cell(st, cell, new_cell);
+
   /* replace old cell with new */
-  free(cell);
+  qz_free_cell(st, cell);
   *obj = qz_from_cell(new_cell);
 }
 
-qz_obj_t qz_make_hash(void)
+qz_obj_t qz_make_hash(qz_state_t* st)
 {
-  return qz_from_cell(make_hash(4));
+  return qz_from_cell(make_hash(st, MIN_CAPACITY));
+}
+
+static qz_obj_t* hash_get(qz_obj_t obj, qz_hash_kind_t kind, qz_obj_t key)
+{
+  qz_hash_slot_t* slot = find_slot(qz_to_cell(obj), kind, key, hash_obj(kind, key));
+
+  if(!slot)
+    return NULL;
+
+  return &slot->value;
+}
+
+/* a weak part of an entry holds no reference
+ * its cell is flagged so that freeing it looks for the entry, see qz_weak_release() */
+static void hold(qz_state_t* st, int weak, qz_obj_t obj)
+{
+  if(!weak)
+    return;
+
+  if(qz_is_cell(obj) && !qz_is_null(obj))
+    qz_set_held(qz_to_cell(obj), 1);
+
+  qz_unref(st, obj);
+}
+
+static void let_go(qz_state_t* st, int weak, qz_obj_t obj)
+{
+  if(!weak)
+    qz_unref(st, obj);
+}
+
+static void hash_set(qz_state_t* st, qz_obj_t* obj, qz_hash_kind_t kind, qz_obj_t key, qz_obj_t value)
+{
+  size_t hash = hash_obj(kind, key);
+  qz_cell_t* cell = qz_to_cell(*obj);
+  qz_hash_slot_t* slot = find_slot(cell, kind, key, hash);
+  int weak = qz_weak(cell);
+
+  if(slot) {
+    /* a weak key stays as it was, the entry goes when it's freed */
+    if(weak & QZ_WEAK_KEYS) {
+      qz_unref(st, key);
+    }
+    else {
+      qz_unref(st, slot->key);
+      slot->key = key;
+    }
+    let_go(st, weak & QZ_WEAK_VALUES, slot->value);
+    slot->value = value;
+    hold(st, weak & QZ_WEAK_VALUES, value);
+    return;
+  }
+
+  /* keep the load under 70%, counting DELETED slots
+   * reallocating drops those, the capacity stays while entries fill at most half, so it won't shrink right back */
+  size_t deleted = grouped(cell) ? *deleted_slots(cell) : 0;
+  if((cell->value.array.size + deleted + 1) * 10 > cell->value.array.capacity * 7) {
+    int grow = (cell->value.array.size + 1) * 2 > cell->value.array.capacity;
+    realloc_hash(st, obj, grow ? cell->value.array.capacity * 2 : cell->value.array.capacity);
+    cell = qz_to_cell(*obj);
+  }
+
+  qz_hash_slot_t entry = { key, value, hash };
+  insert_slot(cell, entry);
+  cell->value.array.size++;
+
+  /* last, dropping the reference may free the cell and remove the entry again */
+  hold(st, weak & QZ_WEAK_KEYS, key);
+  hold(st, weak & QZ_WEAK_VALUES, value);
+}
+
+/* empty a slot
+ * a small hash shifts back the entries after it until one is home or a slot is empty,
+ * which leaves it as if the entry had never been inserted, a large one marks the slot EMPTY or DELETED */
+static void remove_slot(qz_cell_t* cell, qz_hash_slot_t* slot)
+{
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+  size_t mask = cell->value.array.capacity - 1;
+  size_t i = slot - slots;
+
+  if(grouped(cell)) {
+    /* a probe only goes past a slot in a run of GROUP_SIZE slots with no EMPTY one */
+    const uint8_t* controls = control_bytes(cell);
+    uint32_t empty_before = match_empty(controls + ((i - GROUP_SIZE) & mask));
+    uint32_t empty_after = match_empty(controls + i);
+
+    size_t run = empty_after ? lowest_bit(empty_after) : GROUP_SIZE;
+    while(run < GROUP_SIZE && !(empty_before & (1u << (GROUP_SIZE - 1)))) {
+      empty_before <<= 1;
+      run++;
+    }
+
+    if(run < GROUP_SIZE) {
+      set_control(cell, i, EMPTY);
+    }
+    else {
+      set_control(cell, i, DELETED);
+      (*deleted_slots(cell))++;
+    }
+  }
+  else {
+    for(;;) {
+      size_t next = (i + 1) & mask;
+
+      if(qz_is_none(slots[next].key) || probe_distance(mask, slots[next].hash, next) == 0)
+        break;
+
+      slots[i] = slots[next];
+      i = next;
+    }
+  }
+
+  slots[i].key = QZ_NONE;
+  slots[i].value = QZ_NONE;
+  slots[i].hash = 0;
+  cell->value.array.size--;
+}
+
+static int hash_delete(qz_state_t* st, qz_obj_t* obj, qz_hash_kind_t kind, qz_obj_t key)
+{
+  qz_cell_t* cell = qz_to_cell(*obj);
+  qz_hash_slot_t* slot = find_slot(cell, kind, key, hash_obj(kind, key));
+
+  if(!slot)
+    return 0;
+
+  qz_obj_t old_key = slot->key;
+  qz_obj_t old_value = slot->value;
+  int weak = qz_weak(cell);
+
+  remove_slot(cell, slot);
+
+  /* give memory back once the load falls under 25% */
+  if(cell->value.array.capacity > MIN_CAPACITY && cell->value.array.size * 4 < cell->value.array.capacity)
+    realloc_hash(st, obj, cell->value.array.capacity / 2);
+
+  /* unref last, the hash is consistent again */
+  let_go(st, weak & QZ_WEAK_KEYS, old_key);
+  let_go(st, weak & QZ_WEAK_VALUES, old_value);
+  return 1;
 }
 
 qz_obj_t* qz_hash_get(qz_state_t* st, qz_obj_t obj, qz_obj_t key)
 {
   QZ_UNUSED(st);
-  qz_pair_t* pair = get_hash(qz_to_cell(obj), key);
+  return hash_get(obj, QZ_HASH_EQUAL, key);
+}
+
+void qz_hash_set(qz_state_t* st, qz_obj_t* obj, qz_obj_t key, qz_obj_t value)
+{
+  hash_set(st, obj, QZ_HASH_EQUAL, key, value);
+}
+
+int qz_hash_delete(qz_state_t* st, qz_obj_t* obj, qz_obj_t key)
+{
+  return hash_delete(st, obj, QZ_HASH_EQUAL, key);
+}
+
+typedef struct chars_match {
+  const char* str;
+  size_t size;
+} chars_match_t;
+
+/* compare contents without making a string */
+static int match_chars(qz_hash_slot_t* slot, const void* data)
+{
+  const chars_match_t* cm = (const chars_match_t*)data;
+
+  if(!qz_is_string(slot->key))
+    return 0;
+
+  qz_cell_t* key = qz_to_cell(slot->key);
+  return key->value.array.size == cm->size && (cm->size == 0 || memcmp(QZ_CELL_DATA(key, char), cm->str, cm->size) == 0);
+}
+
+qz_hash_slot_t* qz_hash_find_chars(qz_obj_t obj, const char* str, size_t size)
+{
+  chars_match_t cm = { str, size };
+  return probe(qz_to_cell(obj), CityHash32(str, size), match_chars, &cm);
+}
+
+qz_hash_slot_t* qz_hash_next(qz_obj_t obj, size_t* iter)
+{
+  qz_cell_t* cell = qz_to_cell(obj);
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+
+  while(*iter < cell->value.array.capacity) {
+    qz_hash_slot_t* slot = &slots[(*iter)++];
+    if(!qz_is_none(slot->key))
+      return slot;
+  }
+
+  return NULL;
+}
+
+qz_obj_t qz_make_table(qz_state_t* st, qz_hash_kind_t kind)
+{
+  return qz_make_weak_table(st, kind, QZ_WEAK_NONE);
+}
+
+qz_obj_t qz_make_weak_table(qz_state_t* st, qz_hash_kind_t kind, qz_weak_t weak)
+{
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_TABLE, 0);
+  cell->value.pair.first = qz_from_fixnum(kind);
+  cell->value.pair.rest = qz_make_hash(st);
+
+  if(weak) {
+    /* the collector looks at the hash, qz_weak_release() at the table */
+    qz_set_weak(cell, weak);
+    qz_set_weak(qz_to_cell(cell->value.pair.rest), weak);
+
+    if(st->weak_tables_size == st->weak_tables_capacity) {
+      st->weak_tables_capacity = st->weak_tables_capacity ? st->weak_tables_capacity*2 : 16;
+      st->weak_tables = (qz_cell_t**)realloc(st->weak_tables, st->weak_tables_capacity*sizeof(qz_cell_t*));
+    }
+    st->weak_tables[st->weak_tables_size++] = cell;
+  }
+
+  return qz_from_cell(cell);
+}
+
+static qz_hash_kind_t table_kind(qz_obj_t table)
+{
+  return (qz_hash_kind_t)qz_to_fixnum(qz_to_cell(table)->value.pair.first);
+}
+
+qz_obj_t* qz_table_get(qz_state_t* st, qz_obj_t table, qz_obj_t key)
+{
+  QZ_UNUSED(st);
+  return hash_get(qz_to_cell(table)->value.pair.rest, table_kind(table), key);
+}
+
+void qz_table_set(qz_state_t* st, qz_obj_t table, qz_obj_t key, qz_obj_t value)
+{
+  hash_set(st, &qz_to_cell(table)->value.pair.rest, table_kind(table), key, value);
+}
+
+int qz_table_delete(qz_state_t* st, qz_obj_t table, qz_obj_t key)
+{
+  return hash_delete(st, &qz_to_cell(table)->value.pair.rest, table_kind(table), key);
+}
+
+qz_hash_slot_t* qz_table_find(qz_obj_t table, qz_obj_t key)
+{
+  qz_hash_kind_t kind = table_kind(table);
+  return find_slot(qz_to_cell(qz_to_cell(table)->value.pair.rest), kind, key, hash_obj(kind, key));
+}
+
+/* hash array mapped tries
+ * each level of a trie branches on five bits of the hash of a key
+ * a node's entries are packed in the order of their bits in its bitmap
+ * keys whose hashes are the same in every bit end up together in a collision node
+ * a node is never changed once built, an update copies the nodes on the path to its key
+ * a child node always holds at least two entries, one left alone takes the child's place */
+
+#define HAMT_BITS 5
+#define HAMT_HASH_BITS 32
+
+static size_t hamt_branch(uint32_t hash, size_t shift)
+{
+  return (hash >> shift) & ((1 << HAMT_BITS) - 1);
+}
+
+static qz_cell_t* make_node(qz_state_t* st, size_t bitmap, size_t size, size_t entries)
+{
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_HAMT, entries*sizeof(qz_hamt_entry_t));
+  cell->value.hamt.bitmap = bitmap;
+  cell->value.hamt.size = size;
+  return cell;
+}
+
+/* copy the entries of a node, refing them
+ * delta 1 leaves a hole before the entry at index, -1 leaves that entry out
+ * and 0 leaves it for the caller to fill in */
+static qz_cell_t* copy_node(qz_state_t* st, qz_cell_t* cell, size_t bitmap, size_t size, size_t index, int delta)
+{
+  size_t count = qz_hamt_entries(cell);
+  qz_cell_t* copy = make_node(st, bitmap, size, count + delta);
+  qz_hamt_entry_t* from = QZ_CELL_DATA(cell, qz_hamt_entry_t);
+  qz_hamt_entry_t* to = QZ_CELL_DATA(copy, qz_hamt_entry_t);
+
+  for(size_t i = 0, j = 0; i < count; i++) {
+    if(i == index && delta >= 0)
+      j++;
+
+    if(i == index && delta <= 0)
+      continue;
+
+    to[j].key = qz_ref(st, from[i].key);
+    to[j].value = qz_ref(st, from[i].value);
+    j++;
+  }
+
+  return copy;
+}
+
+/* a node holding two entries whose keys differ, nested until their hashes branch apart */
+static qz_cell_t* make_two(qz_state_t* st, qz_hamt_entry_t a, uint32_t a_hash, qz_hamt_entry_t b, uint32_t b_hash, size_t shift)
+{
+  if(shift >= HAMT_HASH_BITS) {
+    qz_cell_t* cell = make_node(st, 0, 2, 2);
+    QZ_CELL_DATA(cell, qz_hamt_entry_t)[0] = a;
+    QZ_CELL_DATA(cell, qz_hamt_entry_t)[1] = b;
+    return cell;
+  }
+
+  size_t a_branch = hamt_branch(a_hash, shift);
+  size_t b_branch = hamt_branch(b_hash, shift);
+
+  if(a_branch == b_branch) {
+    qz_cell_t* cell = make_node(st, (size_t)1 << a_branch, 2, 1);
+    qz_cell_t* child = make_two(st, a, a_hash, b, b_hash, shift + HAMT_BITS);
+    QZ_CELL_DATA(cell, qz_hamt_entry_t)[0].key = QZ_NONE;
+    QZ_CELL_DATA(cell, qz_hamt_entry_t)[0].value = qz_from_cell(child);
+    return cell;
+  }
+
+  qz_cell_t* cell = make_node(st, ((size_t)1 << a_branch) | ((size_t)1 << b_branch), 2, 2);
+  QZ_CELL_DATA(cell, qz_hamt_entry_t)[a_branch < b_branch ? 0 : 1] = a;
+  QZ_CELL_DATA(cell, qz_hamt_entry_t)[a_branch < b_branch ? 1 : 0] = b;
+  return cell;
+}
+
+/* a copy of the node with entry stored below it, the entry is stolen */
+static qz_cell_t* node_set(qz_state_t* st, qz_cell_t* cell, qz_hamt_entry_t entry, uint32_t hash, size_t shift)
+{
+  qz_hamt_entry_t* entries = QZ_CELL_DATA(cell, qz_hamt_entry_t);
+  size_t bitmap = cell->value.hamt.bitmap;
+  size_t size = cell->value.hamt.size;
+  qz_cell_t* copy;
+
+  if(shift >= HAMT_HASH_BITS) {
+    size_t i = 0;
+    while(i < size && !same_key(QZ_HASH_EQUAL, entries[i].key, entry.key))
+      i++;
+
+    if(i < size)
+      copy = copy_node(st, cell, 0, size, i, 0);
+    else
+      copy = copy_node(st, cell, 0, size + 1, i, 1);
+
+    QZ_CELL_DATA(copy, qz_hamt_entry_t)[i] = entry;
+    return copy;
+  }
+
+  size_t bit = (size_t)1 << hamt_branch(hash, shift);
+  size_t index = qz_count_bits(bitmap & (bit - 1));
+
+  if(!(bitmap & bit)) {
+    copy = copy_node(st, cell, bitmap | bit, size + 1, index, 1);
+    QZ_CELL_DATA(copy, qz_hamt_entry_t)[index] = entry;
+    return copy;
+  }
+
+  qz_hamt_entry_t old = entries[index];
+  qz_hamt_entry_t replacement = entry;
+
+  if(qz_is_none(old.key)) {
+    qz_cell_t* child = qz_to_cell(old.value);
+    qz_cell_t* new_child = node_set(st, child, entry, hash, shift + HAMT_BITS);
+    size = size - child->value.hamt.size + new_child->value.hamt.size;
+    replacement.key = QZ_NONE;
+    replacement.value = qz_from_cell(new_child);
+  }
+  else if(!same_key(QZ_HASH_EQUAL, old.key, entry.key)) {
+    qz_hamt_entry_t moved = { qz_ref(st, old.key), qz_ref(st, old.value) };
+    qz_cell_t* child = make_two(st, moved, hash_obj(QZ_HASH_EQUAL, old.key), entry, hash, shift + HAMT_BITS);
+    size++;
+    replacement.key = QZ_NONE;
+    replacement.value = qz_from_cell(child);
+  }
+
+  copy = copy_node(st, cell, bitmap, size, index, 0);
+  QZ_CELL_DATA(copy, qz_hamt_entry_t)[index] = replacement;
+  return copy;
+}
+
+/* a copy of the node without key, or NULL if key isn't below it */
+static qz_cell_t* node_delete(qz_state_t* st, qz_cell_t* cell, qz_obj_t key, uint32_t hash, size_t shift)
+{
+  qz_hamt_entry_t* entries = QZ_CELL_DATA(cell, qz_hamt_entry_t);
+  size_t bitmap = cell->value.hamt.bitmap;
+  size_t size = cell->value.hamt.size;
+
+  if(shift >= HAMT_HASH_BITS) {
+    for(size_t i = 0; i < size; i++) {
+      if(same_key(QZ_HASH_EQUAL, entries[i].key, key))
+        return copy_node(st, cell, 0, size - 1, i, -1);
+    }
+    return NULL;
+  }
+
+  size_t bit = (size_t)1 << hamt_branch(hash, shift);
+  size_t index = qz_count_bits(bitmap & (bit - 1));
+
+  if(!(bitmap & bit))
+    return NULL;
 
-  if(qz_is_none(pair->first))
+  qz_hamt_entry_t old = entries[index];
+
+  if(!qz_is_none(old.key)) {
+    if(!same_key(QZ_HASH_EQUAL, old.key, key))
+      return NULL;
+    return copy_node(st, cell, bitmap & ~bit, size - 1, index, -1);
+  }
+
+  qz_cell_t* child = node_delete(st, qz_to_cell(old.value), key, hash, shift + HAMT_BITS);
+  if(!child)
     return NULL;
 
-  return &pair->rest;
+  qz_cell_t* copy = copy_node(st, cell, bitmap, size - 1, index, 0);
+  qz_hamt_entry_t* replacement = QZ_CELL_DATA(copy, qz_hamt_entry_t) + index;
+
+  if(child->value.hamt.size == 1) {
+    qz_hamt_entry_t* only = QZ_CELL_DATA(child, qz_hamt_entry_t);
+    replacement->key = qz_ref(st, only->key);
+    replacement->value = qz_ref(st, only->value);
+    qz_unref(st, qz_from_cell(child));
+  }
+  else {
+    replacement->key = QZ_NONE;
+    replacement->value = qz_from_cell(child);
+  }
+
+  return copy;
 }
 
-void qz_hash_set(qz_state_t* st, qz_obj_t* obj, qz_obj_t key, qz_obj_t value)
+qz_obj_t qz_make_hamt(qz_state_t* st)
 {
-  qz_cell_t* cell = qz_to_cell(*obj);
-  qz_pair_t* pair = get_hash(cell, key);
+  return qz_from_cell(make_node(st, 0, 0, 0));
+}
+
+qz_obj_t* qz_hamt_get(qz_obj_t hamt, qz_obj_t key)
+{
+  qz_cell_t* cell = qz_to_cell(hamt);
+  uint32_t hash = hash_obj(QZ_HASH_EQUAL, key);
+
+  for(size_t shift = 0; shift < HAMT_HASH_BITS; shift += HAMT_BITS)
+  {
+    size_t bitmap = cell->value.hamt.bitmap;
+    size_t bit = (size_t)1 << hamt_branch(hash, shift);
+
+    if(!(bitmap & bit))
+      return NULL;
 
-  if(qz_is_none(pair->first))
-    cell->value.array.size++;
+    qz_hamt_entry_t* entry = QZ_CELL_DATA(cell, qz_hamt_entry_t) + qz_count_bits(bitmap & (bit - 1));
 
-  qz_unref(st, pair->first);
-  pair->first = key;
-  qz_unref(st, pair->rest);
-  pair->rest = value;
+    if(!qz_is_none(entry->key))
+      return same_key(QZ_HASH_EQUAL, entry->key, key) ? &entry->value : NULL;
+
+    cell = qz_to_cell(entry->value);
+  }
+
+  for(size_t i = 0; i < cell->value.hamt.size; i++) {
+    qz_hamt_entry_t* entry = QZ_CELL_DATA(cell, qz_hamt_entry_t) + i;
+    if(same_key(QZ_HASH_EQUAL, entry->key, key))
+      return &entry->value;
+  }
+
+  return NULL;
+}
+
+qz_obj_t qz_hamt_set(qz_state_t* st, qz_obj_t hamt, qz_obj_t key, qz_obj_t value)
+{
+  qz_hamt_entry_t entry = { key, value };
+  return qz_from_cell(node_set(st, qz_to_cell(hamt), entry, hash_obj(QZ_HASH_EQUAL, key), 0));
+}
 
-  if(cell->value.array.size * 10 > cell->value.array.capacity * 7)
-    realloc_hash(obj);
+qz_obj_t qz_hamt_delete(qz_state_t* st, qz_obj_t hamt, qz_obj_t key)
+{
+  qz_cell_t* cell = node_delete(st, qz_to_cell(hamt), key, hash_obj(QZ_HASH_EQUAL, key), 0);
+  return cell ? qz_from_cell(cell) : qz_ref(st, hamt);
+}
+
+/* *iter counts the entries seen, the sizes of child nodes tell which one holds the next */
+qz_hamt_entry_t* qz_hamt_next(qz_obj_t hamt, size_t* iter)
+{
+  qz_cell_t* cell = qz_to_cell(hamt);
+  size_t skip = *iter;
+
+  if(skip >= cell->value.hamt.size)
+    return NULL;
+
+  (*iter)++;
+
+  for(size_t i = 0; /**/; i++) {
+    qz_hamt_entry_t* entry = QZ_CELL_DATA(cell, qz_hamt_entry_t) + i;
+
+    if(!qz_is_none(entry->key)) {
+      if(skip == 0)
+        return entry;
+      skip--;
+      continue;
+    }
+
+    qz_cell_t* child = qz_to_cell(entry->value);
+    if(skip < child->value.hamt.size) {
+      cell = child;
+      i = (size_t)-1;
+    }
+    else {
+      skip -= child->value.hamt.size;
+    }
+  }
+}
+
+static int match_identity(qz_hash_slot_t* slot, const void* data)
+{
+  return slot->key.value == ((const qz_obj_t*)data)->value;
+}
+
+/* the slot of an entry of a weak table holding the given cell in a weak part, or NULL */
+static qz_hash_slot_t* find_held(qz_cell_t* table, qz_cell_t* held)
+{
+  qz_cell_t* cell = qz_to_cell(table->value.pair.rest);
+  qz_hash_kind_t kind = (qz_hash_kind_t)qz_to_fixnum(table->value.pair.first);
+  qz_hash_slot_t* slots = QZ_CELL_DATA(cell, qz_hash_slot_t);
+  size_t mask = cell->value.array.capacity - 1;
+  int weak = qz_weak(cell);
+  qz_obj_t obj = qz_from_cell(held);
+
+  /* a key can be found by its hash, unless hashing it would look at children that may be gone */
+  int hashable = kind != QZ_HASH_EQUAL || (qz_type(held) != QZ_CT_PAIR && qz_type(held) != QZ_CT_VECTOR);
+
+  if((weak & QZ_WEAK_KEYS) && hashable) {
+    qz_hash_slot_t* slot = probe(cell, hash_obj(kind, obj), match_identity, &obj);
+    if(slot)
+      return slot;
+
+    if(!(weak & QZ_WEAK_VALUES))
+      return NULL;
+  }
+
+  for(size_t i = 0; i <= mask; i++) {
+    qz_hash_slot_t* slot = &slots[i];
+
+    if(((weak & QZ_WEAK_KEYS) && slot->key.value == obj.value) ||
+       ((weak & QZ_WEAK_VALUES) && slot->value.value == obj.value))
+      return slot;
+  }
+
+  return NULL;
+}
+
+void qz_weak_release(qz_state_t* st, qz_cell_t* cell)
+{
+  if(qz_type(cell) == QZ_CT_TABLE && qz_weak(cell)) {
+    for(size_t i = 0; i < st->weak_tables_size; i++) {
+      if(st->weak_tables[i] == cell) {
+        st->weak_tables[i] = st->weak_tables[--st->weak_tables_size];
+        break;
+      }
+    }
+    qz_set_weak(cell, QZ_WEAK_NONE);
+  }
+
+  if(!qz_held(cell))
+    return;
+
+  qz_set_held(cell, 0);
+
+  for(size_t i = 0; i < st->weak_tables_size; i++) {
+    qz_cell_t* table = st->weak_tables[i];
+    qz_hash_slot_t* slot;
+
+    /* one cell may be in many entries of a weak value table */
+    while((slot = find_held(table, cell))) {
+      qz_cell_t* hash = qz_to_cell(table->value.pair.rest);
+      int key_held = (qz_weak(hash) & QZ_WEAK_KEYS) && slot->key.value == qz_from_cell(cell).value;
+      qz_obj_t other = key_held ? slot->value : slot->key;
+      int weak = qz_weak(hash) & (key_held ? QZ_WEAK_VALUES : QZ_WEAK_KEYS);
+
+      /* the hash isn't shrunk, the collector may be in the middle of it */
+      remove_slot(hash, slot);
+
+      if(weak)
+        continue;
+
+      /* unrefs wait while collecting, the garbage being freed may be what they'd look at
+       * otherwise dropping the other part can change any weak table, so start over */
+      if(st->collecting) {
+        if(st->weak_unrefs_size == st->weak_unrefs_capacity) {
+          st->weak_unrefs_capacity = st->weak_unrefs_capacity ? st->weak_unrefs_capacity*2 : 16;
+          st->weak_unrefs = (qz_obj_t*)realloc(st->weak_unrefs, st->weak_unrefs_capacity*sizeof(qz_obj_t));
+        }
+        st->weak_unrefs[st->weak_unrefs_size++] = other;
+      }
+      else {
+        qz_unref(st, other);
+        i = (size_t)-1;
+        break;
+      }
+    }
+  }
 }
@@ -9,8 +9,12 @@
 #include <time.h>
 #include <unistd.h>
 
+/* quuz-state.c */
+qz_obj_t* qz_frame_get(qz_state_t* st, qz_obj_t frame, qz_obj_t sym);
+
 #define ALIGNED __attribute__ ((aligned (8)))
 #define QZ_DEF_CFUN(n) static ALIGNED qz_obj_t n(qz_state_t* st, qz_obj_t args)
+#define QZ_DEF_PRIM(n) static qz_obj_t n(qz_state_t* st, size_t argc, qz_obj_t* argv)
 
 typedef int (*pred_fun)(qz_obj_t);
 typedef int (*cmp_fun)(qz_obj_t, qz_obj_t);
@@ -18,16 +22,37 @@ typedef int (*cmp_fun)(qz_obj_t, qz_obj_t);
 static void set_var(qz_state_t* st, qz_obj_t name, qz_obj_t value)
 {
   qz_obj_t outer_env = qz_to_cell(st->env)->value.pair.first;
+
+  if(qz_is_null(outer_env)) {
+    qz_set_global(st, name, value);
+    return;
+  }
+
   qz_obj_t* inner_env = &qz_to_cell(outer_env)->value.pair.first;
-  qz_hash_set(st, inner_env, name, value);
+
+  if(qz_is_hash(*inner_env)) {
+    qz_hash_set(st, inner_env, name, value);
+    return;
+  }
+
+  /* frames of analyzed code have a fixed set of names */
+  qz_obj_t* slot = qz_frame_get(st, *inner_env, name);
+
+  if(!slot) {
+    qz_push_safety(st, value);
+    qz_error(st, "definition not at start of body", &name, NULL);
+  }
+
+  qz_unref(st, *slot);
+  *slot = value;
 }
 
-qz_obj_t predicate(qz_state_t* st, qz_obj_t args, pred_fun pf)
+/* a predicate prim, which takes a single argument of any type */
+static qz_obj_t prim_predicate(qz_state_t* st, size_t argc, qz_obj_t* argv, pred_fun pf)
 {
-  qz_obj_t value = qz_eval(st, qz_required_arg(st, &args));
-  int b = pf(value);
-  qz_unref(st, value);
-  return b ? QZ_TRUE : QZ_FALSE;
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return pf(argv[0]) ? QZ_TRUE : QZ_FALSE;
 }
 
 #define LESS 1
@@ -39,82 +64,46 @@ static int sign_of(int i)
   return 2 + 2*(i > 0) - (i < 0);
 }
 
-static qz_obj_t compare_many(qz_state_t* st, qz_obj_t args, pred_fun pf, cmp_fun cf, int flags)
+/* compare each pair of neighboring arguments, which are already type checked */
+static qz_obj_t compare_args(size_t argc, qz_obj_t* argv, cmp_fun cf, int flags)
 {
-  qz_obj_t prev = qz_eval(st, qz_required_arg(st, &args));
-  if(!pf(prev)) {
-    qz_push_safety(st, prev);
-    return qz_error(st, "unexpected type", &prev, NULL);
-  }
-
-  /* compare each pair of objects */
-  for(;;) {
-    qz_obj_t expr = qz_optional_arg(st, &args);
-    if(qz_is_none(expr)) {
-      qz_unref(st, prev);
-      return QZ_TRUE; /* ran out of expressions */
-    }
-
-    qz_push_safety(st, prev);
-
-    qz_obj_t curr = qz_eval(st, expr);
-    if(!pf(curr)) {
-      qz_push_safety(st, curr);
-      return qz_error(st, "unexpected type", &curr, NULL);
-    }
-
-    qz_pop_safety(st, 1);
-
-    if(!(sign_of(cf(prev, curr)) & flags)) {
-      qz_unref(st, prev);
-      qz_unref(st, curr);
+  for(size_t i = 1; i < argc; i++) {
+    if(!(sign_of(cf(argv[i - 1], argv[i])) & flags))
       return QZ_FALSE; /* comparison didn't match */
-    }
-
-    qz_unref(st, prev);
-    prev = curr;
   }
+
+  return QZ_TRUE;
 }
 
 /* generic function for string-ref, vector-ref, and bytevector-ref */
 typedef qz_obj_t (*getelem_fun)(qz_state_t*, qz_cell_t*, size_t);
 
-static qz_obj_t array_ref(qz_state_t* st, qz_obj_t args, const char* type_spec, getelem_fun gef)
+static qz_obj_t array_ref(qz_state_t* st, qz_obj_t* argv, getelem_fun gef)
 {
-  qz_obj_t arr, k;
-  qz_get_args(st, &args, type_spec, &arr, &k);
-  qz_push_safety(st, arr);
-
-  intptr_t k_raw = qz_to_fixnum(k);
-  qz_cell_t* cell = qz_to_cell(arr);
+  intptr_t k_raw = qz_to_fixnum(argv[1]);
+  qz_cell_t* cell = qz_to_cell(argv[0]);
 
   if(k_raw < 0 || (uintptr_t)k_raw >= cell->value.array.size)
-    return qz_error(st, "index out of bounds", &arr, &k, NULL);
+    return qz_error(st, "index out of bounds", &argv[0], &argv[1], NULL);
 
-  qz_obj_t result = gef(st, cell, k_raw);
-  return result;
+  return gef(st, cell, k_raw);
 }
 
 /* generic function for string-set!, vector-set!, and bytevector-set! */
 typedef void (*setelem_fun)(qz_state_t*, qz_cell_t*, size_t, qz_obj_t);
 
-static qz_obj_t array_set(qz_state_t* st, qz_obj_t args, const char* type_spec, setelem_fun sef)
+static qz_obj_t array_set(qz_state_t* st, qz_obj_t* argv, setelem_fun sef)
 {
-  /* TODO add immutable flag to strings,
-   * set for strings converted from symbols
-   * check here and elsewhere and throw an error */
+  intptr_t k_raw = qz_to_fixnum(argv[1]);
+  qz_cell_t* cell = qz_to_cell(argv[0]);
 
-  qz_obj_t arr, k, obj;
-  qz_get_args(st, &args, type_spec, &arr, &k, &obj);
-  qz_push_safety(st, arr);
-
-  intptr_t k_raw = qz_to_fixnum(k);
-  qz_cell_t* cell = qz_to_cell(arr);
+  if(qz_immutable(cell))
+    return qz_error(st, "immutable object", &argv[0], NULL);
 
   if(k_raw < 0 || (uintptr_t)k_raw >= cell->value.array.size)
-    return qz_error(st, "index out of bounds", &arr, &k, NULL);
+    return qz_error(st, "index out of bounds", &argv[0], &argv[1], NULL);
 
-  sef(st, cell, k_raw, obj);
+  sef(st, cell, k_raw, argv[2]);
   return QZ_NONE;
 }
 
@@ -133,7 +122,29 @@ static intptr_t list_length(qz_obj_t obj)
   }
 }
 
-QZ_DEF_CFUN(scm_begin);
+/* (quote obj), obj is borrowed */
+static qz_obj_t quoted(qz_state_t* st, qz_obj_t obj)
+{
+  return qz_make_pair(st, st->quote_sym, qz_make_pair(st, qz_ref(st, obj), QZ_NULL));
+}
+
+/* call proc with the given arguments, which are borrowed
+ * they're quoted so the call doesn't evaluate them again */
+static qz_obj_t call_proc(qz_state_t* st, qz_obj_t proc, size_t argc, qz_obj_t* argv)
+{
+  qz_obj_t fun_call = QZ_NULL;
+
+  for(size_t i = argc; i > 0; i--)
+    fun_call = qz_make_pair(st, quoted(st, argv[i - 1]), fun_call);
+
+  fun_call = qz_make_pair(st, qz_ref(st, proc), fun_call);
+
+  qz_push_safety(st, fun_call);
+  qz_obj_t result = qz_eval(st, fun_call);
+  qz_pop_safety(st, 1);
+  qz_unref(st, fun_call);
+  return result;
+}
 
 /******************************************************************************
  * 4.1. Primitive expression types
@@ -148,15 +159,8 @@ QZ_DEF_CFUN(scm_quote)
 /* 4.1.4. Procedures */
 QZ_DEF_CFUN(scm_lambda)
 {
-  qz_obj_t formals = qz_ref(st, qz_required_arg(st, &args));
-  qz_obj_t body = qz_make_pair(st->begin_sym, qz_ref(st, args));
-
-  qz_cell_t* cell = qz_make_cell(QZ_CT_FUN, 0);
-
-  cell->value.pair.first = qz_ref(st, qz_list_head(st->env));
-  cell->value.pair.rest = qz_make_pair(formals, body);
-
-  return qz_from_cell(cell);
+  qz_obj_t formals = qz_required_arg(st, &args);
+  return qz_make_fun(st, qz_list_head(st->env), formals, args);
 }
 
 /* 4.1.5. Conditionals */
@@ -166,14 +170,17 @@ QZ_DEF_CFUN(scm_if)
   qz_obj_t consequent = qz_required_arg(st, &args);
   qz_obj_t alternate = qz_optional_arg(st, &args);
 
-  qz_obj_t test_result = qz_eval(st, test);
-
-  if(qz_eq(test_result, QZ_FALSE))
-    return qz_eval(st, alternate); /* covers no alternate, none evals to none */
+  qz_obj_t owned;
+  qz_obj_t test_result = qz_eval_borrowed(st, test, &owned);
+  qz_unref(st, owned);
 
-  qz_unref(st, test_result);
+  if(qz_eq(test_result, QZ_FALSE)) {
+    if(qz_is_none(alternate))
+      return QZ_NONE; /* no alternate */
+    return qz_tail_eval(st, alternate);
+  }
 
-  return qz_eval(st, consequent);
+  return qz_tail_eval(st, consequent);
 }
 
 /* 4.1.6. Assignments */
@@ -224,6 +231,7 @@ QZ_DEF_CFUN(scm_cond)
       break; /* hit true clause */
   }
 
+  qz_obj_t body = clause;
   qz_obj_t expr = qz_optional_arg(st, &clause);
 
   if(qz_is_none(expr))
@@ -235,7 +243,7 @@ QZ_DEF_CFUN(scm_cond)
     qz_obj_t fun = qz_required_arg(st, &clause);
     qz_pop_safety(st, 1);
     /* call function */
-    qz_obj_t fun_call = qz_make_pair(qz_ref(st, fun), qz_make_pair(result, QZ_NULL));
+    qz_obj_t fun_call = qz_make_pair(st, qz_ref(st, fun), qz_make_pair(st, result, QZ_NULL));
     qz_push_safety(st, fun_call);
     result = qz_eval(st, fun_call);
     qz_pop_safety(st, 1);
@@ -243,15 +251,9 @@ QZ_DEF_CFUN(scm_cond)
     return result;
   }
 
-  /* eval expressions in clause */
-  for(;;) {
-    qz_unref(st, result); /* from test or previous expression */
-    result = qz_eval(st, expr);
-
-    expr = qz_optional_arg(st, &clause);
-    if(qz_is_none(expr))
-      return result; /* ran out of expressions in clause */
-  }
+  /* eval expressions in clause, the last in tail position */
+  qz_unref(st, result); /* from test */
+  return qz_tail_body(st, body, QZ_NONE);
 }
 
 QZ_DEF_CFUN(scm_case)
@@ -267,11 +269,11 @@ QZ_DEF_CFUN(scm_case)
     if(qz_is_none(clause))
       break; /* ran out of clauses */
 
-    if(qz_eq(clause, st->else_sym))
-      break; /* hit else clause */
-
     qz_obj_t datum_list = qz_required_arg(st, &clause);
 
+    if(qz_eq(datum_list, st->else_sym))
+      break; /* hit else clause */
+
     /* match against each datum in list */
     for(;;) {
       qz_obj_t datum = qz_optional_arg(st, &datum_list);
@@ -294,6 +296,7 @@ QZ_DEF_CFUN(scm_case)
   }
 
   /* eval expressions in clause */
+  qz_obj_t body = clause;
   qz_obj_t expr = qz_optional_arg(st, &clause);
 
   if(qz_eq(expr, st->arrow_sym)) {
@@ -302,7 +305,7 @@ QZ_DEF_CFUN(scm_case)
     qz_obj_t fun = qz_required_arg(st, &clause);
     qz_pop_safety(st, 1);
     /* call function */
-    qz_obj_t fun_call = qz_make_pair(qz_ref(st, fun), qz_make_pair(result, QZ_NULL));
+    qz_obj_t fun_call = qz_make_pair(st, qz_ref(st, fun), qz_make_pair(st, result, QZ_NULL));
     qz_push_safety(st, fun_call);
     result = qz_eval(st, fun_call);
     qz_pop_safety(st, 1);
@@ -310,30 +313,29 @@ QZ_DEF_CFUN(scm_case)
     return result;
   }
 
-  for(;;) {
-    if(qz_is_none(expr))
-      return result; /* ran out of expressions in clause */
-
-    qz_unref(st, result); /* from previous expression */
-    result = qz_eval(st, expr);
+  if(qz_is_none(expr))
+    return result; /* no expressions in clause */
 
-    expr = qz_optional_arg(st, &clause);
-  }
+  /* the last expression is in tail position */
+  qz_unref(st, result);
+  return qz_tail_body(st, body, QZ_NONE);
 }
 
 QZ_DEF_CFUN(scm_and)
 {
-  qz_obj_t result = QZ_TRUE;
-
   /* eval tests */
   for(;;) {
     qz_obj_t test = qz_optional_arg(st, &args);
 
     if(qz_is_none(test))
-      return result; /* ran out of tests */
+      return QZ_TRUE; /* ran out of tests */
 
-    qz_unref(st, result); /* from previous test */
-    result = qz_eval(st, test);
+    if(!qz_is_pair(args))
+      return qz_tail_eval(st, test); /* last test is in tail position */
+
+    qz_obj_t owned;
+    qz_obj_t result = qz_eval_borrowed(st, test, &owned);
+    qz_unref(st, owned);
 
     if(qz_eq(result, QZ_FALSE))
       return QZ_FALSE; /* not all expressions true */
@@ -349,50 +351,111 @@ QZ_DEF_CFUN(scm_or)
     if(qz_is_none(test))
       return QZ_FALSE; /* ran out of tests */
 
-    qz_obj_t result = qz_eval(st, test);
+    if(!qz_is_pair(args))
+      return qz_tail_eval(st, test); /* last test is in tail position */
+
+    qz_obj_t owned;
+    qz_obj_t result = qz_eval_borrowed(st, test, &owned);
 
     if(!qz_eq(result, QZ_FALSE))
-      return result; /* not all expressions false */
+      return qz_is_none(owned) ? qz_ref(st, result) : owned; /* not all expressions false */
   }
 }
 
 QZ_DEF_CFUN(scm_when)
 {
-  qz_obj_t result = qz_eval(st, qz_required_arg(st, &args));
+  qz_obj_t owned;
+  qz_obj_t result = qz_eval_borrowed(st, qz_required_arg(st, &args), &owned);
+  qz_unref(st, owned);
 
   if(qz_eq(result, QZ_FALSE))
     return QZ_NONE; /* test was false */
 
-  qz_unref(st, result);
-
   /* eval expressions */
-  qz_unref(st, scm_begin(st, args));
-
-  return QZ_NONE;
+  return qz_tail_body(st, args, QZ_NONE);
 }
 
 QZ_DEF_CFUN(scm_unless)
 {
-  qz_obj_t result = qz_eval(st, qz_required_arg(st, &args));
+  qz_obj_t owned;
+  qz_obj_t result = qz_eval_borrowed(st, qz_required_arg(st, &args), &owned);
+  qz_unref(st, owned);
 
-  if(!qz_eq(result, QZ_FALSE)) {
-    qz_unref(st, result);
+  if(!qz_eq(result, QZ_FALSE))
     return QZ_NONE; /* test was true */
-  }
 
   /* eval expressions */
-  qz_unref(st, scm_begin(st, args));
-
-  return QZ_NONE;
+  return qz_tail_body(st, args, QZ_NONE);
 }
 
 /* 4.2.2. Binding constructs */
+
+/* named let, ex. (let loop ((i 0)) (loop (+ i 1))) */
+static qz_obj_t named_let(qz_state_t* st, qz_obj_t name, qz_obj_t args)
+{
+  qz_obj_t bindings = qz_required_arg(st, &args);
+
+  /* create frame for the first call, collecting formals along the way */
+  qz_obj_t frame = qz_make_hash(st);
+  qz_obj_t formals = QZ_NULL;
+  qz_obj_t elem = QZ_NULL;
+
+  for(;;) {
+    qz_obj_t binding = qz_optional_arg(st, &bindings);
+
+    if(qz_is_none(binding))
+      break;
+
+    qz_push_safety(st, frame);
+    qz_push_safety(st, formals);
+
+    qz_obj_t sym = qz_required_arg(st, &binding);
+    qz_obj_t expr = qz_required_arg(st, &binding);
+
+    if(!qz_is_sym(sym))
+      qz_error(st, "expected symbol", &sym, NULL);
+
+    qz_obj_t value = qz_eval(st, expr);
+
+    qz_pop_safety(st, 2);
+
+    qz_hash_set(st, &frame, sym, value);
+
+    qz_obj_t inner_elem = qz_make_pair(st, sym, QZ_NULL);
+    if(qz_is_null(formals)) {
+      formals = elem = inner_elem;
+    }
+    else {
+      qz_to_pair(elem)->rest = inner_elem;
+      elem = inner_elem;
+    }
+  }
+
+  /* the function gets a frame of its own binding name, so it can call itself */
+  qz_obj_t fun_scope = qz_make_pair(st, qz_make_hash(st), qz_ref(st, qz_first(st->env)));
+
+  qz_push_safety(st, frame);
+  qz_push_safety(st, formals);
+  qz_push_safety(st, fun_scope);
+  qz_obj_t fun = qz_make_fun(st, fun_scope, formals, args);
+  qz_pop_safety(st, 3);
+  qz_unref(st, formals);
+
+  qz_hash_set(st, &qz_to_pair(fun_scope)->first, name, fun);
+
+  /* execute body as the first call */
+  return qz_tail_body(st, args, qz_make_pair(st, frame, fun_scope));
+}
+
 QZ_DEF_CFUN(scm_let)
 {
   qz_obj_t bindings = qz_required_arg(st, &args);
 
+  if(qz_is_sym(bindings))
+    return named_let(st, bindings, args);
+
   /* create frame */
-  qz_obj_t frame = qz_make_hash();
+  qz_obj_t frame = qz_make_hash(st);
 
   for(;;) {
     qz_obj_t binding = qz_optional_arg(st, &bindings);
@@ -413,21 +476,8 @@ QZ_DEF_CFUN(scm_let)
     qz_pop_safety(st, 1);
   }
 
-  /* push environment with frame */
-  qz_obj_t old_env = st->env;
-  qz_obj_t env = qz_make_pair(frame, qz_ref(st, qz_first(st->env)));
-  st->env = qz_make_pair(env, qz_ref(st, st->env));
-  qz_push_safety(st, st->env);
-
-  /* execute body */
-  qz_obj_t result = scm_begin(st, args);
-
-  /* pop environment */
-  qz_pop_safety(st, 1);
-  qz_unref(st, st->env);
-  st->env = old_env;
-
-  return result;
+  /* execute body in tail position with frame */
+  return qz_tail_body(st, args, qz_make_pair(st, frame, qz_ref(st, qz_first(st->env))));
 }
 
 QZ_DEF_CFUN(scm_let_s)
@@ -436,8 +486,8 @@ QZ_DEF_CFUN(scm_let_s)
 
   /* push environment with frame */
   qz_obj_t old_env = st->env;
-  qz_obj_t env = qz_make_pair(qz_make_hash(), qz_ref(st, qz_first(st->env)));
-  st->env = qz_make_pair(env, qz_ref(st, st->env));
+  qz_obj_t env = qz_make_pair(st, qz_make_hash(st), qz_ref(st, qz_first(st->env)));
+  st->env = qz_make_pair(st, env, qz_ref(st, st->env));
   qz_push_safety(st, st->env);
 
   /* fill frame while binding */
@@ -456,39 +506,29 @@ QZ_DEF_CFUN(scm_let_s)
     qz_hash_set(st, &qz_to_pair(env)->first, sym, qz_eval(st, expr));
   }
 
-  /* execute body */
-  qz_obj_t result = scm_begin(st, args);
-
-  /* pop environment */
+  /* pop environment, keeping the frame for the body */
+  qz_obj_t scope = qz_ref(st, env);
   qz_pop_safety(st, 1);
   qz_unref(st, st->env);
   st->env = old_env;
 
-  return result;
+  /* execute body in tail position */
+  return qz_tail_body(st, args, scope);
 }
 
 /* 4.2.3. Sequencing */
 QZ_DEF_CFUN(scm_begin)
 {
-  qz_obj_t result = QZ_NONE;
-
-  /* eval expressions */
-  for(;;) {
-    qz_obj_t expr = qz_optional_arg(st, &args);
-
-    if(qz_is_none(expr))
-      return result; /* ran out of expressions */
-
-    qz_unref(st, result);
-    result = qz_eval(st, expr);
-  }
+  /* eval expressions, the last in tail position */
+  return qz_tail_body(st, args, QZ_NONE);
 }
+
 /* 4.2.5. Delayed evaluation */
 QZ_DEF_CFUN(scm_delay)
 {
   qz_obj_t expr = qz_required_arg(st, &args);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_PROMISE, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_PROMISE, 0);
   cell->value.pair.first = qz_ref(st, qz_first(st->env));
   cell->value.pair.rest = qz_ref(st, expr);
 
@@ -520,7 +560,7 @@ QZ_DEF_CFUN(scm_force)
 
   /* push environment */
   qz_obj_t old_env = st->env;
-  st->env = qz_make_pair(qz_ref(st, pair->first), qz_ref(st, st->env));
+  st->env = qz_make_pair(st, qz_ref(st, pair->first), qz_ref(st, st->env));
   qz_push_safety(st, st->env);
 
   /* evaluate expression */
@@ -548,7 +588,7 @@ QZ_DEF_CFUN(scm_eager)
   qz_obj_t obj;
   qz_get_args(st, &args, "a", &obj);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_PROMISE, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_PROMISE, 0);
   cell->value.pair.first = QZ_NONE;
   cell->value.pair.rest = obj;
 
@@ -613,7 +653,7 @@ static qz_obj_t qq_list(qz_state_t* st, qz_obj_t in, int depth)
     int splice;
     obj = qq_or_splice(st, obj, depth, &splice);
     if(!splice)
-      obj = qz_make_pair(obj, QZ_NULL);
+      obj = qz_make_pair(st, obj, QZ_NULL);
 
     if(!(splice && qz_is_null(obj)))
     {
@@ -658,7 +698,7 @@ static qz_obj_t qq_vector(qz_state_t* st, qz_obj_t in, int depth)
   qz_cell_t* in_cell = qz_to_cell(in);
   size_t len = in_cell->value.array.size;
 
-  qz_cell_t* out_cell = qz_make_cell(QZ_CT_VECTOR, len*sizeof(qz_obj_t));
+  qz_cell_t* out_cell = qz_make_cell(st, QZ_CT_VECTOR, len*sizeof(qz_obj_t));
   out_cell->value.array.size = len;
   out_cell->value.array.capacity = len;
 
@@ -734,15 +774,7 @@ QZ_DEF_CFUN(scm_define)
     if(!qz_is_sym(var))
       return qz_error(st, "function variant of define not given symbol", &var, NULL);
 
-    qz_obj_t formals = qz_ref(st, header);
-    qz_obj_t body = qz_make_pair(st->begin_sym, qz_ref(st, args));
-
-    qz_cell_t* cell = qz_make_cell(QZ_CT_FUN, 0);
-
-    cell->value.pair.first = qz_ref(st, qz_list_head(st->env));
-    cell->value.pair.rest = qz_make_pair(formals, body);
-
-    set_var(st, var, qz_from_cell(cell));
+    set_var(st, var, qz_make_fun(st, qz_list_head(st->env), header, args));
   }
   else
   {
@@ -767,8 +799,9 @@ static ALIGNED qz_obj_t make_record(qz_state_t* st, qz_obj_t args)
   for(intptr_t i = 0; i < ninit; i++)
     init_indices[i] = qz_to_fixnum(qz_required_arg(st, &args)); /* index of initialized field */
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_RECORD, nfields*sizeof(qz_obj_t));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_RECORD, nfields*sizeof(qz_obj_t));
   cell->value.record.name = name;
+  cell->value.record.size = nfields;
 
   /* clear fields */
   for(intptr_t i = 0; i < nfields; i++)
@@ -839,11 +872,12 @@ static ALIGNED qz_obj_t is_record(qz_state_t* st, qz_obj_t args)
 
 static void make_function(qz_state_t* st, qz_obj_t name, qz_obj_t formals, qz_obj_t body)
 {
-  qz_cell_t* cell = qz_make_cell(QZ_CT_FUN, 0);
-  cell->value.pair.first = qz_ref(st, qz_list_tail(st->env));
-  cell->value.pair.rest = qz_make_pair(formals, body);
+  qz_push_safety(st, body);
+  qz_obj_t fun = qz_make_fun(st, qz_list_tail(st->env), formals, body);
+  qz_pop_safety(st, 1);
+  qz_unref(st, body);
 
-  set_var(st, name, qz_from_cell(cell));
+  set_var(st, name, fun);
 }
 
 QZ_DEF_CFUN(scm_define_record_type)
@@ -893,34 +927,33 @@ QZ_DEF_CFUN(scm_define_record_type)
   }
 
   /* allocate unique symbol */
-  /* TODO move me */
-  qz_obj_t name = (qz_obj_t) { (st->next_sym++ << 6) | QZ_PT_SYM };
+  qz_obj_t name = qz_make_unique_sym(st);
 
   /* generate predicate */
   {
     /* (is_record name . args) */
-    qz_obj_t fun_call = qz_make_pair(qz_from_cfun(is_record), qz_make_pair(name, st->args_sym));
+    qz_obj_t fun_call = qz_make_pair(st, qz_from_cfun(is_record), qz_make_pair(st, name, st->args_sym));
 
-    make_function(st, pred_name, st->args_sym, qz_make_pair(fun_call, QZ_NULL));
+    make_function(st, pred_name, st->args_sym, qz_make_pair(st, fun_call, QZ_NULL));
   }
 
   /* generate constructor */
   {
     /* (make_record name nfields ninit init1 init2 init3... . args) */
-    qz_obj_t elem = qz_make_pair(qz_from_fixnum(ninit), QZ_NULL);
-    qz_obj_t fun_call = qz_make_pair(qz_from_cfun(make_record),
-                        qz_make_pair(name,
-                        qz_make_pair(qz_from_fixnum(nfields), elem)));
+    qz_obj_t elem = qz_make_pair(st, qz_from_fixnum(ninit), QZ_NULL);
+    qz_obj_t fun_call = qz_make_pair(st, qz_from_cfun(make_record),
+                        qz_make_pair(st, name,
+                        qz_make_pair(st, qz_from_fixnum(nfields), elem)));
 
     for(int i = 0; i < ninit; i++) {
-      qz_obj_t inner_elem = qz_make_pair(qz_from_fixnum(init_indices[i]), QZ_NULL);
+      qz_obj_t inner_elem = qz_make_pair(st, qz_from_fixnum(init_indices[i]), QZ_NULL);
       qz_to_pair(elem)->rest = inner_elem;
       elem = inner_elem;
     }
 
     qz_to_pair(elem)->rest = st->args_sym;
 
-    make_function(st, ctor_name, st->args_sym, qz_make_pair(fun_call, QZ_NULL));
+    make_function(st, ctor_name, st->args_sym, qz_make_pair(st, fun_call, QZ_NULL));
   }
 
   /* generate accessors and modifiers */
@@ -934,21 +967,21 @@ QZ_DEF_CFUN(scm_define_record_type)
     if(!qz_is_none(accessor_name))
     {
       /* (access_record name field . args) */
-      qz_obj_t fun_call = qz_make_pair(qz_from_cfun(access_record),
-                          qz_make_pair(name,
-                          qz_make_pair(qz_from_fixnum(i), st->args_sym)));
+      qz_obj_t fun_call = qz_make_pair(st, qz_from_cfun(access_record),
+                          qz_make_pair(st, name,
+                          qz_make_pair(st, qz_from_fixnum(i), st->args_sym)));
 
-      make_function(st, accessor_name, st->args_sym, qz_make_pair(fun_call, QZ_NULL));
+      make_function(st, accessor_name, st->args_sym, qz_make_pair(st, fun_call, QZ_NULL));
     }
 
     if(!qz_is_none(modifier_name))
     {
       /* (modify_record name field . args) */
-      qz_obj_t fun_call = qz_make_pair(qz_from_cfun(modify_record),
-                          qz_make_pair(name,
-                          qz_make_pair(qz_from_fixnum(i), st->args_sym)));
+      qz_obj_t fun_call = qz_make_pair(st, qz_from_cfun(modify_record),
+                          qz_make_pair(st, name,
+                          qz_make_pair(st, qz_from_fixnum(i), st->args_sym)));
 
-      make_function(st, modifier_name, st->args_sym, qz_make_pair(fun_call, QZ_NULL));
+      make_function(st, modifier_name, st->args_sym, qz_make_pair(st, fun_call, QZ_NULL));
     }
   }
 
@@ -959,32 +992,25 @@ QZ_DEF_CFUN(scm_define_record_type)
  * 6.1. Equivalence predicates
  ******************************************************************************/
 
-static qz_obj_t compare(qz_state_t* st, qz_obj_t args, cmp_fun cf)
+QZ_DEF_PRIM(scm_eq_q)
 {
-  qz_obj_t obj1, obj2;
-  qz_get_args(st, &args, "aa", &obj1, &obj2);
-
-  int eq = cf(obj1, obj2);
-
-  qz_unref(st, obj1);
-  qz_unref(st, obj2);
-
-  return eq ? QZ_TRUE : QZ_FALSE;
-}
-
-QZ_DEF_CFUN(scm_eq_q)
-{
-  return compare(st, args, qz_eq);
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_eq(argv[0], argv[1]) ? QZ_TRUE : QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_eqv_q)
+QZ_DEF_PRIM(scm_eqv_q)
 {
-  return compare(st, args, qz_eqv);
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_eqv(argv[0], argv[1]) ? QZ_TRUE : QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_equal_q)
+QZ_DEF_PRIM(scm_equal_q)
 {
-  return compare(st, args, qz_equal);
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_equal(argv[0], argv[1]) ? QZ_TRUE : QZ_FALSE;
 }
 
 /******************************************************************************
@@ -998,188 +1024,140 @@ static int compare_fixnum(qz_obj_t a, qz_obj_t b)
   return a.value - b.value;
 }
 
-QZ_DEF_CFUN(scm_num_eq)
+QZ_DEF_PRIM(scm_num_eq)
 {
-  return compare_many(st, args, qz_is_fixnum, compare_fixnum, EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_fixnum, EQUAL);
 }
 
-QZ_DEF_CFUN(scm_num_lt)
+QZ_DEF_PRIM(scm_num_lt)
 {
-  return compare_many(st, args, qz_is_fixnum, compare_fixnum, LESS);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_fixnum, LESS);
 }
 
-QZ_DEF_CFUN(scm_num_gt)
+QZ_DEF_PRIM(scm_num_gt)
 {
-  return compare_many(st, args, qz_is_fixnum, compare_fixnum, GREATER);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_fixnum, GREATER);
 }
 
-QZ_DEF_CFUN(scm_num_lte)
+QZ_DEF_PRIM(scm_num_lte)
 {
-  return compare_many(st, args, qz_is_fixnum, compare_fixnum, LESS|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_fixnum, LESS|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_num_gte)
+QZ_DEF_PRIM(scm_num_gte)
 {
-  return compare_many(st, args, qz_is_fixnum, compare_fixnum, GREATER|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_fixnum, GREATER|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_num_add)
+QZ_DEF_PRIM(scm_num_add)
 {
-  qz_obj_t result = qz_from_fixnum(0);
-
-  for(;;)
-  {
-    qz_obj_t expr = qz_optional_arg(st, &args);
-    if(qz_is_none(expr))
-      return result;
+  QZ_UNUSED(st);
+  intptr_t result = 0;
 
-    qz_obj_t value = qz_eval(st, expr);
-    if(!qz_is_fixnum(value)) {
-      qz_unref(st, value);
-      return qz_error(st, "expected fixnum", &value, NULL);
-    }
+  for(size_t i = 0; i < argc; i++)
+    result += qz_to_fixnum(argv[i]);
 
-    result = qz_from_fixnum(qz_to_fixnum(result) + qz_to_fixnum(value));
-  }
+  return qz_from_fixnum(result);
 }
 
-QZ_DEF_CFUN(scm_num_mul)
+QZ_DEF_PRIM(scm_num_mul)
 {
-  qz_obj_t result = qz_from_fixnum(1);
-
-  for(;;)
-  {
-    qz_obj_t expr = qz_optional_arg(st, &args);
-    if(qz_is_none(expr))
-      return result;
+  QZ_UNUSED(st);
+  intptr_t result = 1;
 
-    qz_obj_t value = qz_eval(st, expr);
-    if(!qz_is_fixnum(value)) {
-      qz_unref(st, value);
-      return qz_error(st, "expected fixnum", &value, NULL);
-    }
+  for(size_t i = 0; i < argc; i++)
+    result *= qz_to_fixnum(argv[i]);
 
-    result = qz_from_fixnum(qz_to_fixnum(result) * qz_to_fixnum(value));
-  }
+  return qz_from_fixnum(result);
 }
 
-QZ_DEF_CFUN(scm_num_sub)
+QZ_DEF_PRIM(scm_num_sub)
 {
-  qz_obj_t expr = qz_required_arg(st, &args);
-
-  qz_obj_t result = qz_eval(st, expr);
-  if(!qz_is_fixnum(result)) {
-    qz_unref(st, result);
-    return qz_error(st, "expected fixnum", &result, NULL);
-  }
-
-  expr = qz_optional_arg(st, &args);
-  if(qz_is_none(expr))
-    return qz_from_fixnum(-qz_to_fixnum(result)); /* single argument form negates */
+  QZ_UNUSED(st);
+  intptr_t result = qz_to_fixnum(argv[0]);
 
-  for(;;)
-  {
-    qz_obj_t value = qz_eval(st, expr);
-    if(!qz_is_fixnum(value)) {
-      qz_unref(st, value);
-      qz_error(st, "expected fixnum");
-    }
+  if(argc == 1)
+    return qz_from_fixnum(-result); /* single argument form negates */
 
-    result = qz_from_fixnum(qz_to_fixnum(result) - qz_to_fixnum(value));
+  for(size_t i = 1; i < argc; i++)
+    result -= qz_to_fixnum(argv[i]);
 
-    expr = qz_optional_arg(st, &args);
-    if(qz_is_none(expr))
-      return result; /* ran out of expressions */
-  }
+  return qz_from_fixnum(result);
 }
 
 /******************************************************************************
  * 6.3. Booleans
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_not)
+QZ_DEF_PRIM(scm_not)
 {
-  qz_obj_t value;
-  qz_get_args(st, &args, "a", &value);
-
-  if(qz_eq(value, QZ_FALSE))
-    return QZ_TRUE;
-
-  qz_unref(st, value);
-  return QZ_FALSE;
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_eq(argv[0], QZ_FALSE) ? QZ_TRUE : QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_boolean_q)
+QZ_DEF_PRIM(scm_boolean_q)
 {
-  return predicate(st, args, qz_is_bool);
+  return prim_predicate(st, argc, argv, qz_is_bool);
 }
 
 /******************************************************************************
  * 6.4. Pairs and lists
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_pair_q)
+QZ_DEF_PRIM(scm_pair_q)
 {
-  return predicate(st, args, qz_is_pair);
+  return prim_predicate(st, argc, argv, qz_is_pair);
 }
 
-QZ_DEF_CFUN(scm_cons)
+QZ_DEF_PRIM(scm_cons)
 {
-  qz_obj_t obj1, obj2;
-  qz_get_args(st, &args, "aa", &obj1, &obj2);
-
-  return qz_make_pair(obj1, obj2);
+  QZ_UNUSED(argc);
+  return qz_make_pair(st, qz_ref(st, argv[0]), qz_ref(st, argv[1]));
 }
 
-QZ_DEF_CFUN(scm_car)
+QZ_DEF_PRIM(scm_car)
 {
-  qz_obj_t pair;
-  qz_get_args(st, &args, "p", &pair);
-
-  qz_obj_t first = qz_ref(st, qz_first(pair));
-  qz_unref(st, pair);
-  return first;
+  QZ_UNUSED(argc);
+  return qz_ref(st, qz_first(argv[0]));
 }
 
-QZ_DEF_CFUN(scm_cdr)
+QZ_DEF_PRIM(scm_cdr)
 {
-  qz_obj_t pair;
-  qz_get_args(st, &args, "p", &pair);
-
-  qz_obj_t rest = qz_ref(st, qz_rest(pair));
-  qz_unref(st, pair);
-  return rest;
+  QZ_UNUSED(argc);
+  return qz_ref(st, qz_rest(argv[0]));
 }
 
-QZ_DEF_CFUN(scm_set_car_b)
+QZ_DEF_PRIM(scm_set_car_b)
 {
-  qz_obj_t pair, first;
-  qz_get_args(st, &args, "pa", &pair, &first);
-
-  qz_pair_t* pair_raw = qz_to_pair(pair);
+  QZ_UNUSED(argc);
+  if(qz_immutable(qz_to_cell(argv[0])))
+    return qz_error(st, "immutable object", &argv[0], NULL);
+  qz_pair_t* pair_raw = qz_to_pair(argv[0]);
   qz_unref(st, pair_raw->first);
-  pair_raw->first = first;
-
-  qz_unref(st, pair);
+  pair_raw->first = qz_ref(st, argv[1]);
   return QZ_NONE;
 }
 
-QZ_DEF_CFUN(scm_set_cdr_b)
+QZ_DEF_PRIM(scm_set_cdr_b)
 {
-  qz_obj_t pair, rest;
-  qz_get_args(st, &args, "pa", &pair, &rest);
-
-  qz_pair_t* pair_raw = qz_to_pair(pair);
+  QZ_UNUSED(argc);
+  if(qz_immutable(qz_to_cell(argv[0])))
+    return qz_error(st, "immutable object", &argv[0], NULL);
+  qz_pair_t* pair_raw = qz_to_pair(argv[0]);
   qz_unref(st, pair_raw->rest);
-  pair_raw->rest = rest;
-
-  qz_unref(st, pair);
+  pair_raw->rest = qz_ref(st, argv[1]);
   return QZ_NONE;
 }
 
-QZ_DEF_CFUN(scm_null_q)
+QZ_DEF_PRIM(scm_null_q)
 {
-  return predicate(st, args, qz_is_null);
+  return prim_predicate(st, argc, argv, qz_is_null);
 }
 
 static int is_list(qz_obj_t obj)
@@ -1196,279 +1174,235 @@ static int is_list(qz_obj_t obj)
   }
 }
 
-QZ_DEF_CFUN(scm_list_q)
+QZ_DEF_PRIM(scm_list_q)
 {
-  return predicate(st, args, is_list);
+  return prim_predicate(st, argc, argv, is_list);
 }
 
-QZ_DEF_CFUN(scm_make_list)
+QZ_DEF_PRIM(scm_make_list)
 {
-  qz_obj_t k, fill;
-  qz_get_args(st, &args, "ia?", &k, &fill);
-
+  qz_obj_t fill = argc > 1 ? argv[1] : QZ_NONE;
   qz_obj_t result = QZ_NULL;
 
-  for(intptr_t i = qz_to_fixnum(k); i > 0; i--)
-    result = qz_make_pair(qz_ref(st, fill), result);
-
-  qz_unref(st, fill);
+  for(intptr_t i = qz_to_fixnum(argv[0]); i > 0; i--)
+    result = qz_make_pair(st, qz_ref(st, fill), result);
 
   return result;
 }
 
-QZ_DEF_CFUN(scm_list)
+QZ_DEF_PRIM(scm_list)
 {
-  return qz_eval_list(st, args);
-}
+  qz_obj_t result = QZ_NULL;
 
-QZ_DEF_CFUN(scm_length)
-{
-  qz_obj_t obj;
-  qz_get_args(st, &args, "a", &obj);
+  for(size_t i = argc; i > 0; i--)
+    result = qz_make_pair(st, qz_ref(st, argv[i - 1]), result);
 
-  intptr_t len = list_length(obj);
+  return result;
+}
 
-  qz_unref(st, obj);
+QZ_DEF_PRIM(scm_length)
+{
+  QZ_UNUSED(argc);
+  intptr_t len = list_length(argv[0]);
 
   if(len < 0)
-    return qz_error(st, "expected list", &obj, NULL);
+    return qz_error(st, "expected list", &argv[0], NULL);
 
   return qz_from_fixnum(len);
 }
 
 /* TODO append */
 
-QZ_DEF_CFUN(scm_reverse)
+QZ_DEF_PRIM(scm_reverse)
 {
-  qz_obj_t list = qz_eval(st, qz_required_arg(st, &args));
+  QZ_UNUSED(argc);
   qz_obj_t result = QZ_NULL;
 
-  qz_obj_t elem = list;
-  for(;;) {
-    if(qz_is_null(elem)) {
-      qz_unref(st, list);
-      return result;
-    }
-
+  for(qz_obj_t elem = argv[0]; !qz_is_null(elem); elem = qz_rest(elem)) {
     if(!qz_is_pair(elem)) {
       qz_unref(st, result);
-      qz_push_safety(st, list);
-      return qz_error(st, "expected list", &list, NULL);
+      return qz_error(st, "expected list", &argv[0], NULL);
     }
 
-    result = qz_make_pair(qz_first(elem), result);
-    elem = qz_rest(elem);
+    result = qz_make_pair(st, qz_ref(st, qz_first(elem)), result);
   }
+
+  return result;
 }
 
-QZ_DEF_CFUN(scm_list_tail)
+/* the tail of a list after its first k elements, borrowed */
+static qz_obj_t kth_tail(qz_state_t* st, qz_obj_t* argv)
 {
-  qz_obj_t list, k;
-  qz_get_args(st, &args, "pi", &list, &k);
-
-  qz_obj_t elem = list;
-  for(intptr_t i = qz_to_fixnum(k); i > 0; i--)
+  qz_obj_t elem = argv[0];
+  for(intptr_t i = qz_to_fixnum(argv[1]); i > 0; i--)
   {
-    if(qz_is_null(elem)) {
-      qz_push_safety(st, list);
-      return qz_error(st, "list too short", &list, NULL);
-    }
+    if(qz_is_null(elem))
+      return qz_error(st, "list too short", &argv[0], NULL);
 
-    if(!qz_is_pair(elem)) {
-      qz_push_safety(st, list);
-      return qz_error(st, "expected list", &list, NULL);
-    }
+    if(!qz_is_pair(elem))
+      return qz_error(st, "expected list", &argv[0], NULL);
 
     elem = qz_rest(elem);
   }
 
-  qz_ref(st, elem);
-  qz_unref(st, list);
   return elem;
 }
 
-QZ_DEF_CFUN(scm_list_ref)
+QZ_DEF_PRIM(scm_list_tail)
 {
-  return qz_first(scm_list_tail(st, args));
+  QZ_UNUSED(argc);
+  return qz_ref(st, kth_tail(st, argv));
 }
 
-QZ_DEF_CFUN(scm_list_set_b)
+/* the pair holding a list's kth element */
+static qz_obj_t kth_pair(qz_state_t* st, qz_obj_t* argv)
 {
-  qz_obj_t elem = scm_list_tail(st, args);
+  qz_obj_t elem = kth_tail(st, argv);
 
-  qz_push_safety(st, elem);
+  if(qz_is_null(elem))
+    return qz_error(st, "list too short", &argv[0], NULL);
 
   if(!qz_is_pair(elem))
-    return qz_error(st, "expected list", &elem, NULL);
+    return qz_error(st, "expected list", &argv[0], NULL);
+
+  return elem;
+}
 
-  qz_obj_t obj = qz_eval(st, qz_required_arg(st, &args));
+QZ_DEF_PRIM(scm_list_ref)
+{
+  QZ_UNUSED(argc);
+  return qz_ref(st, qz_first(kth_pair(st, argv)));
+}
 
-  qz_pop_safety(st, 1);
+QZ_DEF_PRIM(scm_list_set_b)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t elem = kth_pair(st, argv);
+
+  if(qz_immutable(qz_to_cell(elem)))
+    return qz_error(st, "immutable object", &elem, NULL);
 
   qz_pair_t* pair = qz_to_pair(elem);
   qz_unref(st, pair->first);
-  pair->first = obj;
+  pair->first = qz_ref(st, argv[2]);
 
   return QZ_NONE;
 }
 
-static qz_obj_t inner_member(qz_state_t* st, qz_obj_t args, cmp_fun cf)
+/* whether an element of the list searched matches the object searched for
+ * member and assoc take a procedure to compare with in place of cf */
+static int matches(qz_state_t* st, size_t argc, qz_obj_t* argv, qz_obj_t elem, cmp_fun cf)
 {
-  qz_obj_t obj, list;
-  qz_get_args(st, &args, "ap", &obj, &list);
+  if(argc < 3)
+    return cf(argv[0], elem);
 
-  qz_obj_t custom_cmp = QZ_NONE;
-  if(cf == qz_equal) {
-    custom_cmp = qz_optional_arg(st, &args);
-    if(!qz_is_none(custom_cmp)) {
-      qz_obj_t args = qz_make_pair(QZ_NULL, qz_make_pair(qz_ref(st, obj), QZ_NULL));
-      custom_cmp = qz_make_pair(qz_eval(st, custom_cmp), args);
-      qz_push_safety(st, custom_cmp);
-    }
-  }
+  qz_obj_t cmp_argv[2] = { argv[0], elem };
+  qz_obj_t result = call_proc(st, argv[2], 2, cmp_argv);
+  int match = !qz_eq(result, QZ_FALSE);
+  qz_unref(st, result);
 
-  qz_obj_t elem = list;
-  qz_obj_t result = QZ_FALSE;
-  for(;;) {
-    if(qz_is_null(result))
-      break;
+  return match;
+}
 
+/* the first tail of the list starting with a match, or #f */
+static qz_obj_t inner_member(qz_state_t* st, size_t argc, qz_obj_t* argv, cmp_fun cf)
+{
+  for(qz_obj_t elem = argv[1]; !qz_is_null(elem); elem = qz_rest(elem)) {
     if(!qz_is_pair(elem))
-      return qz_error(st, "expected list");
-
-    int match;
-    if(!qz_is_none(custom_cmp)) {
-      qz_obj_t* arg = &qz_to_pair(qz_rest(custom_cmp))->first;
-      /* insert element into args */
-      qz_unref(st, *arg);
-      *arg = qz_ref(st, qz_first(elem));
-      /* call custom comparator */
-      qz_obj_t custom_cmp_result = qz_eval(st, custom_cmp);
-      /* check for equality */
-      match = !qz_eq(custom_cmp_result, QZ_FALSE);
-      /* cleanup */
-      qz_unref(st, custom_cmp_result);
-    }
-    else {
-      match = cf(qz_first(elem), obj);
-    }
-
-    if(match) {
-      result = qz_ref(st, elem);
-      break;
-    }
-
-    elem = qz_rest(elem);
-  }
+      return qz_error(st, "expected list", &argv[1], NULL);
 
-  if(!qz_is_none(custom_cmp)) {
-    qz_pop_safety(st, 1);
-    qz_unref(st, custom_cmp);
+    if(matches(st, argc, argv, qz_first(elem), cf))
+      return qz_ref(st, elem);
   }
-  qz_pop_safety(st, 2);
-  qz_unref(st, obj);
-  qz_unref(st, list);
 
-  return result;
+  return QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_memq)
+QZ_DEF_PRIM(scm_memq)
 {
-  return inner_member(st, args, qz_eq);
+  return inner_member(st, argc, argv, qz_eq);
 }
 
-QZ_DEF_CFUN(scm_memv)
+QZ_DEF_PRIM(scm_memv)
 {
-  return inner_member(st, args, qz_eqv);
+  return inner_member(st, argc, argv, qz_eqv);
 }
 
-QZ_DEF_CFUN(scm_member)
+QZ_DEF_PRIM(scm_member)
 {
-  return inner_member(st, args, qz_equal);
+  return inner_member(st, argc, argv, qz_equal);
 }
 
-static qz_obj_t inner_assoc(qz_state_t* st, qz_obj_t args, cmp_fun cf)
+/* the first pair in the association list with a matching key, or #f */
+static qz_obj_t inner_assoc(qz_state_t* st, size_t argc, qz_obj_t* argv, cmp_fun cf)
 {
-  qz_obj_t obj = inner_member(st, args, cf);
-
-  if(qz_eq(obj, QZ_FALSE))
-    return QZ_FALSE;
+  for(qz_obj_t elem = argv[1]; !qz_is_null(elem); elem = qz_rest(elem)) {
+    if(!qz_is_pair(elem) || !qz_is_pair(qz_first(elem)))
+      return qz_error(st, "expected association list", &argv[1], NULL);
 
-  qz_obj_t result = qz_ref(st, qz_first(obj));
-  qz_unref(st, obj);
+    qz_obj_t entry = qz_first(elem);
+    if(matches(st, argc, argv, qz_first(entry), cf))
+      return qz_ref(st, entry);
+  }
 
-  return result;
+  return QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_assq)
+QZ_DEF_PRIM(scm_assq)
 {
-  return inner_assoc(st, args, qz_eq);
+  return inner_assoc(st, argc, argv, qz_eq);
 }
 
-QZ_DEF_CFUN(scm_assv)
+QZ_DEF_PRIM(scm_assv)
 {
-  return inner_assoc(st, args, qz_eqv);
+  return inner_assoc(st, argc, argv, qz_eqv);
 }
 
-QZ_DEF_CFUN(scm_assoc)
+QZ_DEF_PRIM(scm_assoc)
 {
-  return inner_assoc(st, args, qz_equal);
+  return inner_assoc(st, argc, argv, qz_equal);
 }
 
-QZ_DEF_CFUN(scm_list_copy)
+QZ_DEF_PRIM(scm_list_copy)
 {
-  qz_obj_t list = qz_eval(st, qz_required_arg(st, &args));
-  qz_push_safety(st, list);
-
-  qz_obj_t elem = list;
+  QZ_UNUSED(argc);
   qz_obj_t result = QZ_NULL;
+  qz_obj_t* tail = &result;
 
-  for(;;) {
-    if(qz_is_null(elem)) {
-      qz_pop_safety(st, 1);
-      qz_unref(st, list);
-      return result; /* ran out of elements */
-    }
-
-    if(!qz_is_pair(elem))
-      return qz_error(st, "expected list", &list, NULL);
-
-    qz_obj_t inner_result = qz_make_pair(qz_ref(st, qz_first(elem)), QZ_NULL);
-
-    if(!qz_is_null(result))
-      qz_to_pair(result)->rest = inner_result;
-
-    result = inner_result;
-    elem = qz_rest(elem);
+  qz_obj_t elem = argv[0];
+  for(; qz_is_pair(elem); elem = qz_rest(elem)) {
+    *tail = qz_make_pair(st, qz_ref(st, qz_first(elem)), QZ_NULL);
+    tail = &qz_to_pair(*tail)->rest;
   }
+
+  /* an improper list keeps its last cdr, anything else is returned as is */
+  *tail = qz_ref(st, elem);
+  return result;
 }
 
 /******************************************************************************
  * 6.5. Symbols
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_symbol_q)
+QZ_DEF_PRIM(scm_symbol_q)
 {
-  return predicate(st, args, qz_is_sym);
+  return prim_predicate(st, argc, argv, qz_is_sym);
 }
 
-QZ_DEF_CFUN(scm_symbol_a_string)
+QZ_DEF_PRIM(scm_symbol_a_string)
 {
-  qz_obj_t sym;
-  qz_get_args(st, &args, "n", &sym);
-
-  qz_obj_t* str = qz_hash_get(st, st->sym_name, sym);
-  assert(str && qz_is_string(*str));
+  QZ_UNUSED(argc);
+  qz_obj_t str = qz_sym_name(st, argv[0]);
+  if(qz_is_none(str))
+    return qz_error(st, "symbol has no name", &argv[0], NULL);
 
-  return qz_ref(st, *str);
+  return qz_ref(st, str);
 }
 
-QZ_DEF_CFUN(scm_string_a_symbol)
+QZ_DEF_PRIM(scm_string_a_symbol)
 {
-  qz_obj_t str;
-  qz_get_args(st, &args, "s", &str);
-
-  return qz_make_sym(st, str);
+  QZ_UNUSED(argc);
+  return qz_make_sym(st, qz_ref(st, argv[0]));
 }
 
 /******************************************************************************
@@ -1485,165 +1419,171 @@ static int compare_char_ci(qz_obj_t a, qz_obj_t b)
   return tolower(qz_to_char(a)) - tolower(qz_to_char(b));
 }
 
-QZ_DEF_CFUN(scm_char_q)
+QZ_DEF_PRIM(scm_char_q)
 {
-  return predicate(st, args, qz_is_char);
+  return prim_predicate(st, argc, argv, qz_is_char);
 }
 
-QZ_DEF_CFUN(scm_char_eq_q)
+QZ_DEF_PRIM(scm_char_eq_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char, EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char, EQUAL);
 }
 
-QZ_DEF_CFUN(scm_char_lt_q)
+QZ_DEF_PRIM(scm_char_lt_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char, LESS);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char, LESS);
 }
 
-QZ_DEF_CFUN(scm_char_gt_q)
+QZ_DEF_PRIM(scm_char_gt_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char, GREATER);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char, GREATER);
 }
 
-QZ_DEF_CFUN(scm_char_lte_q)
+QZ_DEF_PRIM(scm_char_lte_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char, LESS|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char, LESS|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_char_gte_q)
+QZ_DEF_PRIM(scm_char_gte_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char, GREATER|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char, GREATER|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_char_ci_eq_q)
+QZ_DEF_PRIM(scm_char_ci_eq_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char_ci, EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char_ci, EQUAL);
 }
 
-QZ_DEF_CFUN(scm_char_ci_lt_q)
+QZ_DEF_PRIM(scm_char_ci_lt_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char_ci, LESS);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char_ci, LESS);
 }
 
-QZ_DEF_CFUN(scm_char_ci_gt_q)
+QZ_DEF_PRIM(scm_char_ci_gt_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char_ci, GREATER);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char_ci, GREATER);
 }
 
-QZ_DEF_CFUN(scm_char_ci_lte_q)
+QZ_DEF_PRIM(scm_char_ci_lte_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char_ci, LESS|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char_ci, LESS|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_char_ci_gte_q)
+QZ_DEF_PRIM(scm_char_ci_gte_q)
 {
-  return compare_many(st, args, qz_is_char, compare_char_ci, GREATER|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_char_ci, GREATER|EQUAL);
 }
 
 typedef int (*char_pred_fun)(int);
 
-static qz_obj_t inner_char_predicate(qz_state_t* st, qz_obj_t args, char_pred_fun cpf)
+/* a character predicate, which is false for anything but a character */
+static qz_obj_t char_predicate(size_t argc, qz_obj_t* argv, char_pred_fun cpf)
 {
-  qz_obj_t value = qz_eval(st, qz_required_arg(st, &args));
-  if(!qz_is_char(value)) {
-    qz_unref(st, value);
-    return QZ_FALSE;
-  }
-  return cpf(qz_to_char(value)) ? QZ_TRUE : QZ_FALSE;
+  QZ_UNUSED(argc);
+  return qz_from_bool(qz_is_char(argv[0]) && cpf(qz_to_char(argv[0])));
 }
 
-QZ_DEF_CFUN(scm_char_alphabetic_q)
+QZ_DEF_PRIM(scm_char_alphabetic_q)
 {
-  return inner_char_predicate(st, args, isalpha);
+  QZ_UNUSED(st);
+  return char_predicate(argc, argv, isalpha);
 }
 
-QZ_DEF_CFUN(scm_char_numeric_q)
+QZ_DEF_PRIM(scm_char_numeric_q)
 {
-  return inner_char_predicate(st, args, isdigit);
+  QZ_UNUSED(st);
+  return char_predicate(argc, argv, isdigit);
 }
 
-QZ_DEF_CFUN(scm_char_whitespace_q)
+QZ_DEF_PRIM(scm_char_whitespace_q)
 {
-  return inner_char_predicate(st, args, isspace);
+  QZ_UNUSED(st);
+  return char_predicate(argc, argv, isspace);
 }
 
-QZ_DEF_CFUN(scm_char_upper_case_q)
+QZ_DEF_PRIM(scm_char_upper_case_q)
 {
-  return inner_char_predicate(st, args, isupper);
+  QZ_UNUSED(st);
+  return char_predicate(argc, argv, isupper);
 }
 
-QZ_DEF_CFUN(scm_char_lower_case_q)
+QZ_DEF_PRIM(scm_char_lower_case_q)
 {
-  return inner_char_predicate(st, args, islower);
+  QZ_UNUSED(st);
+  return char_predicate(argc, argv, islower);
 }
 
-QZ_DEF_CFUN(scm_digit_value)
+QZ_DEF_PRIM(scm_digit_value)
 {
-  qz_obj_t value = qz_eval(st, qz_required_arg(st, &args));
-  if(!qz_is_char(value)) {
-    qz_unref(st, value);
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  if(!qz_is_char(argv[0]))
     return QZ_FALSE;
-  }
-  char ch = qz_to_char(value);
+  char ch = qz_to_char(argv[0]);
   return isdigit(ch) ? qz_from_fixnum(ch - '0') : QZ_FALSE;
 }
 
-QZ_DEF_CFUN(scm_char_a_integer)
+QZ_DEF_PRIM(scm_char_a_integer)
 {
-  qz_obj_t value;
-  qz_get_args(st, &args, "c", &value);
-  return qz_from_fixnum(qz_to_char(value));
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_from_fixnum(qz_to_char(argv[0]));
 }
 
-QZ_DEF_CFUN(scm_integer_a_char)
+QZ_DEF_PRIM(scm_integer_a_char)
 {
-  qz_obj_t value;
-  qz_get_args(st, &args, "i", &value);
-  return qz_from_char(qz_to_fixnum(value));
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_from_char(qz_to_fixnum(argv[0]));
 }
 
 /******************************************************************************
  * 6.7. Strings
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_string_q)
+QZ_DEF_PRIM(scm_string_q)
 {
-  return predicate(st, args, qz_is_string);
+  return prim_predicate(st, argc, argv, qz_is_string);
 }
 
-QZ_DEF_CFUN(scm_make_string)
+QZ_DEF_PRIM(scm_make_string)
 {
-  qz_obj_t k, fill;
-  qz_get_args(st, &args, "ic?", &k, &fill);
-
-  intptr_t k_raw = qz_to_fixnum(k);
+  intptr_t k_raw = qz_to_fixnum(argv[0]);
   if(k_raw < 0)
-    return qz_error(st, "bad string length", &k, NULL);
+    return qz_error(st, "bad string length", &argv[0], NULL);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_STRING, k_raw*sizeof(char));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_STRING, k_raw*sizeof(char));
   cell->value.array.size = k_raw;
   cell->value.array.capacity = k_raw;
 
-  if(!qz_is_none(fill))
-    memset(QZ_CELL_DATA(cell, char), qz_to_char(fill), k_raw*sizeof(char));
+  /* without a fill the contents are unspecified, spaces at least print */
+  memset(QZ_CELL_DATA(cell, char), argc > 1 ? qz_to_char(argv[1]) : ' ', k_raw*sizeof(char));
 
   return qz_from_cell(cell);
 }
 
 /* TODO string */
 
-static qz_obj_t array_length(qz_state_t* st, qz_obj_t args, const char* type_char)
+static qz_obj_t array_length(qz_obj_t obj)
 {
-  qz_obj_t obj;
-  qz_get_args(st, &args, type_char, &obj);
-  size_t len = qz_to_cell(obj)->value.array.size;
-  qz_unref(st, obj);
-  return qz_from_fixnum(len);
+  return qz_from_fixnum(qz_to_cell(obj)->value.array.size);
 }
 
-QZ_DEF_CFUN(scm_string_length)
+QZ_DEF_PRIM(scm_string_length)
 {
-  return array_length(st, args, "s");
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return array_length(argv[0]);
 }
 
 static qz_obj_t string_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
@@ -1652,9 +1592,10 @@ static qz_obj_t string_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
   return qz_from_char(QZ_CELL_DATA(cell, char)[i]);
 }
 
-QZ_DEF_CFUN(scm_string_ref)
+QZ_DEF_PRIM(scm_string_ref)
 {
-  return array_ref(st, args, "si", string_ref);
+  QZ_UNUSED(argc);
+  return array_ref(st, argv, string_ref);
 }
 
 static void string_set(qz_state_t* st, qz_cell_t* cell, size_t i, qz_obj_t obj)
@@ -1663,9 +1604,10 @@ static void string_set(qz_state_t* st, qz_cell_t* cell, size_t i, qz_obj_t obj)
   QZ_CELL_DATA(cell, char)[i] = qz_to_char(obj);
 }
 
-QZ_DEF_CFUN(scm_string_set_b)
+QZ_DEF_PRIM(scm_string_set_b)
 {
-  return array_set(st, args, "sic", string_set);
+  QZ_UNUSED(argc);
+  return array_set(st, argv, string_set);
 }
 
 static int min(size_t a, size_t b)
@@ -1686,6 +1628,10 @@ typedef int (*memcmp_fun)(const void*, const void*, size_t);
 
 static int compare_string(qz_obj_t a, qz_obj_t b, memcmp_fun mcf)
 {
+  /* interned strings are often the same cell */
+  if(a.value == b.value)
+    return 0;
+
   qz_cell_t* a_cell = qz_to_cell(a);
   qz_cell_t* b_cell = qz_to_cell(b);
 
@@ -1710,166 +1656,151 @@ static int compare_string_ci(qz_obj_t a, qz_obj_t b)
 
 /* TODO -ni variants */
 
-QZ_DEF_CFUN(scm_string_eq_q)
+QZ_DEF_PRIM(scm_string_eq_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_cs, EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_cs, EQUAL);
 }
 
-QZ_DEF_CFUN(scm_string_ci_eq_q)
+QZ_DEF_PRIM(scm_string_ci_eq_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_ci, EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_ci, EQUAL);
 }
 
-QZ_DEF_CFUN(scm_string_lt_q)
+QZ_DEF_PRIM(scm_string_lt_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_cs, LESS);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_cs, LESS);
 }
 
-QZ_DEF_CFUN(scm_string_ci_lt_q)
+QZ_DEF_PRIM(scm_string_ci_lt_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_ci, LESS);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_ci, LESS);
 }
 
-QZ_DEF_CFUN(scm_string_gt_q)
+QZ_DEF_PRIM(scm_string_gt_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_cs, GREATER);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_cs, GREATER);
 }
 
-QZ_DEF_CFUN(scm_string_ci_gt_q)
+QZ_DEF_PRIM(scm_string_ci_gt_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_ci, GREATER);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_ci, GREATER);
 }
 
-QZ_DEF_CFUN(scm_string_lte_q)
+QZ_DEF_PRIM(scm_string_lte_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_cs, LESS|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_cs, LESS|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_string_ci_lte_q)
+QZ_DEF_PRIM(scm_string_ci_lte_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_ci, LESS|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_ci, LESS|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_string_gte_q)
+QZ_DEF_PRIM(scm_string_gte_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_cs, GREATER|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_cs, GREATER|EQUAL);
 }
 
-QZ_DEF_CFUN(scm_string_ci_gte_q)
+QZ_DEF_PRIM(scm_string_ci_gte_q)
 {
-  return compare_many(st, args, qz_is_string, compare_string_ci, GREATER|EQUAL);
+  QZ_UNUSED(st);
+  return compare_args(argc, argv, compare_string_ci, GREATER|EQUAL);
 }
 
 typedef int (*xformchar_fun)(int);
 
-static qz_obj_t transform_string(qz_state_t* st, qz_obj_t args, xformchar_fun xcf)
+static qz_obj_t transform_string(qz_state_t* st, qz_obj_t str, xformchar_fun xcf)
 {
-  qz_obj_t str;
-  qz_get_args(st, &args, "s", &str);
-
   qz_cell_t* in = qz_to_cell(str);
   size_t len = in->value.array.size;
 
-  qz_cell_t* out = qz_make_cell(QZ_CT_STRING, len*sizeof(char));
+  qz_cell_t* out = qz_make_cell(st, QZ_CT_STRING, len*sizeof(char));
   out->value.array.size = len;
   out->value.array.capacity = len;
 
   for(size_t i = 0; i < len; i++)
     QZ_CELL_DATA(out, char)[i] = xcf(QZ_CELL_DATA(in, char)[i]);
 
-  qz_unref(st, str);
-
   return qz_from_cell(out);
 }
 
-QZ_DEF_CFUN(scm_string_upcase)
+QZ_DEF_PRIM(scm_string_upcase)
 {
-  return transform_string(st, args, toupper);
+  QZ_UNUSED(argc);
+  return transform_string(st, argv[0], toupper);
 }
 
-QZ_DEF_CFUN(scm_string_downcase)
+QZ_DEF_PRIM(scm_string_downcase)
 {
-  return transform_string(st, args, tolower);
+  QZ_UNUSED(argc);
+  return transform_string(st, argv[0], tolower);
 }
 
 /* TODO string-foldcase */
 
-QZ_DEF_CFUN(scm_substring)
+QZ_DEF_PRIM(scm_substring)
 {
-  qz_obj_t str, start, end;
-  qz_get_args(st, &args, "sii", &str, &start, &end);
-
-  qz_cell_t* in = qz_to_cell(str);
-  intptr_t start_raw = qz_to_fixnum(start);
-  intptr_t end_raw = qz_to_fixnum(end);
+  QZ_UNUSED(argc);
+  qz_cell_t* in = qz_to_cell(argv[0]);
+  intptr_t start_raw = qz_to_fixnum(argv[1]);
+  intptr_t end_raw = qz_to_fixnum(argv[2]);
 
-  if(start_raw < 0 || end_raw < start_raw || in->value.array.size < (uintptr_t)end_raw) {
-    qz_push_safety(st, str);
-    return qz_error(st, "index out of bounds", &str, &start, &end, NULL);
-  }
+  if(start_raw < 0 || end_raw < start_raw || in->value.array.size < (uintptr_t)end_raw)
+    return qz_error(st, "index out of bounds", &argv[0], &argv[1], &argv[2], NULL);
 
-  qz_cell_t* out = qz_make_cell(QZ_CT_STRING, (end_raw-start_raw)*sizeof(char));
+  size_t len = end_raw - start_raw;
+  qz_cell_t* out = qz_make_cell(st, QZ_CT_STRING, len*sizeof(char));
+  out->value.array.size = len;
+  out->value.array.capacity = len;
 
-  memcpy(QZ_CELL_DATA(out, char),
-         QZ_CELL_DATA(in, char) + start_raw,
-         (end_raw-start_raw)*sizeof(char));
-
-  qz_unref(st, str);
+  memcpy(QZ_CELL_DATA(out, char), QZ_CELL_DATA(in, char) + start_raw, len*sizeof(char));
 
   return qz_from_cell(out);
 }
 
-QZ_DEF_CFUN(scm_string_a_list)
+QZ_DEF_PRIM(scm_string_a_list)
 {
-  qz_obj_t str;
-  qz_get_args(st, &args, "s", &str);
-
-  qz_cell_t* cell = qz_to_cell(str);
-
+  QZ_UNUSED(argc);
+  qz_cell_t* cell = qz_to_cell(argv[0]);
   qz_obj_t result = QZ_NULL;
-  qz_obj_t elem;
 
-  for(size_t i = 0; i < cell->value.array.size; i++) {
-    qz_obj_t inner_elem = qz_make_pair(qz_from_char(QZ_CELL_DATA(cell, char)[i]), QZ_NULL);
-    if(qz_is_null(result)) {
-      result = elem = inner_elem;
-    }
-    else {
-      qz_to_pair(elem)->rest = inner_elem;
-      elem = inner_elem;
-    }
-  }
+  for(size_t i = cell->value.array.size; i > 0; i--)
+    result = qz_make_pair(st, qz_from_char(QZ_CELL_DATA(cell, char)[i - 1]), result);
 
-  qz_unref(st, str);
   return result;
 }
 
-QZ_DEF_CFUN(scm_list_a_string)
+QZ_DEF_PRIM(scm_list_a_string)
 {
-  qz_obj_t list;
-  qz_get_args(st, &args, "p", &list);
-
-  intptr_t len = list_length(list);
-  if(len < 0) {
-    qz_push_safety(st, list);
-    return qz_error(st, "expected list", &list, NULL);
-  }
-
-  qz_cell_t* cell = qz_make_cell(QZ_CT_STRING, len);
+  QZ_UNUSED(argc);
+  intptr_t len = list_length(argv[0]);
+  if(len < 0)
+    return qz_error(st, "expected list", &argv[0], NULL);
 
-  qz_obj_t e = list;
-  for(size_t i = 0; i < (uintptr_t)len; i++) {
+  qz_obj_t e = argv[0];
+  for(intptr_t i = 0; i < len; i++, e = qz_rest(e)) {
     qz_obj_t ch = qz_first(e);
-    if(!qz_is_char(ch)) {
-      qz_push_safety(st, list);
-      qz_unref(st, qz_from_cell(cell));
+    if(!qz_is_char(ch))
       return qz_error(st, "expected character", &ch, NULL);
-    }
-    QZ_CELL_DATA(cell, char)[i] = qz_to_char(ch);
-    e = qz_rest(e);
   }
 
-  qz_unref(st, list);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_STRING, len*sizeof(char));
+  cell->value.array.size = len;
+  cell->value.array.capacity = len;
+
+  e = argv[0];
+  for(intptr_t i = 0; i < len; i++, e = qz_rest(e))
+    QZ_CELL_DATA(cell, char)[i] = qz_to_char(qz_first(e));
+
   return qz_from_cell(cell);
 }
 
@@ -1878,9 +1809,10 @@ static int identity(int i)
   return i;
 }
 
-QZ_DEF_CFUN(scm_string_copy)
+QZ_DEF_PRIM(scm_string_copy)
 {
-  return transform_string(st, args, identity);
+  QZ_UNUSED(argc);
+  return transform_string(st, argv[0], identity);
 }
 
 /* TODO string-fill! */
@@ -1889,38 +1821,34 @@ QZ_DEF_CFUN(scm_string_copy)
  * 6.8. Vectors
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_vector_q)
+QZ_DEF_PRIM(scm_vector_q)
 {
-  return predicate(st, args, qz_is_vector);
+  return prim_predicate(st, argc, argv, qz_is_vector);
 }
 
-QZ_DEF_CFUN(scm_make_vector)
+QZ_DEF_PRIM(scm_make_vector)
 {
-  qz_obj_t k, fill;
-  qz_get_args(st, &args, "ia?", &k, &fill);
+  intptr_t k_raw = qz_to_fixnum(argv[0]);
+  if(k_raw < 0)
+    return qz_error(st, "bad vector length", &argv[0], NULL);
 
-  intptr_t k_raw = qz_to_fixnum(k);
-  if(k_raw < 0) {
-    qz_unref(st, fill);
-    return qz_error(st, "bad vector length", &k, NULL);
-  }
+  qz_obj_t fill = argc > 1 ? argv[1] : QZ_NONE;
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_STRING, k_raw*sizeof(qz_obj_t));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_VECTOR, k_raw*sizeof(qz_obj_t));
   cell->value.array.size = k_raw;
   cell->value.array.capacity = k_raw;
 
-  if(!qz_is_none(fill)) {
-    for(size_t i = 0; i < (uintptr_t)k_raw; i++)
-      QZ_CELL_DATA(cell, qz_obj_t)[i] = qz_ref(st, fill);
-    qz_unref(st, fill);
-  }
+  for(size_t i = 0; i < (uintptr_t)k_raw; i++)
+    QZ_CELL_DATA(cell, qz_obj_t)[i] = qz_ref(st, fill);
 
   return qz_from_cell(cell);
 }
 
-QZ_DEF_CFUN(scm_vector_length)
+QZ_DEF_PRIM(scm_vector_length)
 {
-  return array_length(st, args, "v");
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return array_length(argv[0]);
 }
 
 static qz_obj_t vector_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
@@ -1928,155 +1856,125 @@ static qz_obj_t vector_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
   return qz_ref(st, QZ_CELL_DATA(cell, qz_obj_t)[i]);
 }
 
-QZ_DEF_CFUN(scm_vector_ref)
+QZ_DEF_PRIM(scm_vector_ref)
 {
-  return array_ref(st, args, "vi", vector_ref);
+  QZ_UNUSED(argc);
+  return array_ref(st, argv, vector_ref);
 }
 
 static void vector_set(qz_state_t* st, qz_cell_t* cell, size_t i, qz_obj_t obj)
 {
   qz_obj_t* slot = QZ_CELL_DATA(cell, qz_obj_t) + i;
   qz_unref(st, *slot);
-  *slot = obj;
+  *slot = qz_ref(st, obj);
 }
 
-QZ_DEF_CFUN(scm_vector_set_b)
+QZ_DEF_PRIM(scm_vector_set_b)
 {
-  return array_set(st, args, "via", vector_set);
+  QZ_UNUSED(argc);
+  return array_set(st, argv, vector_set);
 }
 
-QZ_DEF_CFUN(scm_vector_a_list)
+QZ_DEF_PRIM(scm_vector_a_list)
 {
-  qz_obj_t vec;
-  qz_get_args(st, &args, "v", &vec);
-
-  qz_cell_t* cell = qz_to_cell(vec);
-  if(cell->value.array.size == 0)
-    return QZ_NULL;
-
+  QZ_UNUSED(argc);
+  qz_cell_t* cell = qz_to_cell(argv[0]);
   qz_obj_t result = QZ_NULL;
-  qz_obj_t elem = QZ_NULL;
 
-  for(size_t i = 0; i < cell->value.array.size; i++)
-  {
-    qz_obj_t inner_elem = qz_make_pair(qz_ref(st, QZ_CELL_DATA(cell, qz_obj_t)[i]), QZ_NULL);
+  for(size_t i = cell->value.array.size; i > 0; i--)
+    result = qz_make_pair(st, qz_ref(st, QZ_CELL_DATA(cell, qz_obj_t)[i - 1]), result);
 
-    if(qz_is_null(elem)) {
-      result = elem = inner_elem;
-    }
-    else {
-      qz_to_pair(elem)->rest = inner_elem;
-      elem = inner_elem;
-    }
-  }
-
-  qz_unref(st, vec);
   return result;
 }
 
-QZ_DEF_CFUN(scm_list_a_vector)
+QZ_DEF_PRIM(scm_list_a_vector)
 {
-  qz_obj_t list;
-  qz_get_args(st, &args, "a", &list);
-
-  intptr_t len = list_length(list);
-
-  if(len < 0) {
-    qz_push_safety(st, list);
-    return qz_error(st, "expected list", &list, NULL);
-  }
+  QZ_UNUSED(argc);
+  intptr_t len = list_length(argv[0]);
+  if(len < 0)
+    return qz_error(st, "expected list", &argv[0], NULL);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_VECTOR, len*sizeof(qz_obj_t));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_VECTOR, len*sizeof(qz_obj_t));
+  cell->value.array.size = len;
+  cell->value.array.capacity = len;
 
-  qz_obj_t elem = list;
-  for(size_t i = 0; i < (uintptr_t)len; i++) {
+  qz_obj_t elem = argv[0];
+  for(intptr_t i = 0; i < len; i++) {
     QZ_CELL_DATA(cell, qz_obj_t)[i] = qz_ref(st, qz_first(elem));
     elem = qz_rest(elem);
   }
 
-  qz_unref(st, list);
-
   return qz_from_cell(cell);
 }
 
-QZ_DEF_CFUN(scm_vector_a_string)
+QZ_DEF_PRIM(scm_vector_a_string)
 {
-  qz_obj_t vec;
-  qz_get_args(st, &args, "v", &vec);
-
-  qz_cell_t* in = qz_to_cell(vec);
+  QZ_UNUSED(argc);
+  qz_cell_t* in = qz_to_cell(argv[0]);
   size_t len = in->value.array.size;
 
-  qz_cell_t* out = qz_make_cell(QZ_CT_STRING, len*sizeof(char));
-  out->value.array.size = len;
-  out->value.array.capacity = len;
-
   for(size_t i = 0; i < len; i++) {
     qz_obj_t ch = QZ_CELL_DATA(in, qz_obj_t)[i];
-    if(!qz_is_char(ch)) {
-      qz_push_safety(st, vec);
-      qz_unref(st, qz_from_cell(out));
+    if(!qz_is_char(ch))
       return qz_error(st, "expected char", &ch, NULL);
-    }
-    QZ_CELL_DATA(out, char)[i] = qz_to_char(ch);
   }
 
-  qz_unref(st, vec);
+  qz_cell_t* out = qz_make_cell(st, QZ_CT_STRING, len*sizeof(char));
+  out->value.array.size = len;
+  out->value.array.capacity = len;
+
+  for(size_t i = 0; i < len; i++)
+    QZ_CELL_DATA(out, char)[i] = qz_to_char(QZ_CELL_DATA(in, qz_obj_t)[i]);
+
   return qz_from_cell(out);
 }
 
-QZ_DEF_CFUN(scm_string_a_vector)
+QZ_DEF_PRIM(scm_string_a_vector)
 {
-  qz_obj_t str;
-  qz_get_args(st, &args, "s", &str);
-
-  qz_cell_t* in = qz_to_cell(str);
+  QZ_UNUSED(argc);
+  qz_cell_t* in = qz_to_cell(argv[0]);
   size_t len = in->value.array.size;
 
-  qz_cell_t* out = qz_make_cell(QZ_CT_VECTOR, len*sizeof(qz_obj_t));
+  qz_cell_t* out = qz_make_cell(st, QZ_CT_VECTOR, len*sizeof(qz_obj_t));
   out->value.array.size = len;
   out->value.array.capacity = len;
 
   for(size_t i = 0; i < len; i++)
     QZ_CELL_DATA(out, qz_obj_t)[i] = qz_from_char(QZ_CELL_DATA(in, char)[i]);
 
-  qz_unref(st, str);
   return qz_from_cell(out);
 }
 
-QZ_DEF_CFUN(scm_vector_copy)
+QZ_DEF_PRIM(scm_vector_copy)
 {
-  qz_obj_t vec, start, end, fill;
-  qz_get_args(st, &args, "vi?i?a?", &vec, &start, &end, &fill);
-
-  qz_cell_t* in = qz_to_cell(vec);
+  qz_cell_t* in = qz_to_cell(argv[0]);
   size_t in_len = in->value.array.size;
 
-  intptr_t start_raw = qz_is_none(start) ? 0 : qz_to_fixnum(start);
-  intptr_t end_raw = qz_is_none(end) ? (intptr_t)in_len : qz_to_fixnum(end);
+  intptr_t start_raw = argc > 1 ? qz_to_fixnum(argv[1]) : 0;
+  intptr_t end_raw = argc > 2 ? qz_to_fixnum(argv[2]) : (intptr_t)in_len;
 
-  if(start_raw > end_raw) {
-    qz_unref(st, vec);
-    return qz_error(st, "invalid range", &start, &end, NULL);
-  }
+  if(start_raw > end_raw)
+    return qz_error(st, "invalid range", &argv[1], &argv[2], NULL);
 
   size_t out_len = end_raw - start_raw;
-  qz_cell_t* out = qz_make_cell(QZ_CT_VECTOR, out_len*sizeof(qz_obj_t));
+  qz_cell_t* out = qz_make_cell(st, QZ_CT_VECTOR, out_len*sizeof(qz_obj_t));
   out->value.array.size = out_len;
   out->value.array.capacity = out_len;
 
+  /* elements past the end are the fill, if one was given */
+  qz_obj_t fill = argc > 3 ? argv[3] : QZ_NONE;
+
   for(size_t i = 0; i < out_len; i++)
   {
     /* signed plus unsigned equals unsigned, so if i + start_raw < 0, it will wrap */
     if(i + start_raw >= in_len) {
-      QZ_CELL_DATA(out, qz_obj_t)[i] = QZ_NONE;
+      QZ_CELL_DATA(out, qz_obj_t)[i] = qz_ref(st, fill);
     }
     else {
       QZ_CELL_DATA(out, qz_obj_t)[i] = qz_ref(st, QZ_CELL_DATA(in, qz_obj_t)[i + start_raw]);
     }
   }
 
-  qz_unref(st, vec);
   return qz_from_cell(out);
 }
 
@@ -2086,33 +1984,31 @@ QZ_DEF_CFUN(scm_vector_copy)
  * 6.9. Bytevectors
  ******************************************************************************/
 
-QZ_DEF_CFUN(scm_bytevector_q)
+QZ_DEF_PRIM(scm_bytevector_q)
 {
-  return predicate(st, args, qz_is_bytevector);
+  return prim_predicate(st, argc, argv, qz_is_bytevector);
 }
 
-QZ_DEF_CFUN(scm_make_bytevector)
+QZ_DEF_PRIM(scm_make_bytevector)
 {
-  qz_obj_t k, fill;
-  qz_get_args(st, &args, "ii?", &k, &fill);
-
-  intptr_t k_raw = qz_to_fixnum(k);
+  intptr_t k_raw = qz_to_fixnum(argv[0]);
   if(k_raw < 0)
-    return qz_error(st, "bad bytevector length", &k, NULL);
+    return qz_error(st, "bad bytevector length", &argv[0], NULL);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_BYTEVECTOR, k_raw*sizeof(uint8_t));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_BYTEVECTOR, k_raw*sizeof(uint8_t));
   cell->value.array.size = k_raw;
   cell->value.array.capacity = k_raw;
 
-  if(!qz_is_none(fill))
-    memset(QZ_CELL_DATA(cell, uint8_t), qz_to_fixnum(fill), k_raw*sizeof(uint8_t));
+  memset(QZ_CELL_DATA(cell, uint8_t), argc > 1 ? qz_to_fixnum(argv[1]) : 0, k_raw*sizeof(uint8_t));
 
   return qz_from_cell(cell);
 }
 
-QZ_DEF_CFUN(scm_bytevector_length)
+QZ_DEF_PRIM(scm_bytevector_length)
 {
-  return array_length(st, args, "w");
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return array_length(argv[0]);
 }
 
 static qz_obj_t bytevector_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
@@ -2121,9 +2017,10 @@ static qz_obj_t bytevector_ref(qz_state_t* st, qz_cell_t* cell, size_t i)
   return qz_from_fixnum(QZ_CELL_DATA(cell, uint8_t)[i]);
 }
 
-QZ_DEF_CFUN(scm_bytevector_u8_ref)
+QZ_DEF_PRIM(scm_bytevector_u8_ref)
 {
-  return array_ref(st, args, "wi", bytevector_ref);
+  QZ_UNUSED(argc);
+  return array_ref(st, argv, bytevector_ref);
 }
 
 static void bytevector_set(qz_state_t* st, qz_cell_t* cell, size_t i, qz_obj_t obj)
@@ -2132,9 +2029,10 @@ static void bytevector_set(qz_state_t* st, qz_cell_t* cell, size_t i, qz_obj_t o
   QZ_CELL_DATA(cell, uint8_t)[i] = qz_to_fixnum(obj);
 }
 
-QZ_DEF_CFUN(scm_bytevector_u8_set_b)
+QZ_DEF_PRIM(scm_bytevector_u8_set_b)
 {
-  return array_set(st, args, "wii", bytevector_set);
+  QZ_UNUSED(argc);
+  return array_set(st, argv, bytevector_set);
 }
 
 /* TODO bytevector-copy-partial */
@@ -2147,55 +2045,37 @@ QZ_DEF_CFUN(scm_bytevector_u8_set_b)
 
 static int is_procedure(qz_obj_t obj)
 {
-  return qz_is_cfun(obj) || qz_is_fun(obj);
+  return qz_is_cfun(obj) || qz_is_prim(obj) || qz_is_fun(obj);
 }
 
-QZ_DEF_CFUN(scm_procedure_q)
+QZ_DEF_PRIM(scm_procedure_q)
 {
-  return predicate(st, args, is_procedure);
+  return prim_predicate(st, argc, argv, is_procedure);
 }
 
-QZ_DEF_CFUN(scm_apply)
+/* the vm calls the procedure in place of apply instead, see quuz-vm.c */
+qz_obj_t qz_apply(qz_state_t* st, size_t argc, qz_obj_t* argv)
 {
-  qz_obj_t fun_call = QZ_NULL;
-  qz_obj_t elem;
+  qz_obj_t list = argv[argc - 1];
 
-  if(!qz_is_pair(args))
-    return qz_error(st, "expected pair", &args, NULL);
+  if(list_length(list) < 0)
+    return qz_error(st, "expected list", &list, NULL);
 
-  for(;;)
-  {
-    qz_obj_t arg = qz_first(args);
-    args = qz_rest(args);
+  qz_obj_t fun_call = qz_make_pair(st, qz_ref(st, argv[0]), QZ_NULL);
+  qz_obj_t* tail = &qz_to_pair(fun_call)->rest;
+  qz_push_safety(st, fun_call);
 
-    if(!qz_is_pair(args))
-    {
-      /* last argument, eval and append directly */
-      qz_push_safety(st, fun_call);
-      qz_obj_t inner_elem = qz_eval(st, arg);
-      qz_pop_safety(st, 1);
-      if(qz_is_null(fun_call)) {
-        fun_call = elem = inner_elem;
-      }
-      else {
-        qz_to_pair(elem)->rest = inner_elem;
-        elem = inner_elem;
-      }
-      break;
-    }
+  /* the list's elements follow the other arguments */
+  for(size_t i = 1; i < argc - 1; i++) {
+    *tail = qz_make_pair(st, quoted(st, argv[i]), QZ_NULL);
+    tail = &qz_to_pair(*tail)->rest;
+  }
 
-    /* not the last argument, just append to the list */
-    qz_obj_t inner_elem = qz_make_pair(qz_ref(st, arg), QZ_NULL);
-    if(qz_is_null(fun_call)) {
-      fun_call = elem = inner_elem;
-    }
-    else {
-      qz_to_pair(elem)->rest = inner_elem;
-      elem = inner_elem;
-    }
+  for(qz_obj_t elem = list; !qz_is_null(elem); elem = qz_rest(elem)) {
+    *tail = qz_make_pair(st, quoted(st, qz_first(elem)), QZ_NULL);
+    tail = &qz_to_pair(*tail)->rest;
   }
 
-  qz_push_safety(st, fun_call);
   qz_obj_t result = qz_eval(st, fun_call);
   qz_pop_safety(st, 1);
   qz_unref(st, fun_call);
@@ -2223,7 +2103,7 @@ QZ_DEF_CFUN(scm_with_exception_handler)
   qz_obj_t handler, thunk;
   qz_get_args(st, &args, "aa", &handler, &thunk);
 
-  thunk = qz_make_pair(thunk, QZ_NULL);
+  thunk = qz_make_pair(st, thunk, QZ_NULL);
 
   /* push error handler */
   qz_obj_t old_handler = st->error_handler;
@@ -2262,7 +2142,7 @@ QZ_DEF_CFUN(scm_error)
   qz_obj_t irritants = qz_eval_list(st, args);
   qz_pop_safety(st, 1);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_ERROR, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_ERROR, 0);
   cell->value.pair.first = message;
   cell->value.pair.rest = irritants;
 
@@ -2272,23 +2152,21 @@ QZ_DEF_CFUN(scm_error)
   return QZ_NONE;
 }
 
-QZ_DEF_CFUN(scm_error_object_q)
+QZ_DEF_PRIM(scm_error_object_q)
 {
-  return predicate(st, args, qz_is_error);
+  return prim_predicate(st, argc, argv, qz_is_error);
 }
 
-QZ_DEF_CFUN(scm_error_object_message)
+QZ_DEF_PRIM(scm_error_object_message)
 {
-  qz_obj_t obj;
-  qz_get_args(st, &args, "e", &obj);
-  return qz_ref(st, qz_first(obj));
+  QZ_UNUSED(argc);
+  return qz_ref(st, qz_first(argv[0]));
 }
 
-QZ_DEF_CFUN(scm_error_object_irritants)
+QZ_DEF_PRIM(scm_error_object_irritants)
 {
-  qz_obj_t obj;
-  qz_get_args(st, &args, "e", &obj);
-  return qz_ref(st, qz_rest(obj));
+  QZ_UNUSED(argc);
+  return qz_ref(st, qz_rest(argv[0]));
 }
 
 /******************************************************************************
@@ -2300,7 +2178,7 @@ QZ_DEF_CFUN(scm_error_object_irritants)
 QZ_DEF_CFUN(scm_eval)
 {
   qz_obj_t expr = qz_required_arg(st, &args);
-  return qz_eval(st, expr);
+  return qz_tail_eval(st, expr);
 }
 
 /******************************************************************************
@@ -2315,7 +2193,7 @@ static qz_obj_t make_port(qz_state_t* st, qz_obj_t str, const char* mode)
   if(!fp)
     return qz_error(st, strerror(errno), &str, NULL);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_PORT, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_PORT, 0);
   cell->value.port.fp = fp;
   cell->value.port.mode = mode;
 
@@ -2327,6 +2205,7 @@ static void close_port(qz_state_t* st, qz_obj_t obj)
   QZ_UNUSED(st);
   qz_port_t* port = qz_to_port(obj);
   if(port->fp) {
+    qz_forget_read_ahead(port->fp);
     fclose(port->fp);
     port->fp = NULL;
   }
@@ -2334,7 +2213,7 @@ static void close_port(qz_state_t* st, qz_obj_t obj)
 
 static qz_obj_t call_with_port(qz_state_t* st, qz_obj_t port, qz_obj_t proc)
 {
-  qz_obj_t fun_call = qz_make_pair(proc, qz_make_pair(port, QZ_NULL));
+  qz_obj_t fun_call = qz_make_pair(st, proc, qz_make_pair(st, port, QZ_NULL));
   qz_push_safety(st, fun_call);
 
   qz_obj_t result = qz_eval(st, fun_call);
@@ -2397,7 +2276,7 @@ static int is_output_port(qz_obj_t obj)
 
 static int is_textual_port(qz_obj_t obj)
 {
-  return !is_port_with_type(obj, 'b');
+  return qz_is_port(obj) && !is_port_with_type(obj, 'b');
 }
 
 static int is_binary_port(qz_obj_t obj)
@@ -2405,53 +2284,56 @@ static int is_binary_port(qz_obj_t obj)
   return is_port_with_type(obj, 'b');
 }
 
-QZ_DEF_CFUN(scm_input_port_q)
+QZ_DEF_PRIM(scm_input_port_q)
 {
-  return predicate(st, args, is_input_port);
+  return prim_predicate(st, argc, argv, is_input_port);
 }
 
-QZ_DEF_CFUN(scm_output_port_q)
+QZ_DEF_PRIM(scm_output_port_q)
 {
-  return predicate(st, args, is_output_port);
+  return prim_predicate(st, argc, argv, is_output_port);
 }
 
-QZ_DEF_CFUN(scm_textual_port_q)
+QZ_DEF_PRIM(scm_textual_port_q)
 {
-  return predicate(st, args, is_textual_port);
+  return prim_predicate(st, argc, argv, is_textual_port);
 }
 
-QZ_DEF_CFUN(scm_binary_port_q)
+QZ_DEF_PRIM(scm_binary_port_q)
 {
-  return predicate(st, args, is_binary_port);
+  return prim_predicate(st, argc, argv, is_binary_port);
 }
 
-QZ_DEF_CFUN(scm_port_q)
+QZ_DEF_PRIM(scm_port_q)
 {
-  return predicate(st, args, qz_is_port);
+  return prim_predicate(st, argc, argv, qz_is_port);
 }
 
-QZ_DEF_CFUN(scm_port_open_q)
+QZ_DEF_PRIM(scm_port_open_q)
 {
-  qz_obj_t obj;
-  qz_get_args(st, &args, "p", &obj);
-  return qz_from_bool(qz_to_port(obj)->fp != NULL);
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_from_bool(qz_to_port(argv[0])->fp != NULL);
 }
 
-QZ_DEF_CFUN(scm_current_input_port)
+QZ_DEF_PRIM(scm_current_input_port)
 {
-  QZ_UNUSED(args);
+  QZ_UNUSED(argc);
+  QZ_UNUSED(argv);
   return qz_ref(st, st->input_port);
 }
 
-QZ_DEF_CFUN(scm_current_output_port)
+QZ_DEF_PRIM(scm_current_output_port)
 {
-  QZ_UNUSED(args);
+  QZ_UNUSED(argc);
+  QZ_UNUSED(argv);
   return qz_ref(st, st->output_port);
 }
 
-QZ_DEF_CFUN(scm_current_error_port)
+QZ_DEF_PRIM(scm_current_error_port)
 {
-  QZ_UNUSED(args);
+  QZ_UNUSED(argc);
+  QZ_UNUSED(argv);
   return qz_ref(st, st->error_port);
 }
 
@@ -2460,7 +2342,7 @@ static qz_obj_t with_file(qz_state_t* st, qz_obj_t args, qz_obj_t* port_slot, co
   qz_obj_t str, thunk;
   qz_get_args(st, &args, "sa~", &str, &thunk);
 
-  qz_obj_t fun_call = qz_make_pair(thunk, QZ_NULL);
+  qz_obj_t fun_call = qz_make_pair(st, thunk, QZ_NULL);
   qz_push_safety(st, fun_call);
 
   qz_push_safety(st, str);
@@ -2573,14 +2455,15 @@ static qz_obj_t get_open_port(qz_state_t* st, qz_obj_t* args, qz_obj_t def)
   return port;
 }
 
-QZ_DEF_CFUN(scm_read)
+/* generic function for read and read-shared */
+static qz_obj_t read_port(qz_state_t* st, qz_obj_t args, qz_obj_t (*reader)(qz_state_t*, FILE*))
 {
   /* TODO read has global state, is this okay? */
 
   qz_obj_t port = get_open_port(st, &args, st->input_port);
   FILE* fp = qz_to_port(port)->fp;
 
-  qz_obj_t result = qz_read(st, fp);
+  qz_obj_t result = reader(st, fp);
   if(qz_is_none(result))
     return qz_error(st, "could not parse data from port", &port, NULL);
   /* TODO handle eof */
@@ -2588,6 +2471,17 @@ QZ_DEF_CFUN(scm_read)
   return result;
 }
 
+QZ_DEF_CFUN(scm_read)
+{
+  return read_port(st, args, qz_read);
+}
+
+/* like read, but data equal to data read before is the same, immutable, cells */
+QZ_DEF_CFUN(scm_read_shared)
+{
+  return read_port(st, args, qz_read_shared);
+}
+
 QZ_DEF_CFUN(scm_read_char)
 {
   qz_obj_t port = get_open_port(st, &args, st->input_port);
@@ -2619,12 +2513,12 @@ QZ_DEF_CFUN(scm_read_line)
       return qz_error(st, "fgets failed", &port, NULL);
     return QZ_EOF;
   }
-  return qz_make_string(line);
+  return qz_make_string(st, line);
 }
 
-QZ_DEF_CFUN(scm_eof_object_q)
+QZ_DEF_PRIM(scm_eof_object_q)
 {
-  return predicate(st, args, qz_is_eof);
+  return prim_predicate(st, argc, argv, qz_is_eof);
 }
 
 /* TODO char-ready? */
@@ -2658,7 +2552,7 @@ QZ_DEF_CFUN(scm_read_bytevector)
   if(length_raw < 0)
     return qz_error(st, "bad length", &length, NULL);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_BYTEVECTOR, length_raw*sizeof(uint8_t));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_BYTEVECTOR, length_raw*sizeof(uint8_t));
   qz_obj_t result = qz_from_cell(cell);
 
   size_t nread = fread(QZ_CELL_DATA(cell, uint8_t), sizeof(uint8_t), length_raw, fp);
@@ -2685,6 +2579,9 @@ QZ_DEF_CFUN(scm_read_bytevector_b)
   qz_get_args(st, &args, "wii", &bvec, &start, &end);
   qz_push_safety(st, bvec);
 
+  if(qz_immutable(qz_to_cell(bvec)))
+    return qz_error(st, "immutable object", &bvec, NULL);
+
   qz_obj_t port = get_open_port(st, &args, st->input_port);
 
   qz_cell_t* bvec_cell = qz_to_cell(bvec);
@@ -2747,7 +2644,7 @@ QZ_DEF_CFUN(scm_newline)
 QZ_DEF_CFUN(scm_write_char)
 {
   qz_obj_t ch;
-  qz_get_args(st, &args, "c");
+  qz_get_args(st, &args, "c", &ch);
   qz_obj_t port = get_open_port(st, &args, st->output_port);
 
   FILE* fp = qz_to_port(port)->fp;
@@ -2794,6 +2691,9 @@ QZ_DEF_CFUN(scm_write_partial_bytevector)
   qz_obj_t bvec, start, end;
   qz_get_args(st, &args, "wii", &bvec, &start, &end);
   qz_push_safety(st, bvec);
+
+  if(qz_immutable(qz_to_cell(bvec)))
+    return qz_error(st, "immutable object", &bvec, NULL);
   qz_obj_t port = get_open_port(st, &args, st->output_port);
 
   qz_cell_t* cell = qz_to_cell(bvec);
@@ -2865,10 +2765,10 @@ QZ_DEF_CFUN(scm_command_line)
   QZ_UNUSED(st);
   QZ_UNUSED(args);
   qz_obj_t result = QZ_NULL;
-  qz_obj_t elem;
+  qz_obj_t elem = QZ_NULL;
 
   for(int i = 0; i < g_argc; i++) {
-    qz_obj_t inner_elem = qz_make_pair(qz_make_string(g_argv[i]), QZ_NULL);
+    qz_obj_t inner_elem = qz_make_pair(st, qz_make_string(st, g_argv[i]), QZ_NULL);
     if(qz_is_null(result)) {
       result = elem = inner_elem;
     }
@@ -2915,7 +2815,7 @@ QZ_DEF_CFUN(scm_get_environment_variable)
   if(!value)
     return QZ_FALSE;
 
-  return qz_make_string(value);
+  return qz_make_string(st, value);
 }
 
 extern char** environ;
@@ -2925,17 +2825,17 @@ QZ_DEF_CFUN(scm_get_environment_variables)
   QZ_UNUSED(st);
   QZ_UNUSED(args);
   qz_obj_t result = QZ_NULL;
-  qz_obj_t elem;
+  qz_obj_t elem = QZ_NULL;
 
   for(char** e = environ; *e; e++) {
     char* sep = strchr(*e, '=');
     if(!sep)
       continue;
 
-    qz_obj_t key = qz_make_string_with_size(*e, sep - *e);
-    qz_obj_t value = qz_make_string_with_size(sep + 1, strlen(sep + 1));
+    qz_obj_t key = qz_make_string_with_size(st, *e, sep - *e);
+    qz_obj_t value = qz_make_string_with_size(st, sep + 1, strlen(sep + 1));
 
-    qz_obj_t inner_elem = qz_make_pair(qz_make_pair(key, value), QZ_NULL);
+    qz_obj_t inner_elem = qz_make_pair(st, qz_make_pair(st, key, value), QZ_NULL);
     if(qz_is_null(result)) {
       result = elem = inner_elem;
     }
@@ -2955,6 +2855,344 @@ QZ_DEF_CFUN(scm_current_second)
   return qz_from_fixnum(time(NULL));
 }
 
+/******************************************************************************
+ * SRFI 69. Basic hash tables
+ ******************************************************************************/
+
+/* the hash kind matching an equivalence procedure
+ * eq? and eqv? are the same here, as are equal? and string=? */
+static int equivalence_kind(qz_obj_t proc, qz_hash_kind_t* kind)
+{
+  if(qz_is_none(proc)) {
+    *kind = QZ_HASH_EQUAL;
+    return 1;
+  }
+
+  if(!qz_is_prim(proc))
+    return 0;
+
+  qz_prim_fun_t fun = qz_to_prim(proc)->fun;
+
+  if(fun == scm_eq_q || fun == scm_eqv_q) {
+    *kind = QZ_HASH_EQV;
+    return 1;
+  }
+
+  if(fun == scm_equal_q || fun == scm_string_eq_q) {
+    *kind = QZ_HASH_EQUAL;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* the hash function argument is accepted but unused, the kind decides how keys hash */
+static qz_obj_t make_table(qz_state_t* st, size_t argc, qz_obj_t* argv, qz_weak_t weak)
+{
+  qz_hash_kind_t kind;
+
+  if(!equivalence_kind(argc > 0 ? argv[0] : QZ_NONE, &kind))
+    return qz_error(st, "unsupported equivalence procedure", &argv[0], NULL);
+
+  return qz_make_weak_table(st, kind, weak);
+}
+
+QZ_DEF_PRIM(scm_make_hash_table)
+{
+  return make_table(st, argc, argv, QZ_WEAK_NONE);
+}
+
+/* not in SRFI 69, tables whose entries go once their key or value is freed */
+QZ_DEF_PRIM(scm_make_weak_key_hash_table)
+{
+  return make_table(st, argc, argv, QZ_WEAK_KEYS);
+}
+
+QZ_DEF_PRIM(scm_make_weak_value_hash_table)
+{
+  return make_table(st, argc, argv, QZ_WEAK_VALUES);
+}
+
+QZ_DEF_PRIM(scm_hash_table_q)
+{
+  return prim_predicate(st, argc, argv, qz_is_table);
+}
+
+QZ_DEF_PRIM(scm_hash_table_ref)
+{
+  qz_obj_t* value = qz_table_get(st, argv[0], argv[1]);
+
+  if(value) {
+    if(argc > 3)
+      return call_proc(st, argv[3], 1, value);
+    return qz_ref(st, *value);
+  }
+
+  if(argc > 2)
+    return call_proc(st, argv[2], 0, NULL);
+
+  return qz_error(st, "key not found", &argv[1], NULL);
+}
+
+QZ_DEF_PRIM(scm_hash_table_ref_default)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t* value = qz_table_get(st, argv[0], argv[1]);
+  return qz_ref(st, value ? *value : argv[2]);
+}
+
+QZ_DEF_PRIM(scm_hash_table_set_b)
+{
+  QZ_UNUSED(argc);
+  qz_table_set(st, argv[0], qz_ref(st, argv[1]), qz_ref(st, argv[2]));
+  return QZ_NONE;
+}
+
+QZ_DEF_PRIM(scm_hash_table_delete_b)
+{
+  QZ_UNUSED(argc);
+  qz_table_delete(st, argv[0], argv[1]);
+  return QZ_NONE;
+}
+
+QZ_DEF_PRIM(scm_hash_table_contains_q)
+{
+  QZ_UNUSED(argc);
+  return qz_table_get(st, argv[0], argv[1]) ? QZ_TRUE : QZ_FALSE;
+}
+
+/* set key to the result of calling proc on its value, or on the default if it's missing */
+static qz_obj_t update_table(qz_state_t* st, qz_obj_t* argv, qz_obj_t value)
+{
+  qz_push_safety(st, value);
+  qz_obj_t new_value = call_proc(st, argv[2], 1, &value);
+  qz_pop_safety(st, 1);
+  qz_unref(st, value);
+
+  qz_table_set(st, argv[0], qz_ref(st, argv[1]), new_value);
+  return QZ_NONE;
+}
+
+QZ_DEF_PRIM(scm_hash_table_update_b)
+{
+  qz_obj_t* value = qz_table_get(st, argv[0], argv[1]);
+
+  if(value)
+    return update_table(st, argv, qz_ref(st, *value));
+
+  if(argc > 3)
+    return update_table(st, argv, call_proc(st, argv[3], 0, NULL));
+
+  return qz_error(st, "key not found", &argv[1], NULL);
+}
+
+QZ_DEF_PRIM(scm_hash_table_update_b_default)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t* value = qz_table_get(st, argv[0], argv[1]);
+  return update_table(st, argv, qz_ref(st, value ? *value : argv[3]));
+}
+
+QZ_DEF_PRIM(scm_hash_table_count)
+{
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  qz_cell_t* hash = qz_to_cell(qz_to_cell(argv[0])->value.pair.rest);
+  return qz_from_fixnum(hash->value.array.size);
+}
+
+/* the table's hash is fetched again after each call, proc may have changed it
+ * entries added or removed by proc may or may not be seen */
+QZ_DEF_PRIM(scm_hash_table_walk)
+{
+  QZ_UNUSED(argc);
+  size_t iter = 0;
+  qz_hash_slot_t* slot;
+
+  while((slot = qz_hash_next(qz_to_cell(argv[0])->value.pair.rest, &iter))) {
+    qz_obj_t entry[2] = { slot->key, slot->value };
+    qz_unref(st, call_proc(st, argv[1], 2, entry));
+  }
+
+  return QZ_NONE;
+}
+
+QZ_DEF_PRIM(scm_hash_table_fold)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t acc = qz_ref(st, argv[2]);
+  size_t iter = 0;
+  qz_hash_slot_t* slot;
+
+  while((slot = qz_hash_next(qz_to_cell(argv[0])->value.pair.rest, &iter))) {
+    qz_obj_t entry[3] = { slot->key, slot->value, acc };
+    qz_push_safety(st, acc);
+    qz_obj_t new_acc = call_proc(st, argv[1], 3, entry);
+    qz_pop_safety(st, 1);
+    qz_unref(st, acc);
+    acc = new_acc;
+  }
+
+  return acc;
+}
+
+/* build a list of the keys, values or both of a table */
+static qz_obj_t table_list(qz_state_t* st, qz_obj_t table, int keys, int values)
+{
+  qz_obj_t result = QZ_NULL;
+  size_t iter = 0;
+  qz_hash_slot_t* slot;
+
+  while((slot = qz_hash_next(qz_to_cell(table)->value.pair.rest, &iter))) {
+    qz_obj_t elem;
+    if(keys && values)
+      elem = qz_make_pair(st, qz_ref(st, slot->key), qz_ref(st, slot->value));
+    else
+      elem = qz_ref(st, keys ? slot->key : slot->value);
+    result = qz_make_pair(st, elem, result);
+  }
+
+  return result;
+}
+
+QZ_DEF_PRIM(scm_hash_table_keys)
+{
+  QZ_UNUSED(argc);
+  return table_list(st, argv[0], 1, 0);
+}
+
+QZ_DEF_PRIM(scm_hash_table_values)
+{
+  QZ_UNUSED(argc);
+  return table_list(st, argv[0], 0, 1);
+}
+
+QZ_DEF_PRIM(scm_hash_table_a_alist)
+{
+  QZ_UNUSED(argc);
+  return table_list(st, argv[0], 1, 1);
+}
+
+/******************************************************************************
+ * Persistent hash maps
+ * like SRFI 69 hash tables compared with equal?, but never changed
+ * hash-map-set and hash-map-delete return a new map sharing most of the old one
+ ******************************************************************************/
+
+QZ_DEF_PRIM(scm_make_hash_map)
+{
+  QZ_UNUSED(argc);
+  QZ_UNUSED(argv);
+  return qz_make_hamt(st);
+}
+
+QZ_DEF_PRIM(scm_hash_map_q)
+{
+  return prim_predicate(st, argc, argv, qz_is_hamt);
+}
+
+QZ_DEF_PRIM(scm_hash_map_ref)
+{
+  qz_obj_t* value = qz_hamt_get(argv[0], argv[1]);
+
+  if(value)
+    return qz_ref(st, *value);
+
+  if(argc > 2)
+    return call_proc(st, argv[2], 0, NULL);
+
+  return qz_error(st, "key not found", &argv[1], NULL);
+}
+
+QZ_DEF_PRIM(scm_hash_map_ref_default)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t* value = qz_hamt_get(argv[0], argv[1]);
+  return qz_ref(st, value ? *value : argv[2]);
+}
+
+QZ_DEF_PRIM(scm_hash_map_set)
+{
+  QZ_UNUSED(argc);
+  return qz_hamt_set(st, argv[0], qz_ref(st, argv[1]), qz_ref(st, argv[2]));
+}
+
+QZ_DEF_PRIM(scm_hash_map_delete)
+{
+  QZ_UNUSED(argc);
+  return qz_hamt_delete(st, argv[0], argv[1]);
+}
+
+QZ_DEF_PRIM(scm_hash_map_contains_q)
+{
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_hamt_get(argv[0], argv[1]) ? QZ_TRUE : QZ_FALSE;
+}
+
+QZ_DEF_PRIM(scm_hash_map_count)
+{
+  QZ_UNUSED(st);
+  QZ_UNUSED(argc);
+  return qz_from_fixnum(qz_to_cell(argv[0])->value.hamt.size);
+}
+
+QZ_DEF_PRIM(scm_hash_map_fold)
+{
+  QZ_UNUSED(argc);
+  qz_obj_t acc = qz_ref(st, argv[2]);
+  size_t iter = 0;
+  qz_hamt_entry_t* entry;
+
+  while((entry = qz_hamt_next(argv[0], &iter))) {
+    qz_obj_t args[3] = { entry->key, entry->value, acc };
+    qz_push_safety(st, acc);
+    qz_obj_t new_acc = call_proc(st, argv[1], 3, args);
+    qz_pop_safety(st, 1);
+    qz_unref(st, acc);
+    acc = new_acc;
+  }
+
+  return acc;
+}
+
+/* build a list of the keys, values or both of a map */
+static qz_obj_t hamt_list(qz_state_t* st, qz_obj_t hamt, int keys, int values)
+{
+  qz_obj_t result = QZ_NULL;
+  size_t iter = 0;
+  qz_hamt_entry_t* entry;
+
+  while((entry = qz_hamt_next(hamt, &iter))) {
+    qz_obj_t elem;
+    if(keys && values)
+      elem = qz_make_pair(st, qz_ref(st, entry->key), qz_ref(st, entry->value));
+    else
+      elem = qz_ref(st, keys ? entry->key : entry->value);
+    result = qz_make_pair(st, elem, result);
+  }
+
+  return result;
+}
+
+QZ_DEF_PRIM(scm_hash_map_keys)
+{
+  QZ_UNUSED(argc);
+  return hamt_list(st, argv[0], 1, 0);
+}
+
+QZ_DEF_PRIM(scm_hash_map_values)
+{
+  QZ_UNUSED(argc);
+  return hamt_list(st, argv[0], 0, 1);
+}
+
+QZ_DEF_PRIM(scm_hash_map_a_alist)
+{
+  QZ_UNUSED(argc);
+  return hamt_list(st, argv[0], 1, 1);
+}
+
 const qz_named_cfun_t QZ_LIB_FUNCTIONS[] = {
   {scm_quote, "quote"},
   {scm_lambda, "lambda"},
@@ -2977,120 +3215,13 @@ const qz_named_cfun_t QZ_LIB_FUNCTIONS[] = {
   {scm_unquote, "unquote"},
   {scm_define, "define"},
   {scm_define_record_type, "define-record-type"},
-  {scm_eq_q, "eq?"},
-  {scm_eqv_q, "eqv?"},
-  {scm_equal_q, "equal?"},
-  {scm_num_eq, "="},
-  {scm_num_lt, "<"},
-  {scm_num_gt, ">"},
-  {scm_num_lte, "<="},
-  {scm_num_gte, ">="},
-  {scm_num_add, "+"},
-  {scm_num_mul, "*"},
-  {scm_num_sub, "-"},
-  {scm_not, "not"},
-  {scm_boolean_q, "boolean?"},
-  {scm_pair_q, "pair?"},
-  {scm_cons, "cons"},
-  {scm_car, "car"},
-  {scm_cdr, "cdr"},
-  {scm_set_car_b, "set-car!"},
-  {scm_set_cdr_b, "set-cdr!"},
-  {scm_null_q, "null?"},
-  {scm_list_q, "list?"},
-  {scm_make_list, "make-list"},
-  {scm_list, "list"},
-  {scm_length, "length"},
-  {scm_reverse, "reverse"},
-  {scm_list_tail, "list-tail"},
-  {scm_list_ref, "list-ref"},
-  {scm_list_set_b, "list-set!"},
-  {scm_memq, "memq"},
-  {scm_memv, "memv"},
-  {scm_member, "member"},
-  {scm_assq, "assq"},
-  {scm_assv, "assv"},
-  {scm_assoc, "assoc"},
-  {scm_list_copy, "list-copy"},
-  {scm_symbol_q, "symbol?"},
-  {scm_symbol_a_string, "symbol->string"},
-  {scm_string_a_symbol, "string->symbol"},
-  {scm_char_q, "char?"},
-  {scm_char_eq_q, "char=?"},
-  {scm_char_lt_q, "char<?"},
-  {scm_char_gt_q, "char>?"},
-  {scm_char_lte_q, "char<=?"},
-  {scm_char_gte_q, "char>=?"},
-  {scm_char_ci_eq_q, "char-ci=?"},
-  {scm_char_ci_lt_q, "char-ci<?"},
-  {scm_char_ci_gt_q, "char-ci>?"},
-  {scm_char_ci_lte_q, "char-ci<=?"},
-  {scm_char_ci_gte_q, "char-ci>=?"},
-  {scm_char_alphabetic_q, "char-alphabetic?"},
-  {scm_char_numeric_q, "char-numeric?"},
-  {scm_char_whitespace_q, "char-whitespace?"},
-  {scm_char_upper_case_q, "char-upper-case?"},
-  {scm_char_lower_case_q, "char-lower-case?"},
-  {scm_digit_value, "digit-value"},
-  {scm_char_a_integer, "char->integer"},
-  {scm_integer_a_char, "integer->char"},
-  {scm_string_q, "string?"},
-  {scm_make_string, "make-string"},
-  {scm_string_length, "string-length"},
-  {scm_string_ref, "string-ref"},
-  {scm_string_set_b, "string-set!"},
-  {scm_string_eq_q, "string=?"},
-  {scm_string_ci_eq_q, "string-ci=?"},
-  {scm_string_lt_q, "string<?"},
-  {scm_string_ci_lt_q, "string-ci<?"},
-  {scm_string_gt_q, "string>?"},
-  {scm_string_ci_gt_q, "string-ci>?"},
-  {scm_string_lte_q, "string<=?"},
-  {scm_string_ci_lte_q, "string-ci<=?"},
-  {scm_string_gte_q, "string>=?"},
-  {scm_string_ci_gte_q, "string-ci>=?"},
-  {scm_string_upcase, "string-upcase"},
-  {scm_string_downcase, "string-downcase"},
-  {scm_substring, "substring"},
-  {scm_string_a_list, "string->list"},
-  {scm_list_a_string, "list->string"},
-  {scm_string_copy, "string-copy"},
-  {scm_vector_q, "vector?"},
-  {scm_make_vector, "make-vector"},
-  {scm_vector_length, "vector-length"},
-  {scm_vector_ref, "vector-ref"},
-  {scm_vector_set_b, "vector-set!"},
-  {scm_vector_a_list, "vector->list"},
-  {scm_list_a_vector, "list->vector"},
-  {scm_vector_a_string, "vector->string"},
-  {scm_string_a_vector, "string->vector"},
-  {scm_vector_copy, "vector-copy"},
-  {scm_bytevector_q, "bytevector?"},
-  {scm_make_bytevector, "make-bytevector"},
-  {scm_bytevector_length, "bytevector-length"},
-  {scm_bytevector_u8_ref, "bytevector-u8-ref"},
-  {scm_bytevector_u8_set_b, "bytevector-u8-set!"},
-  {scm_procedure_q, "procedure?"},
-  {scm_apply, "apply"},
   {scm_with_exception_handler, "with-exception-handler"},
   {scm_raise, "raise"},
   {scm_error, "error"},
-  {scm_error_object_q, "error-object?"},
-  {scm_error_object_message, "error-object-message"},
-  {scm_error_object_irritants, "error-object-irritants"},
   {scm_eval, "eval"},
   {scm_call_with_input_file, "call-with-input-file"},
   {scm_call_with_output_file, "call-with-output-file"},
   {scm_call_with_port, "call-with-port"},
-  {scm_input_port_q, "input-port?"},
-  {scm_output_port_q, "output-port?"},
-  {scm_textual_port_q, "textual-port?"},
-  {scm_binary_port_q, "binary-port?"},
-  {scm_port_q, "port?"},
-  {scm_port_open_q, "port-open?"},
-  {scm_current_input_port, "current-input-port"},
-  {scm_current_output_port, "current-output-port"},
-  {scm_current_error_port, "current-error-port"},
   {scm_with_input_from_file, "with-input-from-file"},
   {scm_with_output_to_file, "with-output-to-file"},
   {scm_open_input_file, "open-input-file"},
@@ -3101,10 +3232,10 @@ const qz_named_cfun_t QZ_LIB_FUNCTIONS[] = {
   {scm_close_input_port, "close-input-port"},
   {scm_close_output_port, "close-output-port"},
   {scm_read, "read"},
+  {scm_read_shared, "read-shared"},
   {scm_read_char, "read-char"},
   {scm_peek_char, "peek-char"},
   {scm_read_line, "read-line"},
-  {scm_eof_object_q, "eof-object?"},
   {scm_read_u8, "read-u8"},
   {scm_read_bytevector, "read-bytevector"},
   {scm_read_bytevector_b, "read-bytevector!"},
@@ -3125,3 +3256,146 @@ const qz_named_cfun_t QZ_LIB_FUNCTIONS[] = {
   {scm_current_second, "current-second"},
   {NULL, NULL}
 };
+
+const qz_prim_t QZ_LIB_PRIMS[] = {
+  {scm_eq_q, "eq?", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_eqv_q, "eqv?", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_equal_q, "equal?", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_num_eq, "=", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_lt, "<", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_gt, ">", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_lte, "<=", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_gte, ">=", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_add, "+", 0, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_mul, "*", 0, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_num_sub, "-", 1, SIZE_MAX, {QZ_T_FIXNUM}},
+  {scm_not, "not", 1, 1, {QZ_T_ANY}},
+  {scm_boolean_q, "boolean?", 1, 1, {QZ_T_ANY}},
+  {scm_pair_q, "pair?", 1, 1, {QZ_T_ANY}},
+  {scm_cons, "cons", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_car, "car", 1, 1, {QZ_T_PAIR}},
+  {scm_cdr, "cdr", 1, 1, {QZ_T_PAIR}},
+  {scm_set_car_b, "set-car!", 2, 2, {QZ_T_PAIR, QZ_T_ANY}},
+  {scm_set_cdr_b, "set-cdr!", 2, 2, {QZ_T_PAIR, QZ_T_ANY}},
+  {scm_null_q, "null?", 1, 1, {QZ_T_ANY}},
+  {scm_list_q, "list?", 1, 1, {QZ_T_ANY}},
+  {scm_list, "list", 0, SIZE_MAX, {QZ_T_ANY}},
+  {scm_length, "length", 1, 1, {QZ_T_ANY}},
+  {scm_make_list, "make-list", 1, 2, {QZ_T_FIXNUM, QZ_T_ANY}},
+  {scm_reverse, "reverse", 1, 1, {QZ_T_ANY}},
+  {scm_list_tail, "list-tail", 2, 2, {QZ_T_ANY, QZ_T_FIXNUM}},
+  {scm_list_ref, "list-ref", 2, 2, {QZ_T_ANY, QZ_T_FIXNUM}},
+  {scm_list_set_b, "list-set!", 3, 3, {QZ_T_ANY, QZ_T_FIXNUM, QZ_T_ANY}},
+  {scm_memq, "memq", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_memv, "memv", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_member, "member", 2, 3, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_assq, "assq", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_assv, "assv", 2, 2, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_assoc, "assoc", 2, 3, {QZ_T_ANY, QZ_T_ANY}},
+  {scm_list_copy, "list-copy", 1, 1, {QZ_T_ANY}},
+  {scm_symbol_q, "symbol?", 1, 1, {QZ_T_ANY}},
+  {scm_symbol_a_string, "symbol->string", 1, 1, {QZ_T_SYM}},
+  {scm_string_a_symbol, "string->symbol", 1, 1, {QZ_T_STRING}},
+  {scm_char_q, "char?", 1, 1, {QZ_T_ANY}},
+  {scm_char_eq_q, "char=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_lt_q, "char<?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_gt_q, "char>?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_lte_q, "char<=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_gte_q, "char>=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_ci_eq_q, "char-ci=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_ci_lt_q, "char-ci<?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_ci_gt_q, "char-ci>?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_ci_lte_q, "char-ci<=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_ci_gte_q, "char-ci>=?", 1, SIZE_MAX, {QZ_T_CHAR}},
+  {scm_char_alphabetic_q, "char-alphabetic?", 1, 1, {QZ_T_ANY}},
+  {scm_char_numeric_q, "char-numeric?", 1, 1, {QZ_T_ANY}},
+  {scm_char_whitespace_q, "char-whitespace?", 1, 1, {QZ_T_ANY}},
+  {scm_char_upper_case_q, "char-upper-case?", 1, 1, {QZ_T_ANY}},
+  {scm_char_lower_case_q, "char-lower-case?", 1, 1, {QZ_T_ANY}},
+  {scm_digit_value, "digit-value", 1, 1, {QZ_T_ANY}},
+  {scm_char_a_integer, "char->integer", 1, 1, {QZ_T_CHAR}},
+  {scm_integer_a_char, "integer->char", 1, 1, {QZ_T_FIXNUM}},
+  {scm_string_q, "string?", 1, 1, {QZ_T_ANY}},
+  {scm_string_length, "string-length", 1, 1, {QZ_T_STRING}},
+  {scm_string_ref, "string-ref", 2, 2, {QZ_T_STRING, QZ_T_FIXNUM}},
+  {scm_string_set_b, "string-set!", 3, 3, {QZ_T_STRING, QZ_T_FIXNUM, QZ_T_CHAR}},
+  {scm_string_eq_q, "string=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_ci_eq_q, "string-ci=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_lt_q, "string<?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_ci_lt_q, "string-ci<?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_gt_q, "string>?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_ci_gt_q, "string-ci>?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_lte_q, "string<=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_ci_lte_q, "string-ci<=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_gte_q, "string>=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_string_ci_gte_q, "string-ci>=?", 1, SIZE_MAX, {QZ_T_STRING}},
+  {scm_make_string, "make-string", 1, 2, {QZ_T_FIXNUM, QZ_T_CHAR}},
+  {scm_string_upcase, "string-upcase", 1, 1, {QZ_T_STRING}},
+  {scm_string_downcase, "string-downcase", 1, 1, {QZ_T_STRING}},
+  {scm_substring, "substring", 3, 3, {QZ_T_STRING, QZ_T_FIXNUM, QZ_T_FIXNUM}},
+  {scm_string_a_list, "string->list", 1, 1, {QZ_T_STRING}},
+  {scm_list_a_string, "list->string", 1, 1, {QZ_T_ANY}},
+  {scm_string_copy, "string-copy", 1, 1, {QZ_T_STRING}},
+  {scm_vector_q, "vector?", 1, 1, {QZ_T_ANY}},
+  {scm_vector_length, "vector-length", 1, 1, {QZ_T_VECTOR}},
+  {scm_vector_ref, "vector-ref", 2, 2, {QZ_T_VECTOR, QZ_T_FIXNUM}},
+  {scm_vector_set_b, "vector-set!", 3, 3, {QZ_T_VECTOR, QZ_T_FIXNUM, QZ_T_ANY}},
+  {scm_make_vector, "make-vector", 1, 2, {QZ_T_FIXNUM, QZ_T_ANY}},
+  {scm_vector_a_list, "vector->list", 1, 1, {QZ_T_VECTOR}},
+  {scm_list_a_vector, "list->vector", 1, 1, {QZ_T_ANY}},
+  {scm_vector_a_string, "vector->string", 1, 1, {QZ_T_VECTOR}},
+  {scm_string_a_vector, "string->vector", 1, 1, {QZ_T_STRING}},
+  {scm_vector_copy, "vector-copy", 1, 4, {QZ_T_VECTOR, QZ_T_FIXNUM, QZ_T_FIXNUM, QZ_T_ANY}},
+  {scm_bytevector_q, "bytevector?", 1, 1, {QZ_T_ANY}},
+  {scm_bytevector_length, "bytevector-length", 1, 1, {QZ_T_BYTEVECTOR}},
+  {scm_bytevector_u8_ref, "bytevector-u8-ref", 2, 2, {QZ_T_BYTEVECTOR, QZ_T_FIXNUM}},
+  {scm_bytevector_u8_set_b, "bytevector-u8-set!", 3, 3, {QZ_T_BYTEVECTOR, QZ_T_FIXNUM, QZ_T_FIXNUM}},
+  {scm_make_bytevector, "make-bytevector", 1, 2, {QZ_T_FIXNUM, QZ_T_FIXNUM}},
+  {scm_procedure_q, "procedure?", 1, 1, {QZ_T_ANY}},
+  {qz_apply, "apply", 2, SIZE_MAX, {QZ_T_ANY}},
+  {scm_error_object_q, "error-object?", 1, 1, {QZ_T_ANY}},
+  {scm_error_object_message, "error-object-message", 1, 1, {QZ_T_ERROR}},
+  {scm_error_object_irritants, "error-object-irritants", 1, 1, {QZ_T_ERROR}},
+  {scm_input_port_q, "input-port?", 1, 1, {QZ_T_ANY}},
+  {scm_output_port_q, "output-port?", 1, 1, {QZ_T_ANY}},
+  {scm_textual_port_q, "textual-port?", 1, 1, {QZ_T_ANY}},
+  {scm_binary_port_q, "binary-port?", 1, 1, {QZ_T_ANY}},
+  {scm_port_q, "port?", 1, 1, {QZ_T_ANY}},
+  {scm_port_open_q, "port-open?", 1, 1, {QZ_T_PORT}},
+  {scm_current_input_port, "current-input-port", 0, 0, {QZ_T_ANY}},
+  {scm_current_output_port, "current-output-port", 0, 0, {QZ_T_ANY}},
+  {scm_current_error_port, "current-error-port", 0, 0, {QZ_T_ANY}},
+  {scm_eof_object_q, "eof-object?", 1, 1, {QZ_T_ANY}},
+  {scm_make_hash_table, "make-hash-table", 0, 2, {QZ_T_ANY}},
+  {scm_make_weak_key_hash_table, "make-weak-key-hash-table", 0, 2, {QZ_T_ANY}},
+  {scm_make_weak_value_hash_table, "make-weak-value-hash-table", 0, 2, {QZ_T_ANY}},
+  {scm_hash_table_q, "hash-table?", 1, 1, {QZ_T_ANY}},
+  {scm_hash_table_ref, "hash-table-ref", 2, 4, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_ref_default, "hash-table-ref/default", 3, 3, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_set_b, "hash-table-set!", 3, 3, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_delete_b, "hash-table-delete!", 2, 2, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_contains_q, "hash-table-contains?", 2, 2, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_contains_q, "hash-table-exists?", 2, 2, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_update_b, "hash-table-update!", 3, 4, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_update_b_default, "hash-table-update!/default", 4, 4, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_count, "hash-table-count", 1, 1, {QZ_T_TABLE}},
+  {scm_hash_table_count, "hash-table-size", 1, 1, {QZ_T_TABLE}},
+  {scm_hash_table_walk, "hash-table-walk", 2, 2, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_fold, "hash-table-fold", 3, 3, {QZ_T_TABLE, QZ_T_ANY}},
+  {scm_hash_table_keys, "hash-table-keys", 1, 1, {QZ_T_TABLE}},
+  {scm_hash_table_values, "hash-table-values", 1, 1, {QZ_T_TABLE}},
+  {scm_hash_table_a_alist, "hash-table->alist", 1, 1, {QZ_T_TABLE}},
+  {scm_make_hash_map, "make-hash-map", 0, 0, {QZ_T_ANY}},
+  {scm_hash_map_q, "hash-map?", 1, 1, {QZ_T_ANY}},
+  {scm_hash_map_ref, "hash-map-ref", 2, 3, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_ref_default, "hash-map-ref/default", 3, 3, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_set, "hash-map-set", 3, 3, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_delete, "hash-map-delete", 2, 2, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_contains_q, "hash-map-contains?", 2, 2, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_count, "hash-map-count", 1, 1, {QZ_T_HAMT}},
+  {scm_hash_map_fold, "hash-map-fold", 3, 3, {QZ_T_HAMT, QZ_T_ANY}},
+  {scm_hash_map_keys, "hash-map-keys", 1, 1, {QZ_T_HAMT}},
+  {scm_hash_map_values, "hash-map-values", 1, 1, {QZ_T_HAMT}},
+  {scm_hash_map_a_alist, "hash-map->alist", 1, 1, {QZ_T_HAMT}},
+  {NULL, NULL, 0, 0, {0}}
+};
@@ -11,10 +11,12 @@ int main(int argc, char* argv[])
   FILE* fp = stdin;
   enum { PARSE, RUN, EVAL } mode = RUN;
   int debug = 0;
+  int incremental = 0;
+  qz_engine_t engine = QZ_ENGINE_TREE;
 
   /* parse options */
   int c;
-  while((c = getopt(argc, argv, "pred")) != -1) {
+  while((c = getopt(argc, argv, "predbi")) != -1) {
     switch(c) {
       case 'p':
         mode = PARSE;
@@ -28,6 +30,12 @@ int main(int argc, char* argv[])
       case 'd':
         debug = 1;
         break;
+      case 'b':
+        engine = QZ_ENGINE_VM;
+        break;
+      case 'i':
+        incremental = 1;
+        break;
     }
   }
 
@@ -45,6 +53,9 @@ int main(int argc, char* argv[])
   }
 
   qz_state_t* st = qz_alloc();
+  st->engine = engine;
+  if(incremental)
+    qz_set_collect_budget(st, QZ_COLLECT_BUDGET);
   int ret = EXIT_SUCCESS;
 
   while(!feof(fp)) {
@@ -82,17 +93,24 @@ int main(int argc, char* argv[])
   if(debug) {
     qz_printf(st, st->error_port, "st->env = %w\n", st->env);
     qz_printf(st, st->error_port, "st->name_sym = %w\n", st->name_sym);
-    qz_printf(st, st->error_port, "st->sym_name = %w\n", st->sym_name);
 
     fputs("st->root_buffer = \n", stderr);
     for(size_t i = 0; i < st->root_buffer_size; i++)
       fprintf(stderr, " %p\n", (void*)st->root_buffer[i]);
+
+    fprintf(stderr, "cells allocated = %zu, freed = %zu, bytes allocated = %zu, slabs = %zu\n",
+      st->cells_allocated, st->cells_freed, st->bytes_allocated, st->slabs_allocated);
+    fprintf(stderr, "collections = %zu, traces = %zu, incremental steps = %zu\n", st->collections, st->traces, st->collect_steps);
+    fprintf(stderr, "safety buffer peak = %zu\n", st->safety_buffer_peak);
+    fprintf(stderr, "symbols = %zu, reclaimed = %zu\n", st->next_sym - st->free_syms_size, st->syms_reclaimed);
   }
 
   qz_free(st);
 
-  if(fp != stdin)
+  if(fp != stdin) {
+    qz_forget_read_ahead(fp);
     fclose(fp);
+  }
 
   return ret;
 }
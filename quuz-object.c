@@ -1,215 +1,184 @@
+/* export the object model accessors from here */
+#define QZ_INLINE
 #include "quuz.h"
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
+/* quuz-collector.c */
+void qz_reclaim_syms(qz_state_t* st);
+
 const qz_obj_t QZ_NULL = { (size_t)NULL | QZ_PT_CELL };
 const qz_obj_t QZ_TRUE = { (1 << 6) | QZ_PT_BOOL };
 const qz_obj_t QZ_FALSE = { (0 << 6) | QZ_PT_BOOL };
 const qz_obj_t QZ_EOF = { QZ_PT_EOF };
 const qz_obj_t QZ_NONE = { QZ_PT_NONE };
 
-/* qz_is_<type> */
-static int cell_of_type(qz_obj_t obj, qz_cell_type_t type) {
-  if(qz_is_cell(obj)) {
-    qz_cell_t* cell = qz_to_cell(obj);
-    if(cell) return qz_type(cell) == type;
-  }
-  return 0;
-}
-int qz_is_null(qz_obj_t obj) {
-  return obj.value == QZ_NULL.value;
-}
-int qz_is_fixnum(qz_obj_t obj) {
-  return (obj.value & 3) == 0;
-}
-int qz_is_cell(qz_obj_t obj) {
-  return (obj.value & 7) == QZ_PT_CELL;
-}
-int qz_is_cfun(qz_obj_t obj) {
-  return (obj.value & 7) == QZ_PT_CFUN;
-}
-int qz_is_sym(qz_obj_t obj) {
-  return (obj.value & 63) == QZ_PT_SYM;
-}
-int qz_is_bool(qz_obj_t obj) {
-  return (obj.value & 63) == QZ_PT_BOOL;
-}
-int qz_is_char(qz_obj_t obj) {
-  return (obj.value & 63) == QZ_PT_CHAR;
-}
-int qz_is_eof(qz_obj_t obj) {
-  return obj.value == QZ_EOF.value;
-}
-int qz_is_none(qz_obj_t obj) {
-  return obj.value == QZ_NONE.value;
-}
-int qz_is_pair(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_PAIR);
-}
-int qz_is_fun(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_FUN);
-}
-int qz_is_promise(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_PROMISE);
-}
-int qz_is_error(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_ERROR);
-}
-int qz_is_string(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_STRING);
-}
-int qz_is_vector(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_VECTOR);
-}
-int qz_is_bytevector(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_BYTEVECTOR);
-}
-int qz_is_hash(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_HASH);
-}
-int qz_is_record(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_RECORD);
-}
-int qz_is_port(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_PORT);
-}
-int qz_is_real(qz_obj_t obj) {
-  return cell_of_type(obj, QZ_CT_REAL);
-}
+/* cell sizes of each pool, a pair or other fixed size cell fits the first */
+static const size_t POOL_SIZES[QZ_POOL_COUNT] = {
+  sizeof(qz_cell_t), 32, 48, 64, 96, 128, 256
+};
 
-/* qz_to_<type> */
-intptr_t qz_to_fixnum(qz_obj_t obj) {
-  assert(qz_is_fixnum(obj));
-  return (intptr_t)obj.value >> 2;
-}
-qz_cell_t* qz_to_cell(qz_obj_t obj) {
-  assert(qz_is_cell(obj));
-  return (qz_cell_t*)(obj.value & ~(size_t)7);
-}
-qz_cfun_t qz_to_cfun(qz_obj_t obj) {
-  assert(qz_is_cfun(obj));
-  return (qz_cfun_t)(obj.value & ~(size_t)7);
-}
-size_t qz_to_sym(qz_obj_t obj) {
-  assert(qz_is_sym(obj));
-  return obj.value >> 6;
-}
-int qz_to_bool(qz_obj_t obj) {
-  assert(qz_is_bool(obj));
-  return obj.value >> 6;
-}
-char qz_to_char(qz_obj_t obj) {
-  assert(qz_is_char(obj));
-  return obj.value >> 6;
-}
-qz_pair_t* qz_to_pair(qz_obj_t obj) {
-  assert(qz_is_pair(obj));
-  return &qz_to_cell(obj)->value.pair;
-}
-qz_pair_t* qz_to_fun(qz_obj_t obj) {
-  assert(qz_is_fun(obj));
-  return &qz_to_cell(obj)->value.pair;
-}
-qz_pair_t* qz_to_promise(qz_obj_t obj) {
-  assert(qz_is_promise(obj));
-  return &qz_to_cell(obj)->value.pair;
-}
-qz_port_t* qz_to_port(qz_obj_t obj) {
-  assert(qz_is_port(obj));
-  return &qz_to_cell(obj)->value.port;
-}
-double qz_to_real(qz_obj_t obj) {
-  assert(qz_is_real(obj));
-  return qz_to_cell(obj)->value.real;
-}
-
-/* qz_from_<type> */
-#ifndef NDEBUG
-static int pointer_aligned(void* ptr) {
-  return ((size_t)ptr & 7) == 0;
-}
+/* find the smallest pool holding cells of the given size, QZ_POOL_COUNT if none */
+static size_t size_to_pool(size_t size)
+{
+#ifdef QZ_MALLOC_CELLS
+  /* lets valgrind and asan track each cell */
+  QZ_UNUSED(size);
+  return QZ_POOL_COUNT;
+#else
+  size_t pool = 0;
+  while(pool < QZ_POOL_COUNT && POOL_SIZES[pool] < size)
+    pool++;
+  return pool;
 #endif
-qz_obj_t qz_from_fixnum(intptr_t i) {
-  return (qz_obj_t) { i << 2 };
-}
-qz_obj_t qz_from_cell(qz_cell_t* cell) {
-  assert(pointer_aligned(cell));
-  return (qz_obj_t) { (size_t)cell | QZ_PT_CELL };
-}
-qz_obj_t qz_from_cfun(qz_cfun_t cfun) {
-  assert(pointer_aligned((void*)(size_t)cfun));
-  return (qz_obj_t) { (size_t)cfun | QZ_PT_CFUN };
-}
-qz_obj_t qz_from_bool(int b) {
-  return (qz_obj_t) { (b << 6) | QZ_PT_BOOL };
-}
-qz_obj_t qz_from_char(char c) {
-  return (qz_obj_t) { (c << 6) | QZ_PT_CHAR };
 }
 
-/* cell->info accessors */
-#define REFCOUNT_BITS (sizeof(size_t)*CHAR_BIT - TYPE_BITS - COLOR_BITS - BUFFERED_BITS - DIRTY_BITS)
-#define TYPE_BITS 4
-#define COLOR_BITS 2
-#define BUFFERED_BITS 1
-#define DIRTY_BITS 1
+/* the start of each slab, the two words keep cells 8 byte aligned */
+typedef struct slab {
+  struct slab* next;
+  size_t pool; /* the size class its cells belong to */
+} slab_t;
 
-static size_t get_bits(size_t bitfield, size_t pos, size_t len) {
-  size_t mask = ~(size_t)0 >> (sizeof(size_t)*CHAR_BIT - len);
-  return (bitfield >> pos) & mask;
-}
-static size_t set_bits(size_t bitfield, size_t pos, size_t len, size_t value) {
-  size_t mask = ~(size_t)0 >> (sizeof(size_t)*CHAR_BIT - len);
-  return (bitfield & ~(mask << pos)) | (value << pos);
-}
-size_t qz_refcount(qz_cell_t* cell) {
-  return get_bits(cell->info, 0, REFCOUNT_BITS);
-}
-qz_cell_type_t qz_type(qz_cell_t* cell) {
-  return get_bits(cell->info, REFCOUNT_BITS, TYPE_BITS);
-}
-qz_cell_color_t qz_color(qz_cell_t* cell) {
-  return get_bits(cell->info, REFCOUNT_BITS + TYPE_BITS, COLOR_BITS);
-}
-size_t qz_buffered(qz_cell_t* cell) {
-  return get_bits(cell->info, REFCOUNT_BITS + TYPE_BITS + COLOR_BITS, BUFFERED_BITS);
-}
-size_t qz_dirty(qz_cell_t* cell) {
-  return get_bits(cell->info, REFCOUNT_BITS + TYPE_BITS + COLOR_BITS + BUFFERED_BITS, DIRTY_BITS);
-}
-void qz_set_refcount(qz_cell_t* cell, size_t rc) {
-  cell->info = set_bits(cell->info, 0, REFCOUNT_BITS, rc);
-}
-void qz_set_type(qz_cell_t* cell, qz_cell_type_t ct) {
-  cell->info = set_bits(cell->info, REFCOUNT_BITS, TYPE_BITS, ct);
+/* the start of each malloc'd cell, so they can be walked too */
+typedef struct big_cell {
+  struct big_cell* prev;
+  struct big_cell* next;
+} big_cell_t;
+
+/* carve a new slab into the given pool */
+static void grow_pool(qz_state_t* st, size_t pool_index)
+{
+  slab_t* slab = (slab_t*)malloc(QZ_SLAB_SIZE);
+  slab->next = (slab_t*)st->slabs;
+  slab->pool = pool_index;
+  st->slabs = slab;
+  st->slabs_allocated++;
+
+  qz_pool_t* pool = &st->pools[pool_index];
+  pool->unused = (char*)(slab + 1);
+  pool->unused_end = (char*)slab + QZ_SLAB_SIZE;
 }
-void qz_set_color(qz_cell_t* cell, qz_cell_color_t cc) {
-  cell->info = set_bits(cell->info, REFCOUNT_BITS + TYPE_BITS, COLOR_BITS, cc);
+
+qz_cell_t* qz_make_cell(qz_state_t* st, qz_cell_type_t type, size_t extra_size)
+{
+  size_t size = sizeof(qz_cell_t) + extra_size;
+  size_t pool_index = size_to_pool(size);
+  qz_cell_t* cell;
+
+  if(pool_index == QZ_POOL_COUNT) {
+    big_cell_t* big = (big_cell_t*)malloc(sizeof(big_cell_t) + size);
+    big->prev = NULL;
+    big->next = (big_cell_t*)st->big_cells;
+    if(big->next)
+      big->next->prev = big;
+    st->big_cells = big;
+    cell = (qz_cell_t*)(big + 1);
+  }
+  else {
+    qz_pool_t* pool = &st->pools[pool_index];
+
+    if(pool->free_list) {
+      cell = (qz_cell_t*)pool->free_list;
+      pool->free_list = *(void**)&cell->value;
+    }
+    else {
+      if(pool->unused + POOL_SIZES[pool_index] > pool->unused_end)
+        grow_pool(st, pool_index);
+      cell = (qz_cell_t*)pool->unused;
+      pool->unused += POOL_SIZES[pool_index];
+    }
+  }
+
+  /* the backup collector walks every cell, even one still being filled in,
+   * so whatever could hold references starts out as fixnums */
+  if(type == QZ_CT_STRING || type == QZ_CT_BYTEVECTOR)
+    memset(&cell->value, 0, sizeof(cell->value));
+  else
+    memset(&cell->value, 0, size - offsetof(qz_cell_t, value));
+
+  if(pool_index != QZ_POOL_COUNT)
+    size = POOL_SIZES[pool_index];
+
+  st->cells_allocated++;
+  st->bytes_allocated += size;
+
+  cell->info = 1 /*refcount*/ | ((size_t)type << QZ_REFCOUNT_BITS);
+  qz_set_pool(cell, pool_index);
+  return cell;
 }
-void qz_set_buffered(qz_cell_t* cell, size_t bu) {
-  cell->info = set_bits(cell->info, REFCOUNT_BITS + TYPE_BITS + COLOR_BITS, BUFFERED_BITS, bu);
+
+void qz_free_cell(qz_state_t* st, qz_cell_t* cell)
+{
+  size_t pool_index = qz_pool(cell);
+  st->cells_freed++;
+
+  if(pool_index == QZ_POOL_COUNT) {
+    big_cell_t* big = (big_cell_t*)cell - 1;
+    if(big->prev)
+      big->prev->next = big->next;
+    else
+      st->big_cells = big->next;
+    if(big->next)
+      big->next->prev = big->prev;
+    free(big);
+    return;
+  }
+
+  /* a free cell's info is zero, telling it apart from the cells in use */
+  qz_pool_t* pool = &st->pools[pool_index];
+  cell->info = 0;
+  *(void**)&cell->value = pool->free_list;
+  pool->free_list = cell;
 }
-void qz_set_dirty(qz_cell_t* cell, size_t d) {
-  cell->info = set_bits(cell->info, REFCOUNT_BITS + TYPE_BITS + COLOR_BITS + BUFFERED_BITS, DIRTY_BITS, d);
+
+void qz_each_cell(qz_state_t* st, void (*func)(qz_state_t*, qz_cell_t*))
+{
+  for(slab_t* slab = (slab_t*)st->slabs; slab; slab = slab->next) {
+    qz_pool_t* pool = &st->pools[slab->pool];
+    size_t size = POOL_SIZES[slab->pool];
+    char* end = (char*)slab + QZ_SLAB_SIZE;
+
+    /* the newest slab of a pool is only carved up to its unused part */
+    if(pool->unused_end == end)
+      end = pool->unused;
+
+    for(char* p = (char*)(slab + 1); p + size <= end; p += size) {
+      qz_cell_t* cell = (qz_cell_t*)p;
+      if(cell->info != 0)
+        func(st, cell);
+    }
+  }
+
+  for(big_cell_t* big = (big_cell_t*)st->big_cells; big; big = big->next)
+    func(st, (qz_cell_t*)(big + 1));
 }
 
-qz_cell_t* qz_make_cell(qz_cell_type_t type, size_t extra_size)
+void qz_free_pools(qz_state_t* st)
 {
-  qz_cell_t* cell = (qz_cell_t*)malloc(sizeof(qz_cell_t) + extra_size);
-  cell->info = 1 /*refcount*/ | ((size_t)type << REFCOUNT_BITS);
-  return cell;
+  while(st->slabs) {
+    slab_t* next = ((slab_t*)st->slabs)->next;
+    free(st->slabs);
+    st->slabs = next;
+  }
+
+  for(size_t i = 0; i < QZ_POOL_COUNT; i++) {
+    st->pools[i].free_list = NULL;
+    st->pools[i].unused = NULL;
+    st->pools[i].unused_end = NULL;
+  }
 }
 
-qz_obj_t qz_make_string(const char* str)
+qz_obj_t qz_make_string(qz_state_t* st, const char* str)
 {
-  return qz_make_string_with_size(str, strlen(str));
+  return qz_make_string_with_size(st, str, strlen(str));
 }
 
-qz_obj_t qz_make_string_with_size(const char* str, size_t size)
+qz_obj_t qz_make_string_with_size(qz_state_t* st, const char* str, size_t size)
 {
-  qz_cell_t* cell = qz_make_cell(QZ_CT_STRING, size*sizeof(char));
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_STRING, size*sizeof(char));
 
   cell->value.array.size = size;
   cell->value.array.capacity = size;
@@ -219,9 +188,9 @@ qz_obj_t qz_make_string_with_size(const char* str, size_t size)
   return qz_from_cell(cell);
 }
 
-qz_obj_t qz_make_pair(qz_obj_t first, qz_obj_t rest)
+qz_obj_t qz_make_pair(qz_state_t* st, qz_obj_t first, qz_obj_t rest)
 {
-  qz_cell_t* cell = qz_make_cell(QZ_CT_PAIR, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_PAIR, 0);
 
   cell->value.pair.first = first;
   cell->value.pair.rest = rest;
@@ -229,6 +198,28 @@ qz_obj_t qz_make_pair(qz_obj_t first, qz_obj_t rest)
   return qz_from_cell(cell);
 }
 
+qz_obj_t qz_intern_string(qz_state_t* st, const char* str, size_t size)
+{
+  qz_hash_slot_t* slot = qz_hash_find_chars(qz_to_cell(st->strings)->value.pair.rest, str, size);
+  if(slot)
+    return qz_ref(st, slot->key);
+
+  /* the null beyond the end lets the data be used as a C string */
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_STRING, (size + 1)*sizeof(char));
+  cell->value.array.size = size;
+  cell->value.array.capacity = size;
+  /* the reader interns "" from a NULL buffer */
+  if(size > 0)
+    memcpy(QZ_CELL_DATA(cell, char), str, size);
+  QZ_CELL_DATA(cell, char)[size] = '\0';
+  qz_set_immutable(cell, 1);
+
+  /* the table's reference is dropped at once, so the string goes when the last user lets go */
+  qz_obj_t obj = qz_from_cell(cell);
+  qz_table_set(st, st->strings, qz_ref(st, obj), QZ_TRUE);
+  return obj;
+}
+
 /* convert a name into an symbol
  * name is unrefed */
 qz_obj_t qz_make_sym(qz_state_t* st, qz_obj_t name)
@@ -236,25 +227,73 @@ qz_obj_t qz_make_sym(qz_state_t* st, qz_obj_t name)
   /* find existing symbol */
   qz_obj_t* slot = qz_hash_get(st, st->name_sym, name);
   if(slot) {
-    qz_unref(st, name); /* (1) -1 */
+    qz_unref(st, name);
     return *slot;
   }
 
-  /* create new symbol */
-  /* TODO move me */
-  qz_obj_t sym = (qz_obj_t) { (st->next_sym++ << 6) | QZ_PT_SYM };
-  qz_ref(st, name); /* (1) +1 -2 */
-  qz_hash_set(st, &st->name_sym, name, sym);
-  qz_hash_set(st, &st->sym_name, sym, name);
+  /* create new symbol, named by an interned copy of name so changing name can't rename it */
+  qz_cell_t* name_cell = qz_to_cell(name);
+  qz_obj_t interned = qz_intern_string(st, QZ_CELL_DATA(name_cell, char), name_cell->value.array.size);
+  qz_unref(st, name);
+
+  qz_obj_t sym = qz_make_unique_sym(st);
+  qz_hash_set(st, &st->name_sym, qz_ref(st, interned), sym);
+  st->sym_names[qz_to_sym(sym)] = interned;
   return sym;
 }
 
-qz_obj_t qz_first(qz_obj_t obj) {
-  return qz_to_cell(obj)->value.pair.first;
+qz_obj_t qz_make_unique_sym(qz_state_t* st)
+{
+  /* only while evaluating, when the C stack that could hold symbols is known */
+  if(st->c_stack_base)
+    qz_reclaim_syms(st);
+
+  st->syms_made++;
+
+  if(st->free_syms_size > 0)
+    return (qz_obj_t) { (st->free_syms[--st->free_syms_size] << 6) | QZ_PT_SYM };
+
+  /* every symbol has a global variable slot and a name slot */
+  if(st->next_sym >= st->globals_capacity) {
+    size_t capacity = st->globals_capacity ? st->globals_capacity*2 : 512;
+    st->globals = (qz_obj_t*)realloc(st->globals, capacity*sizeof(qz_obj_t));
+    st->sym_names = (qz_obj_t*)realloc(st->sym_names, capacity*sizeof(qz_obj_t));
+
+    for(size_t i = st->globals_capacity; i < capacity; i++) {
+      st->globals[i] = QZ_NONE;
+      st->sym_names[i] = QZ_NONE;
+    }
+
+    st->globals_capacity = capacity;
+  }
+
+  return (qz_obj_t) { (st->next_sym++ << 6) | QZ_PT_SYM };
+}
+
+qz_obj_t qz_sym_name(qz_state_t* st, qz_obj_t sym)
+{
+  size_t index = qz_to_sym(sym);
+  assert(index < st->next_sym);
+  return st->sym_names[index];
 }
 
-qz_obj_t qz_rest(qz_obj_t obj) {
-  return qz_to_cell(obj)->value.pair.rest;
+void qz_pin_sym(qz_state_t* st, qz_obj_t sym)
+{
+  qz_obj_t* count = qz_hash_get(st, st->pinned_syms, sym);
+  if(count)
+    *count = qz_from_fixnum(qz_to_fixnum(*count) + 1);
+  else
+    qz_hash_set(st, &st->pinned_syms, sym, qz_from_fixnum(1));
+}
+
+void qz_unpin_sym(qz_state_t* st, qz_obj_t sym)
+{
+  qz_obj_t* count = qz_hash_get(st, st->pinned_syms, sym);
+  assert(count);
+  if(qz_to_fixnum(*count) > 1)
+    *count = qz_from_fixnum(qz_to_fixnum(*count) - 1);
+  else
+    qz_hash_delete(st, &st->pinned_syms, sym);
 }
 
 qz_obj_t qz_required_arg(qz_state_t* st, qz_obj_t* obj)
@@ -314,18 +353,6 @@ qz_obj_t* qz_vector_tail_ptr(qz_obj_t obj)
 qz_obj_t qz_vector_head(qz_obj_t obj) { return *qz_vector_head_ptr(obj); }
 qz_obj_t qz_vector_tail(qz_obj_t obj) { return *qz_vector_tail_ptr(obj); }
 
-/* scheme's eq? procedure */
-int qz_eq(qz_obj_t a, qz_obj_t b)
-{
-  return a.value == b.value;
-}
-
-/* scheme's eqv? procedure */
-int qz_eqv(qz_obj_t a, qz_obj_t b)
-{
-  return a.value == b.value;
-}
-
 /* performs a bitwise comparison of two arrays
  * returns nonzero if equal */
 static int compare_array(qz_cell_t* a, qz_cell_t* b, size_t elem_size)
@@ -350,8 +377,8 @@ int qz_equal(qz_obj_t a, qz_obj_t b)
   if(a_tag != b_tag)
     return 0;
 
-  /* straight compare failed for non-cell? not equal */
-  if(a_tag != QZ_PT_CELL)
+  /* straight compare failed for non-cell or the empty list? not equal */
+  if(a_tag != QZ_PT_CELL || qz_is_null(a) || qz_is_null(b))
     return 0;
 
   qz_cell_t* a_cell = qz_to_cell(a);
@@ -368,7 +395,7 @@ int qz_equal(qz_obj_t a, qz_obj_t b)
   {
     /* recusively compare pairs */
     return qz_equal(a_cell->value.pair.first, b_cell->value.pair.first)
-      && qz_equal(b_cell->value.pair.rest, b_cell->value.pair.rest);
+      && qz_equal(a_cell->value.pair.rest, b_cell->value.pair.rest);
   }
   else if(a_type == QZ_CT_STRING)
   {
@@ -405,6 +432,28 @@ int qz_equal(qz_obj_t a, qz_obj_t b)
   {
     assert(0); /* NYI */
   }
+  else if(a_type == QZ_CT_HAMT)
+  {
+    /* the same keys with equal values, whatever shape the tries have */
+    if(a_cell->value.hamt.size != b_cell->value.hamt.size)
+      return 0;
+
+    size_t iter = 0;
+    qz_hamt_entry_t* entry;
+
+    while((entry = qz_hamt_next(a, &iter))) {
+      qz_obj_t* value = qz_hamt_get(b, entry->key);
+      if(!value || !qz_equal(entry->value, *value))
+        return 0;
+    }
+
+    return 1;
+  }
+  else if(a_type == QZ_CT_CODE || a_type == QZ_CT_TABLE)
+  {
+    /* code and hash tables are only equal to themselves */
+    return 0;
+  }
 
   assert(0); /* unknown cell type */
   return 0;
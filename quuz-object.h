@@ -0,0 +1,312 @@
+#ifndef QUUZ_OBJECT_H
+#define QUUZ_OBJECT_H
+
+/* the object model accessors, included by quuz.h
+ * these are static inline everywhere except quuz-object.c,
+ * which defines QZ_INLINE as nothing to export them as ordinary functions */
+
+#include <assert.h>
+#include <limits.h>
+
+#ifndef QZ_INLINE
+#define QZ_INLINE static inline
+#endif
+
+/* cell->info accessors */
+#define QZ_REFCOUNT_BITS (sizeof(size_t)*CHAR_BIT - QZ_TYPE_BITS - QZ_COLOR_BITS - QZ_BUFFERED_BITS - QZ_DIRTY_BITS - QZ_POOL_BITS - QZ_IMMUTABLE_BITS - QZ_WEAK_BITS - QZ_HELD_BITS - QZ_DEFERRED_BITS)
+#define QZ_TYPE_BITS 4
+#define QZ_COLOR_BITS 2
+#define QZ_BUFFERED_BITS 1
+#define QZ_DIRTY_BITS 1
+#define QZ_POOL_BITS 3
+#define QZ_IMMUTABLE_BITS 1
+#define QZ_WEAK_BITS 2
+#define QZ_HELD_BITS 1
+#define QZ_DEFERRED_BITS 1
+
+static inline size_t qz_get_bits(size_t bitfield, size_t pos, size_t len) {
+  size_t mask = ~(size_t)0 >> (sizeof(size_t)*CHAR_BIT - len);
+  return (bitfield >> pos) & mask;
+}
+static inline size_t qz_set_bits(size_t bitfield, size_t pos, size_t len, size_t value) {
+  size_t mask = ~(size_t)0 >> (sizeof(size_t)*CHAR_BIT - len);
+  return (bitfield & ~(mask << pos)) | (value << pos);
+}
+QZ_INLINE size_t qz_refcount(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, 0, QZ_REFCOUNT_BITS);
+}
+QZ_INLINE qz_cell_type_t qz_type(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS, QZ_TYPE_BITS);
+}
+QZ_INLINE qz_cell_color_t qz_color(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS, QZ_COLOR_BITS);
+}
+QZ_INLINE size_t qz_buffered(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS, QZ_BUFFERED_BITS);
+}
+QZ_INLINE size_t qz_dirty(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS, QZ_DIRTY_BITS);
+}
+QZ_INLINE size_t qz_pool(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS, QZ_POOL_BITS);
+}
+QZ_INLINE size_t qz_immutable(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS, QZ_IMMUTABLE_BITS);
+}
+QZ_INLINE size_t qz_weak(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS, QZ_WEAK_BITS);
+}
+QZ_INLINE size_t qz_held(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS + QZ_WEAK_BITS, QZ_HELD_BITS);
+}
+QZ_INLINE size_t qz_deferred(qz_cell_t* cell) {
+  return qz_get_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS + QZ_WEAK_BITS + QZ_HELD_BITS, QZ_DEFERRED_BITS);
+}
+QZ_INLINE void qz_set_refcount(qz_cell_t* cell, size_t rc) {
+  cell->info = qz_set_bits(cell->info, 0, QZ_REFCOUNT_BITS, rc);
+}
+QZ_INLINE void qz_set_type(qz_cell_t* cell, qz_cell_type_t ct) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS, QZ_TYPE_BITS, ct);
+}
+QZ_INLINE void qz_set_color(qz_cell_t* cell, qz_cell_color_t cc) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS, QZ_COLOR_BITS, cc);
+}
+QZ_INLINE void qz_set_buffered(qz_cell_t* cell, size_t bu) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS, QZ_BUFFERED_BITS, bu);
+}
+QZ_INLINE void qz_set_dirty(qz_cell_t* cell, size_t d) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS, QZ_DIRTY_BITS, d);
+}
+QZ_INLINE void qz_set_pool(qz_cell_t* cell, size_t pool) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS, QZ_POOL_BITS, pool);
+}
+QZ_INLINE void qz_set_immutable(qz_cell_t* cell, size_t im) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS, QZ_IMMUTABLE_BITS, im);
+}
+QZ_INLINE void qz_set_weak(qz_cell_t* cell, size_t weak) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS, QZ_WEAK_BITS, weak);
+}
+QZ_INLINE void qz_set_held(qz_cell_t* cell, size_t held) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS + QZ_WEAK_BITS, QZ_HELD_BITS, held);
+}
+QZ_INLINE void qz_set_deferred(qz_cell_t* cell, size_t deferred) {
+  cell->info = qz_set_bits(cell->info, QZ_REFCOUNT_BITS + QZ_TYPE_BITS + QZ_COLOR_BITS + QZ_BUFFERED_BITS + QZ_DIRTY_BITS + QZ_POOL_BITS + QZ_IMMUTABLE_BITS + QZ_WEAK_BITS + QZ_HELD_BITS, QZ_DEFERRED_BITS, deferred);
+}
+
+/* qz_is_<type> */
+static inline int qz_cell_of_type(qz_obj_t obj, qz_cell_type_t type) {
+  if((obj.value & 7) == QZ_PT_CELL) {
+    qz_cell_t* cell = (qz_cell_t*)(obj.value & ~(size_t)7);
+    if(cell) return qz_type(cell) == type;
+  }
+  return 0;
+}
+QZ_INLINE int qz_is_null(qz_obj_t obj) {
+  return obj.value == QZ_PT_CELL; /* NULL cell */
+}
+QZ_INLINE int qz_is_fixnum(qz_obj_t obj) {
+  return (obj.value & 3) == 0;
+}
+QZ_INLINE int qz_is_cell(qz_obj_t obj) {
+  return (obj.value & 7) == QZ_PT_CELL;
+}
+QZ_INLINE int qz_is_cfun(qz_obj_t obj) {
+  return (obj.value & 7) == QZ_PT_CFUN;
+}
+QZ_INLINE int qz_is_prim(qz_obj_t obj) {
+  return (obj.value & 7) == QZ_PT_PRIM;
+}
+QZ_INLINE int qz_is_sym(qz_obj_t obj) {
+  return (obj.value & 63) == QZ_PT_SYM;
+}
+QZ_INLINE int qz_is_bool(qz_obj_t obj) {
+  return (obj.value & 63) == QZ_PT_BOOL;
+}
+QZ_INLINE int qz_is_char(qz_obj_t obj) {
+  return (obj.value & 63) == QZ_PT_CHAR;
+}
+QZ_INLINE int qz_is_eof(qz_obj_t obj) {
+  return obj.value == QZ_PT_EOF;
+}
+QZ_INLINE int qz_is_none(qz_obj_t obj) {
+  return obj.value == QZ_PT_NONE;
+}
+QZ_INLINE int qz_is_pair(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_PAIR);
+}
+QZ_INLINE int qz_is_fun(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_FUN);
+}
+QZ_INLINE int qz_is_promise(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_PROMISE);
+}
+QZ_INLINE int qz_is_error(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_ERROR);
+}
+QZ_INLINE int qz_is_string(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_STRING);
+}
+QZ_INLINE int qz_is_vector(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_VECTOR);
+}
+QZ_INLINE int qz_is_bytevector(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_BYTEVECTOR);
+}
+QZ_INLINE int qz_is_hash(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_HASH);
+}
+QZ_INLINE int qz_is_record(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_RECORD);
+}
+QZ_INLINE int qz_is_port(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_PORT);
+}
+QZ_INLINE int qz_is_real(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_REAL);
+}
+QZ_INLINE int qz_is_table(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_TABLE);
+}
+QZ_INLINE int qz_is_hamt(qz_obj_t obj) {
+  return qz_cell_of_type(obj, QZ_CT_HAMT);
+}
+
+/* the qz_type_mask_t bit of an object, 0 for none */
+QZ_INLINE uint32_t qz_type_bit(qz_obj_t obj) {
+  switch(obj.value & 7) {
+  case QZ_PT_EVEN_FIXNUM:
+  case QZ_PT_ODD_FIXNUM:
+    return QZ_T_FIXNUM;
+  case QZ_PT_CELL:
+    if(obj.value == QZ_PT_CELL) return QZ_T_NULL;
+    return (uint32_t)1 << qz_type((qz_cell_t*)(obj.value & ~(size_t)7));
+  case QZ_PT_CFUN:
+    return QZ_T_CFUN;
+  case QZ_PT_PRIM:
+    return QZ_T_PRIM;
+  }
+  switch(obj.value & 63) {
+  case QZ_PT_SYM: return QZ_T_SYM;
+  case QZ_PT_BOOL: return QZ_T_BOOL;
+  case QZ_PT_CHAR: return QZ_T_CHAR;
+  }
+  return obj.value == QZ_PT_EOF ? QZ_T_EOF : 0;
+}
+
+/* qz_to_<type> */
+QZ_INLINE intptr_t qz_to_fixnum(qz_obj_t obj) {
+  assert(qz_is_fixnum(obj));
+  return (intptr_t)obj.value >> 2;
+}
+QZ_INLINE qz_cell_t* qz_to_cell(qz_obj_t obj) {
+  assert(qz_is_cell(obj));
+  return (qz_cell_t*)(obj.value & ~(size_t)7);
+}
+QZ_INLINE qz_cfun_t qz_to_cfun(qz_obj_t obj) {
+  assert(qz_is_cfun(obj));
+  return (qz_cfun_t)(obj.value & ~(size_t)7);
+}
+QZ_INLINE const qz_prim_t* qz_to_prim(qz_obj_t obj) {
+  assert(qz_is_prim(obj));
+  return (const qz_prim_t*)(obj.value & ~(size_t)7);
+}
+QZ_INLINE size_t qz_to_sym(qz_obj_t obj) {
+  assert(qz_is_sym(obj));
+  return obj.value >> 6;
+}
+QZ_INLINE int qz_to_bool(qz_obj_t obj) {
+  assert(qz_is_bool(obj));
+  return obj.value >> 6;
+}
+QZ_INLINE char qz_to_char(qz_obj_t obj) {
+  assert(qz_is_char(obj));
+  return obj.value >> 6;
+}
+QZ_INLINE qz_pair_t* qz_to_pair(qz_obj_t obj) {
+  assert(qz_is_pair(obj));
+  return &qz_to_cell(obj)->value.pair;
+}
+QZ_INLINE qz_pair_t* qz_to_fun(qz_obj_t obj) {
+  assert(qz_is_fun(obj));
+  return &qz_to_cell(obj)->value.pair;
+}
+QZ_INLINE qz_pair_t* qz_to_promise(qz_obj_t obj) {
+  assert(qz_is_promise(obj));
+  return &qz_to_cell(obj)->value.pair;
+}
+QZ_INLINE qz_port_t* qz_to_port(qz_obj_t obj) {
+  assert(qz_is_port(obj));
+  return &qz_to_cell(obj)->value.port;
+}
+QZ_INLINE double qz_to_real(qz_obj_t obj) {
+  assert(qz_is_real(obj));
+  return qz_to_cell(obj)->value.real;
+}
+
+/* qz_from_<type> */
+static inline int qz_pointer_aligned(const void* ptr) {
+  return ((size_t)ptr & 7) == 0;
+}
+QZ_INLINE qz_obj_t qz_from_fixnum(intptr_t i) {
+  return (qz_obj_t) { i << 2 };
+}
+QZ_INLINE qz_obj_t qz_from_cell(qz_cell_t* cell) {
+  assert(qz_pointer_aligned(cell));
+  return (qz_obj_t) { (size_t)cell | QZ_PT_CELL };
+}
+QZ_INLINE qz_obj_t qz_from_cfun(qz_cfun_t cfun) {
+  assert(qz_pointer_aligned((void*)(size_t)cfun));
+  return (qz_obj_t) { (size_t)cfun | QZ_PT_CFUN };
+}
+QZ_INLINE qz_obj_t qz_from_prim(const qz_prim_t* prim) {
+  assert(qz_pointer_aligned((void*)prim));
+  return (qz_obj_t) { (size_t)prim | QZ_PT_PRIM };
+}
+QZ_INLINE qz_obj_t qz_from_bool(int b) {
+  return (qz_obj_t) { (b << 6) | QZ_PT_BOOL };
+}
+QZ_INLINE qz_obj_t qz_from_char(char c) {
+  return (qz_obj_t) { (c << 6) | QZ_PT_CHAR };
+}
+
+/* returns the first member of a pair
+ * qz_is_pair(obj) must be true */
+QZ_INLINE qz_obj_t qz_first(qz_obj_t obj) {
+  return qz_to_cell(obj)->value.pair.first;
+}
+
+/* returns the rest member of a pair
+ * qz_is_pair(obj) must be true */
+QZ_INLINE qz_obj_t qz_rest(qz_obj_t obj) {
+  return qz_to_cell(obj)->value.pair.rest;
+}
+
+/* scheme's eq? procedure */
+QZ_INLINE int qz_eq(qz_obj_t a, qz_obj_t b)
+{
+  return a.value == b.value;
+}
+
+/* scheme's eqv? procedure */
+QZ_INLINE int qz_eqv(qz_obj_t a, qz_obj_t b)
+{
+  return a.value == b.value;
+}
+
+/* the number of bits set */
+static inline size_t qz_count_bits(uint32_t bits) {
+  bits = bits - ((bits >> 1) & 0x55555555);
+  bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+  return (((bits + (bits >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* the number of entries following a hamt node */
+QZ_INLINE size_t qz_hamt_entries(qz_cell_t* cell)
+{
+  if(!cell->value.hamt.bitmap)
+    return cell->value.hamt.size;
+
+  return qz_count_bits((uint32_t)cell->value.hamt.bitmap);
+}
+
+#endif /* QUUZ_OBJECT_H */
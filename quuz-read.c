@@ -16,9 +16,30 @@ static qz_state_t* g_st = NULL;
 static FILE* g_fp = NULL;
 static qz_obj_t g_stack;
 
+/* set by qz_read_shared() */
+static int g_share = 0;
+
+/* characters of the string or identifier being read, interned once it's done */
+static char* g_chars = NULL;
+static size_t g_chars_size = 0;
+static size_t g_chars_capacity = 0;
+
+/* characters leg read ahead from a file but hasn't parsed yet, set aside while another file is read */
+typedef struct read_ahead {
+  FILE* fp;
+  char* chars;
+  int size;
+  struct read_ahead* next;
+} read_ahead_t;
+
+static read_ahead_t* g_read_ahead = NULL;
+
+/* the file the characters in leg's buffer came from */
+static FILE* g_buffer_fp = NULL;
+
 static qz_obj_t make_array(qz_cell_type_t type, size_t elem_size)
 {
-  qz_cell_t* cell = qz_make_cell(type, INITIAL_CAPACITY*elem_size);
+  qz_cell_t* cell = qz_make_cell(g_st, type, INITIAL_CAPACITY*elem_size);
 
   cell->value.array.size = 0;
   cell->value.array.capacity = INITIAL_CAPACITY;
@@ -36,11 +57,13 @@ static qz_cell_t* grow_array(qz_cell_t* cell, size_t elem_size)
   size_t new_capacity = cell->value.array.capacity * 2;
 
   /* make copy of array */
-  qz_cell_t* new_cell = (qz_cell_t*)malloc(sizeof(qz_cell_t) + new_capacity*elem_size);
+  qz_cell_t* new_cell = qz_make_cell(g_st, qz_type(cell), new_capacity*elem_size);
   assert(((size_t)new_cell & 7) == 0);
 
-  /* copy info */
+  /* copy info, except for the pool */
+  size_t pool = qz_pool(new_cell);
   new_cell->info = cell->info;
+  qz_set_pool(new_cell, pool);
 
   /* init array */
   new_cell->value.array.size = cell->value.array.size;
@@ -50,7 +73,7 @@ static qz_cell_t* grow_array(qz_cell_t* cell, size_t elem_size)
   memcpy(QZ_CELL_DATA(new_cell, char), QZ_CELL_DATA(cell, char), cell->value.array.size*elem_size);
 
   /* cleanup */
-  free(cell);
+  qz_free_cell(g_st, cell);
 
   return new_cell;
 }
@@ -59,17 +82,14 @@ static void concat_string(char c)
 {
   /*printf("concat_string(%c)\n", c);*/
 
-  qz_obj_t* obj = qz_vector_tail_ptr(g_stack);
-  qz_cell_t* cell = qz_to_cell(*obj);
-
   /* resize if necessary */
-  if(cell->value.array.size == cell->value.array.capacity) {
-    cell = grow_array(cell, sizeof(char));
-    *obj = qz_from_cell(cell);
+  if(g_chars_size == g_chars_capacity) {
+    g_chars_capacity = g_chars_capacity ? g_chars_capacity*2 : INITIAL_CAPACITY;
+    g_chars = (char*)realloc(g_chars, g_chars_capacity);
   }
 
   /* append character */
-  QZ_CELL_DATA(cell, char)[cell->value.array.size++] = c;
+  g_chars[g_chars_size++] = c;
 }
 
 static void concat_bytevector(int b)
@@ -98,7 +118,7 @@ static void append(qz_obj_t value_obj)
   if(qz_is_null(*obj))
   {
     /* parsing is the only place a null is promoted to a pair */
-    *obj = qz_make_pair(value_obj, QZ_NULL);
+    *obj = qz_make_pair(g_st, value_obj, QZ_NULL);
   }
   else if(qz_is_pair(*obj))
   {
@@ -109,7 +129,7 @@ static void append(qz_obj_t value_obj)
       pair = qz_to_pair(pair->rest);
 
     /* wrap in another cell and append */
-    pair->rest = qz_make_pair(value_obj, QZ_NULL);
+    pair->rest = qz_make_pair(g_st, value_obj, QZ_NULL);
   }
   else if(qz_is_vector(*obj))
   {
@@ -149,6 +169,50 @@ static void push(qz_obj_t obj)
   QZ_CELL_DATA(stack_cell, qz_obj_t)[stack_cell->value.array.size++] = obj;
 }
 
+/* the shared cell equal to a finished object, made immutable and remembered if there isn't one yet
+ * the object's elements were shared as they finished, so only the object itself is compared */
+static qz_obj_t share(qz_obj_t obj)
+{
+  if(qz_is_null(obj))
+    return obj;
+
+  qz_hash_slot_t* slot = qz_table_find(g_st->shared, obj);
+  if(slot) {
+    qz_obj_t found = qz_ref(g_st, slot->key);
+    qz_unref(g_st, obj);
+    return found;
+  }
+
+  qz_set_immutable(qz_to_cell(obj), 1);
+  qz_table_set(g_st, g_st->shared, qz_ref(g_st, obj), QZ_TRUE);
+  return obj;
+}
+
+/* share a finished list pair by pair from its end, so lists ending alike share their tails */
+static qz_obj_t share_list(qz_obj_t list)
+{
+  /* reverse the spine, stopping at a tail after a dot that's been shared already */
+  qz_obj_t prev = QZ_NULL;
+  while(qz_is_pair(list) && !qz_immutable(qz_to_cell(list))) {
+    qz_pair_t* pair = qz_to_pair(list);
+    qz_obj_t next = pair->rest;
+    pair->rest = prev;
+    prev = list;
+    list = next;
+  }
+
+  /* and reverse it back, sharing each pair once its rest has been */
+  while(!qz_is_null(prev)) {
+    qz_pair_t* pair = qz_to_pair(prev);
+    qz_obj_t next = pair->rest;
+    pair->rest = list;
+    list = share(prev);
+    prev = next;
+  }
+
+  return list;
+}
+
 /* pop an object from the stack, appending it to the container at the new top of the stack */
 static void pop(void)
 {
@@ -160,41 +224,26 @@ static void pop(void)
 
   qz_obj_t obj = QZ_CELL_DATA(stack_cell, qz_obj_t)[--stack_cell->value.array.size];
 
-  /* append a null to strings */
-  if(qz_is_string(obj)) {
-    qz_cell_t* cell = qz_to_cell(obj);
-    if(cell->value.array.size == cell->value.array.capacity) {
-      cell = grow_array(cell, sizeof(char));
-      obj = qz_from_cell(cell);
-    }
-    QZ_CELL_DATA(cell, char)[cell->value.array.size] = '\0';
-  }
+  if(g_share)
+    obj = qz_is_pair(obj) ? share_list(obj) : share(obj);
 
   append(obj);
 }
 
-/* pop a string from the stack, appending the matching symbol to the container at the top of the stack */
-static void pop_sym(void)
+/* append the string read to the container at the top of the stack */
+static void pop_string(void)
 {
-  /*printf("pop_sym()\n");*/
-
-  qz_cell_t* stack_cell = qz_to_cell(g_stack);
-
-  assert(stack_cell->value.array.size > 1); /* never pop the root element */
+  /*printf("pop_string()\n");*/
 
-  qz_obj_t obj = QZ_CELL_DATA(stack_cell, qz_obj_t)[--stack_cell->value.array.size];
+  append(qz_intern_string(g_st, g_chars, g_chars_size));
+}
 
-  /* append a null to strings */
-  if(qz_is_string(obj)) {
-    qz_cell_t* cell = qz_to_cell(obj);
-    if(cell->value.array.size == cell->value.array.capacity) {
-      cell = grow_array(cell, sizeof(char));
-      obj = qz_from_cell(cell);
-    }
-    QZ_CELL_DATA(cell, char)[cell->value.array.size] = '\0';
-  }
+/* append the symbol named by the string read to the container at the top of the stack */
+static void pop_sym(void)
+{
+  /*printf("pop_sym()\n");*/
 
-  append(qz_make_sym(g_st, obj));
+  append(qz_make_sym(g_st, qz_intern_string(g_st, g_chars, g_chars_size)));
 }
 
 /* (a b c) -> (a b . c) */
@@ -204,7 +253,7 @@ static void elide_pair(void)
 
   qz_cell_t* stack_cell = qz_to_cell(g_stack);
 
-  qz_obj_t prev;
+  qz_obj_t prev = QZ_NULL;
   qz_obj_t curr = QZ_CELL_DATA(stack_cell, qz_obj_t)[stack_cell->value.array.size - 1];
 
   for(;;) {
@@ -246,12 +295,12 @@ static void push_bytevector(void)
   push(make_array(QZ_CT_BYTEVECTOR, sizeof(uint8_t)));
 }
 
-/* push a string onto the stack */
+/* start reading a string or identifier */
 static void push_string(void)
 {
   /*printf("push_string()\n");*/
 
-  push(make_array(QZ_CT_STRING, sizeof(char)));
+  g_chars_size = 0;
 }
 
 /* append a char value to the container at the top of the stack */
@@ -297,20 +346,77 @@ static void append_sym(const char* s)
 #include "parser.c"
 #pragma GCC diagnostic pop
 
+/* leg keeps the characters a parse read ahead in its buffer for the next parse, whatever file that reads
+ * so they're set aside while another file is read, and put back when that file is read again */
+static void switch_file(FILE* fp)
+{
+  if(fp == g_buffer_fp)
+    return;
+
+  /* after a parse, the characters read ahead are at the start of the buffer */
+  if(yyctx->__limit > 0) {
+    read_ahead_t* ra = (read_ahead_t*)malloc(sizeof(read_ahead_t));
+    ra->fp = g_buffer_fp;
+    ra->size = yyctx->__limit;
+    ra->chars = (char*)malloc(ra->size);
+    memcpy(ra->chars, yyctx->__buf, ra->size);
+    ra->next = g_read_ahead;
+    g_read_ahead = ra;
+    yyctx->__limit = 0;
+  }
+
+  for(read_ahead_t** p = &g_read_ahead; *p; p = &(*p)->next) {
+    read_ahead_t* ra = *p;
+    if(ra->fp == fp) {
+      /* the buffer only grows, it held these before */
+      assert(ra->size <= yyctx->__buflen);
+      memcpy(yyctx->__buf, ra->chars, ra->size);
+      yyctx->__limit = ra->size;
+      *p = ra->next;
+      free(ra->chars);
+      free(ra);
+      break;
+    }
+  }
+
+  g_buffer_fp = fp;
+}
+
+void qz_forget_read_ahead(FILE* fp)
+{
+  if(fp == g_buffer_fp) {
+    yyctx->__limit = 0;
+    g_buffer_fp = NULL;
+  }
+
+  for(read_ahead_t** p = &g_read_ahead; *p; p = &(*p)->next) {
+    read_ahead_t* ra = *p;
+    if(ra->fp == fp) {
+      *p = ra->next;
+      free(ra->chars);
+      free(ra);
+      break;
+    }
+  }
+}
+
 void qz_discard_hashbang(FILE* fp)
 {
+  switch_file(fp);
   g_fp = fp;
   yyparsefrom(yy_hashBang);
   g_fp = NULL;
 }
 
-qz_obj_t qz_read(qz_state_t* st, FILE* fp)
+static qz_obj_t read_datum(qz_state_t* st, FILE* fp, int shared)
 {
   /* avoid unused function warning */
   (void)yyAccept;
 
+  switch_file(fp);
   g_st = st;
   g_fp = fp;
+  g_share = shared;
 
   /* setup stack with empty list */
   g_stack = make_array(QZ_CT_VECTOR, sizeof(qz_obj_t));
@@ -328,8 +434,23 @@ qz_obj_t qz_read(qz_state_t* st, FILE* fp)
   /* cleanup */
   qz_unref(st, g_stack);
   g_stack = QZ_NONE;
+  free(g_chars);
+  g_chars = NULL;
+  g_chars_size = 0;
+  g_chars_capacity = 0;
   g_st = NULL;
   g_fp = NULL;
+  g_share = 0;
 
   return result;
 }
+
+qz_obj_t qz_read(qz_state_t* st, FILE* fp)
+{
+  return read_datum(st, fp, 0);
+}
+
+qz_obj_t qz_read_shared(qz_state_t* st, FILE* fp)
+{
+  return read_datum(st, fp, 1);
+}
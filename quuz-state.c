@@ -8,9 +8,11 @@
 /* quuz-lib.c */
 qz_obj_t qz_error_handler(qz_state_t*, qz_obj_t);
 extern const qz_named_cfun_t QZ_LIB_FUNCTIONS[];
+extern const qz_prim_t QZ_LIB_PRIMS[];
 
-/* quuz-collector.c */
-void qz_collect(qz_state_t* st);
+/* quuz-vm.c */
+qz_obj_t qz_vm_run(qz_state_t* st, qz_obj_t fun, qz_obj_t scope);
+void qz_vm_unwind(qz_state_t* st, size_t stack_size, size_t frames_size);
 
 static void cleanup_safety_buffer(qz_state_t* st, size_t old_safety_buffer_size)
 {
@@ -32,7 +34,7 @@ static void cleanup_safety_buffer(qz_state_t* st, size_t old_safety_buffer_size)
 static qz_obj_t make_port(qz_state_t* st, int fd, const char* mode)
 {
   QZ_UNUSED(st);
-  qz_cell_t* cell = qz_make_cell(QZ_CT_PORT, 0);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_PORT, 0);
   cell->value.port.fp = fdopen(dup(fd), mode);
   cell->value.port.mode = mode;
   return qz_from_cell(cell);
@@ -42,35 +44,112 @@ qz_state_t* qz_alloc(void)
 {
   qz_state_t* st = (qz_state_t*)malloc(sizeof(qz_state_t));
   st->root_buffer_size = 0;
+  st->root_buffer_capacity = 0;
+  st->root_buffer = NULL;
+  st->collect_policy = QZ_COLLECT_COUNT;
+  st->collect_threshold = QZ_COLLECT_THRESHOLD;
+  st->collect_bytes = 0;
+  st->collections = 0;
+  st->trace_ratio = QZ_TRACE_RATIO;
+  st->trace_pending = 0;
+  st->traces = 0;
+  st->collect_budget = 0;
+  st->collect_phase = QZ_PHASE_IDLE;
+  st->collect_index = 0;
+  st->black_base = SIZE_MAX;
+  st->collect_steps = 0;
+  st->trial_roots_size = 0;
+  st->trial_roots_capacity = 0;
+  st->trial_roots = NULL;
+  st->trial_size = 0;
+  st->trial_capacity = 0;
+  st->trial = NULL;
+  st->old_trial_capacity = 0;
+  st->old_trial = NULL;
+  st->trial_moved = 0;
+  st->work_stack_size = 0;
+  st->work_stack_capacity = 0;
+  st->work_stack = NULL;
+  st->white_cells_size = 0;
+  st->white_cells_capacity = 0;
+  st->white_cells = NULL;
+  st->collecting = 0;
+  st->zct_size = 0;
+  st->zct_capacity = 0;
+  st->zct = NULL;
+  st->stack_counted = 0;
+  st->weak_tables_size = 0;
+  st->weak_tables_capacity = 0;
+  st->weak_tables = NULL;
+  st->weak_unrefs_size = 0;
+  st->weak_unrefs_capacity = 0;
+  st->weak_unrefs = NULL;
+  for(size_t i = 0; i < QZ_POOL_COUNT; i++) {
+    st->pools[i].free_list = NULL;
+    st->pools[i].unused = NULL;
+    st->pools[i].unused_end = NULL;
+  }
+  st->slabs = NULL;
+  st->big_cells = NULL;
+  st->cells_allocated = 0;
+  st->cells_freed = 0;
+  st->bytes_allocated = 0;
+  st->slabs_allocated = 0;
+  st->engine = QZ_ENGINE_TREE;
+  st->stack = NULL;
+  st->stack_size = 0;
+  st->stack_capacity = 0;
+  st->frames = NULL;
+  st->frames_size = 0;
+  st->frames_capacity = 0;
   st->safety_buffer_size = 0;
+  st->safety_buffer_capacity = 0;
+  st->safety_buffer_peak = 0;
+  st->safety_buffer = NULL;
   st->peval_fail = NULL;
   st->error_handler = QZ_NONE;
   st->error_obj = QZ_NONE;
-  qz_obj_t toplevel = qz_make_hash();
-  st->env = qz_make_pair(qz_make_pair(toplevel, QZ_NULL), QZ_NULL);
-  /*fprintf(stderr, "toplevel = %p\n", (void*)qz_to_cell(toplevel));*/
-  st->name_sym = qz_make_hash();
+  st->tail_expr = QZ_NONE;
+  st->tail_body = 0;
+  st->tail_scope = QZ_NONE;
+  st->env = qz_make_pair(st, QZ_NULL, QZ_NULL);
+  st->globals = NULL;
+  st->sym_names = NULL;
+  st->globals_capacity = 0;
+  st->name_sym = qz_make_hash(st);
   /*fprintf(stderr, "name_sym = %p\n", (void*)qz_to_cell(st->name_sym));*/
-  st->sym_name = qz_make_hash();
-  /*fprintf(stderr, "sym_name = %p\n", (void*)qz_to_cell(st->sym_name));*/
+  st->strings = qz_make_weak_table(st, QZ_HASH_EQUAL, QZ_WEAK_KEYS);
+  st->shared = qz_make_weak_table(st, QZ_HASH_SHALLOW, QZ_WEAK_KEYS);
   st->input_port = make_port(st, STDIN_FILENO, "r");
   st->output_port = make_port(st, STDOUT_FILENO, "w");
   st->error_port = make_port(st, STDERR_FILENO, "w");
   st->next_sym = 1;
-  st->begin_sym = qz_make_sym(st, qz_make_string("begin"));
-  st->else_sym = qz_make_sym(st, qz_make_string("else"));
-  st->arrow_sym = qz_make_sym(st, qz_make_string("=>"));
-  st->quote_sym = qz_make_sym(st, qz_make_string("quote"));
-  st->quasiquote_sym = qz_make_sym(st, qz_make_string("quasiquote"));
-  st->unquote_sym = qz_make_sym(st, qz_make_string("unquote"));
-  st->unquote_splicing_sym = qz_make_sym(st, qz_make_string("unquote-splicing"));
-  st->args_sym = qz_make_sym(st, qz_make_string("args"));
+  st->free_syms_size = 0;
+  st->free_syms_capacity = 0;
+  st->free_syms = NULL;
+  st->syms_made = 0;
+  st->syms_reclaimed = 0;
+  st->sym_marks = NULL;
+  st->pinned_syms = qz_make_hash(st);
+  st->c_stack_base = NULL;
+  st->begin_sym = qz_make_sym(st, qz_make_string(st, "begin"));
+  st->define_sym = qz_make_sym(st, qz_make_string(st, "define"));
+  st->else_sym = qz_make_sym(st, qz_make_string(st, "else"));
+  st->arrow_sym = qz_make_sym(st, qz_make_string(st, "=>"));
+  st->quote_sym = qz_make_sym(st, qz_make_string(st, "quote"));
+  st->quasiquote_sym = qz_make_sym(st, qz_make_string(st, "quasiquote"));
+  st->unquote_sym = qz_make_sym(st, qz_make_string(st, "unquote"));
+  st->unquote_splicing_sym = qz_make_sym(st, qz_make_string(st, "unquote-splicing"));
+  st->args_sym = qz_make_sym(st, qz_make_string(st, "args"));
 
   for(const qz_named_cfun_t* ncf = QZ_LIB_FUNCTIONS; ncf->cfun; ncf++)
-  {
-    qz_hash_set(st, qz_list_head_ptr(qz_list_head(st->env)),
-        qz_make_sym(st, qz_make_string(ncf->name)), qz_from_cfun(ncf->cfun));
-  }
+    qz_set_global(st, qz_make_sym(st, qz_make_string(st, ncf->name)), qz_from_cfun(ncf->cfun));
+
+  for(const qz_prim_t* prim = QZ_LIB_PRIMS; prim->fun; prim++)
+    qz_set_global(st, qz_make_sym(st, qz_make_string(st, prim->name)), qz_from_prim(prim));
+
+  st->fixed_syms = st->next_sym;
+  st->syms_made = 0;
 
   return st;
 }
@@ -80,14 +159,37 @@ void qz_free(qz_state_t* st)
   qz_unref(st, st->error_obj);
   /*fprintf(stderr, "destroying env...\n");*/
   qz_unref(st, st->env);
+  /*fprintf(stderr, "destroying globals...\n");*/
+  for(size_t i = 0; i < st->globals_capacity; i++)
+    qz_unref(st, st->globals[i]);
   /*fprintf(stderr, "destroying name_sym...\n");*/
   qz_unref(st, st->name_sym);
-  /*fprintf(stderr, "destroying sym_name...\n");*/
-  qz_unref(st, st->sym_name);
+  qz_unref(st, st->pinned_syms);
+  qz_unref(st, st->strings);
+  qz_unref(st, st->shared);
+  /*fprintf(stderr, "destroying sym_names...\n");*/
+  for(size_t i = 0; i < st->globals_capacity; i++)
+    qz_unref(st, st->sym_names[i]);
   qz_unref(st, st->input_port);
   qz_unref(st, st->output_port);
   qz_unref(st, st->error_port);
   qz_collect(st);
+  qz_free_pools(st);
+  free(st->root_buffer);
+  free(st->white_cells);
+  free(st->work_stack);
+  free(st->trial_roots);
+  free(st->trial);
+  free(st->old_trial);
+  free(st->zct);
+  free(st->safety_buffer);
+  free(st->weak_tables);
+  free(st->weak_unrefs);
+  free(st->globals);
+  free(st->sym_names);
+  free(st->free_syms);
+  free(st->stack);
+  free(st->frames);
   free(st);
 }
 
@@ -99,6 +201,12 @@ qz_obj_t qz_peval(qz_state_t* st, qz_obj_t obj)
   st->peval_fail = &peval_fail;
 
   size_t old_safety_buffer_size = st->safety_buffer_size;
+  size_t old_stack_size = st->stack_size;
+  size_t old_frames_size = st->frames_size;
+
+  /* symbols held by the C stack from here on are kept while reclaiming */
+  if(!old_peval_fail)
+    st->c_stack_base = &peval_fail;
 
   /* clear error object */
   qz_unref(st, st->error_obj);
@@ -124,7 +232,7 @@ qz_obj_t qz_peval(qz_state_t* st, qz_obj_t obj)
       st->error_handler = qz_from_cfun(qz_error_handler);
 
       /* call handler */
-      qz_obj_t handler_call = qz_make_pair(qz_ref(st, old_handler), qz_make_pair(st->error_obj, QZ_NULL));
+      qz_obj_t handler_call = qz_make_pair(st, qz_ref(st, old_handler), qz_make_pair(st, st->error_obj, QZ_NULL));
       st->error_obj = QZ_NONE;
       result = qz_peval(st, handler_call);
       qz_unref(st, handler_call);
@@ -134,35 +242,83 @@ qz_obj_t qz_peval(qz_state_t* st, qz_obj_t obj)
     }
 
     /* clean up objects left behind after failure */
+    qz_vm_unwind(st, old_stack_size, old_frames_size);
     cleanup_safety_buffer(st, old_safety_buffer_size);
   }
 
   /* pop state */
   st->peval_fail = old_peval_fail;
+  if(!old_peval_fail)
+    st->c_stack_base = NULL;
 
   return result;
 }
 
-static qz_obj_t call_function(qz_state_t* st, qz_obj_t fun, qz_obj_t args)
+/* create a frame for analyzed code with a slot for each of names
+ * slot 0 holds the number of names n, the values are in slots 1 to n and
+ * a copy of the names follows, so lookups by name still work */
+qz_obj_t qz_make_frame(qz_state_t* st, qz_obj_t names)
 {
-  qz_obj_t env = qz_first(fun);
-  qz_obj_t params = qz_first(qz_rest(fun));
-  qz_obj_t body = qz_rest(qz_rest(fun));
+  QZ_UNUSED(st);
+  size_t n = qz_to_cell(names)->value.array.size;
+  size_t size = 2*n + 1;
 
-  /* create frame */
-  qz_obj_t frame = qz_make_hash();
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_VECTOR, size*sizeof(qz_obj_t));
+  cell->value.array.size = size;
+  cell->value.array.capacity = size;
 
-  while(qz_is_pair(params))
-  {
-    /* grab parameter */
-    qz_obj_t param = qz_first(params);
-    params = qz_to_pair(params)->rest;
+  qz_obj_t* slots = QZ_CELL_DATA(cell, qz_obj_t);
+  slots[0] = qz_from_fixnum(n);
 
-    if(!qz_is_sym(param)) {
-      qz_unref(st, frame);
-      return qz_error(st, "function parameter is not a symbol", &param, NULL);
-    }
+  for(size_t i = 1; i <= n; i++)
+    slots[i] = QZ_NONE;
+
+  /* names are symbols, no references to take */
+  memcpy(slots + n + 1, QZ_CELL_DATA(qz_to_cell(names), qz_obj_t), n*sizeof(qz_obj_t));
 
+  return qz_from_cell(cell);
+}
+
+static qz_obj_t* frame_slots(qz_obj_t frame)
+{
+  return QZ_CELL_DATA(qz_to_cell(frame), qz_obj_t);
+}
+
+/* find the slot for a variable in a single frame
+ * returns NULL if the frame doesn't bind it, or hasn't yet */
+qz_obj_t* qz_frame_get(qz_state_t* st, qz_obj_t frame, qz_obj_t sym)
+{
+  if(qz_is_hash(frame))
+    return qz_hash_get(st, frame, sym);
+
+  qz_obj_t* slots = frame_slots(frame);
+  size_t n = (size_t)qz_to_fixnum(slots[0]);
+  const qz_obj_t* names = slots + n + 1;
+
+  /* later names shadow earlier ones, as with let*
+   * slots hold none until bound, like a key not yet in a hash */
+  for(size_t i = n; i > 0; i--) {
+    if(qz_eq(names[i - 1], sym) && !qz_is_none(slots[i]))
+      return &slots[i];
+  }
+
+  return NULL;
+}
+
+/* bind arguments to a function's parameters
+ * arguments are evaluated in the current environment
+ * returns the scope the function's body is evaluated in */
+qz_obj_t qz_bind_arguments(qz_state_t* st, qz_obj_t fun, qz_obj_t args)
+{
+  qz_obj_t env = qz_first(fun);
+  qz_obj_t params = qz_fun_formals(fun);
+
+  /* create frame, the formals were checked when the function was made */
+  qz_obj_t frame = qz_make_frame(st, qz_fun_code(fun)->names);
+  size_t i = 1;
+
+  for(/**/; qz_is_pair(params); params = qz_rest(params), i++)
+  {
     /* grab argument */
     if(!qz_is_pair(args)) {
       qz_unref(st, frame);
@@ -177,14 +333,10 @@ static qz_obj_t call_function(qz_state_t* st, qz_obj_t fun, qz_obj_t args)
     qz_pop_safety(st, 1);
 
     /* assign argument to parameter */
-    qz_hash_set(st, &frame, param, arg);
+    frame_slots(frame)[i] = arg;
   }
 
-  if(qz_is_null(params))
-  {
-    /* all done */
-  }
-  else if(qz_is_sym(params))
+  if(qz_is_sym(params))
   {
     /* variable parameter, ex. (lambda (a b c . rest) ...) */
     qz_push_safety(st, frame);
@@ -192,63 +344,611 @@ static qz_obj_t call_function(qz_state_t* st, qz_obj_t fun, qz_obj_t args)
     qz_pop_safety(st, 1);
 
     /* assign evaluated arguments list to parameter */
-    qz_hash_set(st, &frame, params, rest_args);
+    frame_slots(frame)[i] = rest_args;
   }
-  else
+
+  return qz_make_pair(st, frame, qz_ref(st, env));
+}
+
+/* the objects a qz_eval loop keeps alive across tail calls
+ * both live in the safety buffer so they're released if an error is thrown */
+typedef struct tail_state {
+  qz_obj_t old_env; /* environment to restore when the loop returns */
+  int reserved; /* nonzero once our slots have been pushed */
+  size_t base; /* index of our slots in the safety buffer */
+} tail_state_t;
+
+#define TAIL_FUN_SLOT 0 /* function whose code is being executed */
+#define TAIL_ENV_SLOT 1 /* environment pushed for that body */
+
+/* the returned pointer is only good until the next push, the safety buffer may move */
+static qz_obj_t* tail_slot(qz_state_t* st, tail_state_t* ts, size_t slot)
+{
+  if(!ts->reserved) {
+    ts->reserved = 1;
+    ts->base = st->safety_buffer_size;
+    qz_push_safety(st, QZ_NONE);
+    qz_push_safety(st, QZ_NONE);
+  }
+  assert(st->safety_buffer_size == ts->base + 2);
+  return &st->safety_buffer[ts->base + slot];
+}
+
+/* replace the object held in one of our slots, stealing a reference */
+static void tail_hold(qz_state_t* st, tail_state_t* ts, size_t slot, qz_obj_t obj)
+{
+  qz_obj_t* held = tail_slot(st, ts, slot);
+  qz_obj_t prev = *held;
+  *held = obj;
+  qz_unref(st, prev);
+}
+
+/* replace the environment pushed by this loop with a new one built from scope */
+static void tail_push_env(qz_state_t* st, tail_state_t* ts, qz_obj_t scope)
+{
+  qz_obj_t env = qz_make_pair(st, scope, qz_ref(st, ts->old_env));
+  /* set st->env first, the previous environment mustn't be current when it's released */
+  st->env = env;
+  tail_hold(st, ts, TAIL_ENV_SLOT, env);
+}
+
+/* release everything held by the loop and restore the environment */
+static qz_obj_t tail_return(qz_state_t* st, tail_state_t* ts, qz_obj_t result)
+{
+  if(ts->reserved) {
+    st->env = ts->old_env;
+    qz_pop_safety(st, 2);
+    qz_unref(st, st->safety_buffer[ts->base + TAIL_ENV_SLOT]);
+    qz_unref(st, st->safety_buffer[ts->base + TAIL_FUN_SLOT]);
+  }
+  return result;
+}
+
+/* take the tail evaluation a special form asked for
+ * returns zero if there's nothing left to evaluate, else sets *obj */
+static int take_tail_request(qz_state_t* st, tail_state_t* ts, qz_obj_t* obj)
+{
+  *obj = st->tail_expr;
+  int body = st->tail_body;
+  qz_obj_t scope = st->tail_scope;
+  st->tail_expr = QZ_NONE;
+  st->tail_scope = QZ_NONE;
+
+  if(!qz_is_none(scope))
+    tail_push_env(st, ts, scope);
+
+  if(body)
   {
-    /* it's not a pair, symbol, or null, hmmm... */
-    qz_unref(st, frame);
-    return qz_error(st, "invalid function formals", &params, NULL);
+    if(qz_is_null(*obj))
+      return 0; /* empty body */
+
+    /* evaluate all but the last expression normally */
+    while(qz_is_pair(qz_rest(*obj))) {
+      qz_unref(st, qz_eval(st, qz_first(*obj)));
+      *obj = qz_rest(*obj);
+    }
+
+    *obj = qz_first(*obj);
   }
 
-  /* push environment with frame */
-  qz_obj_t old_env = st->env;
-  st->env = qz_make_pair(qz_make_pair(frame, qz_ref(st, env)), qz_ref(st, st->env));
-  qz_push_safety(st, st->env);
+  return 1;
+}
 
-  /* execute function */
-  qz_obj_t result = qz_eval(st, body);
+static void push_arg(qz_state_t* st, qz_obj_t obj)
+{
+  if(st->stack_size == st->stack_capacity) {
+    st->stack_capacity = st->stack_capacity ? st->stack_capacity*2 : 64;
+    st->stack = (qz_obj_t*)realloc(st->stack, st->stack_capacity*sizeof(qz_obj_t));
+  }
 
-  /* pop environment */
-  qz_pop_safety(st, 1);
-  qz_unref(st, st->env);
-  st->env = old_env;
+  st->stack[st->stack_size++] = obj;
+}
+
+/* evaluate a list of arguments onto the stack, returning how many there were
+ * the stack doesn't count references, so each value is pushed borrowed */
+static size_t push_args(qz_state_t* st, qz_obj_t args)
+{
+  size_t nargs = 0;
+
+  for(/**/; !qz_is_null(args); nargs++) {
+    qz_obj_t owned;
+    push_arg(st, qz_eval_borrowed(st, qz_required_arg(st, &args), &owned));
+    qz_unref(st, owned);
+  }
+
+  return nargs;
+}
+
+/* call a prim with the nargs values on top of the stack and pop them
+ * if the call fails, the arguments are left for qz_peval to unwind */
+qz_obj_t qz_call_prim(qz_state_t* st, qz_obj_t prim, size_t nargs)
+{
+  const qz_prim_t* p = qz_to_prim(prim);
+  qz_obj_t* argv = st->stack + st->stack_size - nargs;
+
+  qz_check_args(st, p, nargs, argv);
+  qz_obj_t result = p->fun(st, nargs, argv);
+
+  st->stack_size -= nargs;
+
+  if(st->stack_size == 0 && st->frames_size == 0)
+    qz_reconcile(st);
+
+  if(st->trace_pending)
+    qz_collect(st);
+  else if(st->collect_phase != QZ_PHASE_IDLE)
+    qz_collect_step(st);
 
   return result;
 }
 
-qz_obj_t qz_eval(qz_state_t* st, qz_obj_t obj)
+/* call a cfun or prim from analyzed code with unevaluated arguments,
+ * finishing any tail evaluation a cfun asks for */
+qz_obj_t qz_call_cfun(qz_state_t* st, qz_obj_t fun, qz_obj_t args)
 {
-  if(qz_is_pair(obj))
+  if(qz_is_prim(fun))
+    return qz_call_prim(st, fun, push_args(st, args));
+
+  size_t old_safety_buffer_size = st->safety_buffer_size;
+
+  qz_obj_t result = qz_to_cfun(fun)(st, args);
+
+  /* cleanup up objects left behind after clean call */
+  cleanup_safety_buffer(st, old_safety_buffer_size);
+
+  if(qz_is_none(st->tail_expr))
+    return result;
+
+  tail_state_t ts = {st->env, 0, 0};
+  qz_obj_t obj;
+
+  if(!take_tail_request(st, &ts, &obj))
+    return tail_return(st, &ts, QZ_NONE);
+
+  return tail_return(st, &ts, qz_eval(st, obj));
+}
+
+static qz_obj_t* lookup_from(qz_state_t* st, qz_obj_t scope, qz_obj_t sym)
+{
+  for(/**/; !qz_is_null(scope); scope = qz_rest(scope)) {
+    qz_obj_t* slot = qz_frame_get(st, qz_first(scope), sym);
+
+    if(slot)
+      return slot;
+  }
+
+  return qz_lookup_global(st, sym);
+}
+
+/* find the slot of the variable a ref or set node names, NULL if unbound */
+qz_obj_t* qz_find_var(qz_state_t* st, qz_node_t* node)
+{
+  qz_obj_t scope = qz_first(st->env);
+
+  switch(node->type) {
+  case QZ_NT_LOCAL_REF:
+  case QZ_NT_LOCAL_SET:
+    for(size_t i = 0; i < node->depth; i++)
+      scope = qz_rest(scope);
+    return frame_slots(qz_first(scope)) + node->index;
+  case QZ_NT_GLOBAL_REF:
+  case QZ_NT_GLOBAL_SET:
+    return qz_lookup_global(st, node->sym);
+  default:
+    for(size_t i = 0; i < node->depth; i++)
+      scope = qz_rest(scope);
+    return lookup_from(st, scope, node->sym);
+  }
+}
+
+static qz_obj_t exec_node(qz_state_t* st, qz_node_t* node, qz_obj_t fun, qz_obj_t scope);
+
+/* execute a node like qz_eval_borrowed, constants and variables without taking references */
+static qz_obj_t exec_borrowed(qz_state_t* st, qz_node_t* node, qz_obj_t* owned)
+{
+  *owned = QZ_NONE;
+
+  switch(node->type) {
+  case QZ_NT_CONST:
+    return node->obj;
+  case QZ_NT_LOCAL_REF:
+  case QZ_NT_GLOBAL_REF:
+  case QZ_NT_FREE_REF:
+  {
+    qz_obj_t* slot = qz_find_var(st, node);
+
+    if(!slot)
+      return qz_error(st, "unbound variable", &node->sym, NULL);
+
+    return *slot;
+  }
+  default:
+    return *owned = exec_node(st, node, QZ_NONE, QZ_NONE);
+  }
+}
+
+/* execute an argument to a prim onto the stack */
+static void push_node(qz_state_t* st, qz_node_t* node)
+{
+  qz_obj_t owned;
+  push_arg(st, exec_borrowed(st, node, &owned));
+  qz_unref(st, owned);
+}
+
+/* bind the values of a call node's arguments to a function's parameters
+ * returns the scope the function's code is executed in */
+static qz_obj_t bind_values(qz_state_t* st, qz_obj_t fun, qz_node_t* call)
+{
+  qz_obj_t params = qz_fun_formals(fun);
+  size_t i = 1;
+
+  /* create frame, arguments and parameters both start at 1 */
+  qz_obj_t frame = qz_make_frame(st, qz_fun_code(fun)->names);
+
+  for(/**/; qz_is_pair(params); params = qz_rest(params), i++)
   {
-    qz_obj_t fun = qz_eval(st, qz_required_arg(st, &obj));
+    if(i == call->nkids) {
+      qz_unref(st, frame);
+      return qz_error(st, "not enough arguments to function", NULL);
+    }
+
+    qz_push_safety(st, frame);
+    qz_obj_t arg = exec_node(st, call->kids[i], QZ_NONE, QZ_NONE);
+    qz_pop_safety(st, 1);
+
+    /* assign argument to parameter */
+    frame_slots(frame)[i] = arg;
+  }
+
+  size_t rest_slot = i;
 
-    if(qz_is_fun(fun))
+  if(qz_is_sym(params))
+  {
+    /* variable parameter, collect remaining arguments */
+    qz_obj_t rest_args = QZ_NULL;
+    qz_obj_t elem = QZ_NULL;
+
+    for(/**/; i < call->nkids; i++) {
+      qz_push_safety(st, frame);
+      qz_push_safety(st, rest_args);
+      qz_obj_t arg = exec_node(st, call->kids[i], QZ_NONE, QZ_NONE);
+      qz_pop_safety(st, 2);
+
+      qz_obj_t inner_elem = qz_make_pair(st, arg, QZ_NULL);
+      if(qz_is_null(rest_args)) {
+        rest_args = elem = inner_elem;
+      }
+      else {
+        qz_to_pair(elem)->rest = inner_elem;
+        elem = inner_elem;
+      }
+    }
+
+    frame_slots(frame)[rest_slot] = rest_args;
+  }
+
+  return qz_make_pair(st, frame, qz_ref(st, qz_first(fun)));
+}
+
+/* bind a let node's inits in a new frame with the given names, which start with the bindings */
+static qz_obj_t bind_inits(qz_state_t* st, qz_node_t* node, size_t ninits, qz_obj_t names)
+{
+  qz_obj_t frame = qz_make_frame(st, names);
+
+  for(size_t i = 0; i < ninits; i++) {
+    qz_push_safety(st, frame);
+    qz_obj_t value = exec_node(st, node->kids[i], QZ_NONE, QZ_NONE);
+    qz_pop_safety(st, 1);
+
+    frame_slots(frame)[i + 1] = value;
+  }
+
+  return frame;
+}
+
+/* the kid of a case node holding the body of the clause key matches, or 0 if none does */
+size_t qz_case_clause(qz_state_t* st, qz_node_t* node, qz_obj_t key)
+{
+  qz_obj_t clauses = node->obj;
+
+  for(size_t i = 1; i < node->nkids; i++, clauses = qz_rest(clauses)) {
+    qz_obj_t data = qz_first(qz_first(clauses));
+
+    if(qz_eq(data, st->else_sym))
+      return i;
+
+    for(/**/; qz_is_pair(data); data = qz_rest(data)) {
+      if(qz_eqv(qz_first(data), key))
+        return i;
+    }
+  }
+
+  return 0;
+}
+
+/* execute analyzed code in the current environment
+ * if fun isn't none, its code is executed in scope instead, both are stolen */
+static qz_obj_t exec_node(qz_state_t* st, qz_node_t* node, qz_obj_t fun, qz_obj_t scope)
+{
+  tail_state_t ts = {st->env, 0, 0};
+
+  if(!qz_is_none(fun)) {
+    tail_push_env(st, &ts, scope);
+    tail_hold(st, &ts, TAIL_FUN_SLOT, fun);
+    node = qz_fun_code(fun)->body;
+  }
+
+  for(;;)
+  {
+    switch(node->type)
     {
-      qz_push_safety(st, fun);
+    case QZ_NT_CONST:
+      return tail_return(st, &ts, qz_ref(st, node->obj));
+    case QZ_NT_LOCAL_REF:
+    case QZ_NT_GLOBAL_REF:
+    case QZ_NT_FREE_REF:
+    {
+      qz_obj_t* slot = qz_find_var(st, node);
+
+      if(!slot)
+        return qz_error(st, "unbound variable", &node->sym, NULL);
+
+      return tail_return(st, &ts, qz_ref(st, *slot));
+    }
+    case QZ_NT_LOCAL_SET:
+    case QZ_NT_GLOBAL_SET:
+    case QZ_NT_FREE_SET:
+    {
+      qz_obj_t value = exec_node(st, node->kids[0], QZ_NONE, QZ_NONE);
+      qz_obj_t* slot = qz_find_var(st, node);
+
+      if(!slot) {
+        qz_push_safety(st, value);
+        return qz_error(st, "unbound variable in set!", &node->sym, NULL);
+      }
+
+      qz_unref(st, *slot);
+      *slot = value;
+
+      return tail_return(st, &ts, QZ_NONE);
+    }
+    case QZ_NT_DEFINE:
+    {
+      qz_obj_t value = exec_node(st, node->kids[0], QZ_NONE, QZ_NONE);
+      qz_obj_t* slot = frame_slots(qz_first(qz_first(st->env))) + node->index;
+
+      qz_unref(st, *slot);
+      *slot = value;
+
+      return tail_return(st, &ts, QZ_NONE);
+    }
+    case QZ_NT_IF:
+    {
+      qz_obj_t owned;
+      qz_obj_t test = exec_borrowed(st, node->kids[0], &owned);
+      node = qz_eq(test, QZ_FALSE) ? node->kids[2] : node->kids[1];
+      qz_unref(st, owned);
+
+      if(!node)
+        return tail_return(st, &ts, QZ_NONE);
 
-      qz_obj_t result = call_function(st, fun, obj);
+      continue;
+    }
+    case QZ_NT_LAMBDA:
+    {
+      qz_cell_t* cell = qz_make_cell(st, QZ_CT_FUN, 0);
+      cell->value.pair.first = qz_ref(st, qz_first(st->env));
+      cell->value.pair.rest = qz_ref(st, node->obj);
+      return tail_return(st, &ts, qz_from_cell(cell));
+    }
+    case QZ_NT_SEQ:
+    {
+      if(node->nkids == 0)
+        return tail_return(st, &ts, QZ_NONE); /* empty body */
 
-      qz_pop_safety(st, 1);
-      qz_unref(st, fun);
+      /* execute all but the last normally */
+      for(size_t i = 0; i < node->nkids - 1; i++)
+        qz_unref(st, exec_node(st, node->kids[i], QZ_NONE, QZ_NONE));
 
-      return result;
+      node = node->kids[node->nkids - 1];
+      continue;
     }
-    else if(qz_is_cfun(fun))
+    case QZ_NT_AND:
+    case QZ_NT_OR:
     {
-      size_t old_safety_buffer_size = st->safety_buffer_size;
+      int is_and = node->type == QZ_NT_AND;
 
-      qz_obj_t result = qz_to_cfun(fun)(st, obj);
+      if(node->nkids == 0)
+        return tail_return(st, &ts, qz_from_bool(is_and));
 
-      /* cleanup up objects left behind after clean call */
-      cleanup_safety_buffer(st, old_safety_buffer_size);
+      /* all but the last test decide */
+      size_t i = 0;
+      for(/**/; i < node->nkids - 1; i++) {
+        qz_obj_t owned;
+        qz_obj_t result = exec_borrowed(st, node->kids[i], &owned);
 
-      return result;
+        if(qz_eq(result, QZ_FALSE) == is_and)
+          return tail_return(st, &ts, qz_is_none(owned) ? qz_ref(st, result) : owned);
+
+        qz_unref(st, owned);
+      }
+
+      node = node->kids[i];
+      continue;
     }
+    case QZ_NT_CASE:
+    {
+      qz_obj_t owned;
+      qz_obj_t key = exec_borrowed(st, node->kids[0], &owned);
+      size_t i = qz_case_clause(st, node, key);
+      qz_unref(st, owned);
+
+      if(!i)
+        return tail_return(st, &ts, QZ_NONE);
+
+      node = node->kids[i];
+      continue;
+    }
+    case QZ_NT_LET:
+    {
+      size_t ninits = node->nkids - 1;
+      qz_obj_t frame = bind_inits(st, node, ninits, node->names);
+
+      tail_push_env(st, &ts, qz_make_pair(st, frame, qz_ref(st, qz_first(st->env))));
+      node = node->kids[ninits];
+      continue;
+    }
+    case QZ_NT_LET_S:
+    {
+      /* inits are executed with the frame in place */
+      size_t ninits = node->nkids - 1;
+      qz_obj_t frame = qz_make_frame(st, node->names);
+
+      tail_push_env(st, &ts, qz_make_pair(st, frame, qz_ref(st, qz_first(st->env))));
 
-    qz_push_safety(st, fun);
-    return qz_error(st, "uncallable value", &fun, NULL);
+      for(size_t i = 0; i < ninits; i++)
+        frame_slots(frame)[i + 1] = exec_node(st, node->kids[i], QZ_NONE, QZ_NONE);
+
+      node = node->kids[ninits];
+      continue;
+    }
+    case QZ_NT_NAMED_LET:
+    {
+      qz_code_t* code = QZ_CELL_DATA(qz_to_cell(node->obj), qz_code_t);
+      qz_obj_t frame = bind_inits(st, node, node->nkids, code->names);
+
+      /* the function gets a frame of its own binding name, so it can call itself */
+      qz_obj_t fun_frame = qz_make_frame(st, node->names);
+      qz_obj_t fun_scope = qz_make_pair(st, fun_frame, qz_ref(st, qz_first(st->env)));
+
+      qz_cell_t* cell = qz_make_cell(st, QZ_CT_FUN, 0);
+      cell->value.pair.first = qz_ref(st, fun_scope);
+      cell->value.pair.rest = qz_ref(st, node->obj);
+
+      frame_slots(fun_frame)[1] = qz_from_cell(cell);
+
+      /* execute body as the first call */
+      tail_push_env(st, &ts, qz_make_pair(st, frame, fun_scope));
+      node = qz_fun_code(qz_from_cell(cell))->body;
+      continue;
+    }
+    case QZ_NT_CALL:
+    case QZ_NT_FEXPR:
+    {
+      qz_obj_t op = exec_node(st, node->kids[0], QZ_NONE, QZ_NONE);
+
+      if(qz_is_fun(op))
+      {
+        qz_push_safety(st, op);
+        qz_obj_t call_scope = node->type == QZ_NT_CALL
+          ? bind_values(st, op, node)
+          : qz_bind_arguments(st, op, node->obj);
+        qz_pop_safety(st, 1);
+
+        /* continue with the function's code in place of the call
+         * the previously held function may own node, so it's released last */
+        tail_push_env(st, &ts, call_scope);
+        node = qz_fun_code(op)->body;
+        tail_hold(st, &ts, TAIL_FUN_SLOT, op);
+        continue;
+      }
+      else if(qz_is_prim(op) && node->type == QZ_NT_CALL)
+      {
+        for(size_t i = 1; i < node->nkids; i++)
+          push_node(st, node->kids[i]);
+
+        return tail_return(st, &ts, qz_call_prim(st, op, node->nkids - 1));
+      }
+      else if(qz_is_cfun(op) || qz_is_prim(op))
+      {
+        return tail_return(st, &ts, qz_call_cfun(st, op, node->obj));
+      }
+
+      qz_push_safety(st, op);
+      return qz_error(st, "uncallable value", &op, NULL);
+    }
+    }
+
+    assert(0); /* unknown node type */
+    return QZ_NONE;
+  }
+}
+
+qz_obj_t qz_eval(qz_state_t* st, qz_obj_t obj)
+{
+  tail_state_t ts;
+  ts.old_env = st->env;
+  ts.reserved = 0;
+  ts.base = 0;
+
+  for(;;)
+  {
+    if(qz_is_pair(obj))
+    {
+      qz_obj_t fun = qz_eval(st, qz_required_arg(st, &obj));
+
+      if(qz_is_fun(fun))
+      {
+        qz_push_safety(st, fun);
+        qz_obj_t scope = qz_bind_arguments(st, fun, obj);
+        qz_pop_safety(st, 1);
+
+        /* analyzed code continues the tail calls from here */
+        if(st->engine == QZ_ENGINE_VM)
+          return tail_return(st, &ts, qz_vm_run(st, fun, scope));
+
+        return tail_return(st, &ts, exec_node(st, NULL, fun, scope));
+      }
+      else if(qz_is_prim(fun))
+      {
+        return tail_return(st, &ts, qz_call_prim(st, fun, push_args(st, obj)));
+      }
+      else if(qz_is_cfun(fun))
+      {
+        size_t old_safety_buffer_size = st->safety_buffer_size;
+
+        qz_obj_t result = qz_to_cfun(fun)(st, obj);
+
+        /* cleanup up objects left behind after clean call */
+        cleanup_safety_buffer(st, old_safety_buffer_size);
+
+        if(qz_is_none(st->tail_expr))
+          return tail_return(st, &ts, result);
+
+        /* special form asked for a tail evaluation */
+        if(!take_tail_request(st, &ts, &obj))
+          return tail_return(st, &ts, QZ_NONE);
+
+        continue;
+      }
+
+      qz_push_safety(st, fun);
+      return qz_error(st, "uncallable value", &fun, NULL);
+    }
+
+    if(qz_is_sym(obj))
+    {
+      qz_obj_t* slot = qz_lookup(st, obj);
+
+      if(!slot)
+        return qz_error(st, "unbound variable", &obj, NULL);
+
+      return tail_return(st, &ts, qz_ref(st, *slot));
+    }
+
+    if(qz_is_null(obj))
+      return qz_error(st, "cannot evaluate null", NULL);
+
+    if(qz_is_none(obj))
+      return qz_error(st, "cannot evaluate unspecified value", NULL);
+
+    return tail_return(st, &ts, qz_ref(st, obj));
   }
+}
+
+qz_obj_t qz_eval_borrowed(qz_state_t* st, qz_obj_t obj, qz_obj_t* owned)
+{
+  *owned = QZ_NONE;
 
   if(qz_is_sym(obj))
   {
@@ -257,33 +957,50 @@ qz_obj_t qz_eval(qz_state_t* st, qz_obj_t obj)
     if(!slot)
       return qz_error(st, "unbound variable", &obj, NULL);
 
-    return qz_ref(st, *slot);
+    return *slot;
   }
 
-  if(qz_is_null(obj))
-    return qz_error(st, "cannot evaluate null", NULL);
+  /* calls and the errors for null and none are left to qz_eval */
+  if(qz_is_pair(obj) || qz_is_null(obj) || qz_is_none(obj))
+    return *owned = qz_eval(st, obj);
 
-  if(qz_is_none(obj))
-    return qz_error(st, "cannot evaluate unspecified value", NULL);
-
-  return qz_ref(st, obj);
+  return obj;
 }
 
-qz_obj_t* qz_lookup(qz_state_t* st, qz_obj_t sym)
+qz_obj_t qz_tail_eval(qz_state_t* st, qz_obj_t expr)
 {
-  qz_pair_t* scope = qz_to_pair(qz_list_head(st->env));
+  assert(qz_is_none(st->tail_expr));
+  st->tail_expr = expr;
+  st->tail_body = 0;
+  return QZ_NONE;
+}
 
-  for(;;) {
-    qz_obj_t* slot = qz_hash_get(st, scope->first, sym);
+qz_obj_t qz_tail_body(qz_state_t* st, qz_obj_t body, qz_obj_t scope)
+{
+  assert(qz_is_none(st->tail_expr));
+  st->tail_expr = body;
+  st->tail_body = 1;
+  st->tail_scope = scope;
+  return QZ_NONE;
+}
 
-    if(slot)
-      return slot;
+qz_obj_t* qz_lookup(qz_state_t* st, qz_obj_t sym)
+{
+  return lookup_from(st, qz_list_head(st->env), sym);
+}
 
-    if(qz_is_null(scope->rest))
-      return NULL;
+qz_obj_t* qz_lookup_global(qz_state_t* st, qz_obj_t sym)
+{
+  qz_obj_t* slot = st->globals + qz_to_sym(sym);
+  return qz_is_none(*slot) ? NULL : slot;
+}
 
-    scope = qz_to_pair(scope->rest);
-  }
+void qz_set_global(qz_state_t* st, qz_obj_t sym, qz_obj_t value)
+{
+  qz_obj_t* slot = st->globals + qz_to_sym(sym);
+  qz_obj_t old_value = *slot;
+  *slot = value;
+  qz_unref(st, old_value);
 }
 
 qz_obj_t qz_error(qz_state_t* st, const char* msg, ...)
@@ -292,7 +1009,7 @@ qz_obj_t qz_error(qz_state_t* st, const char* msg, ...)
   va_start(ap, msg);
 
   qz_obj_t irritants = QZ_NULL;
-  qz_obj_t elem;
+  qz_obj_t elem = QZ_NULL;
 
   for(;;) {
     qz_obj_t* obj = va_arg(ap, qz_obj_t*);
@@ -300,7 +1017,7 @@ qz_obj_t qz_error(qz_state_t* st, const char* msg, ...)
     if(!obj)
       break;
 
-    qz_obj_t inner_elem = qz_make_pair(qz_ref(st, *obj), QZ_NULL);
+    qz_obj_t inner_elem = qz_make_pair(st, qz_ref(st, *obj), QZ_NULL);
     if(qz_is_null(irritants)) {
       irritants = elem = inner_elem;
     }
@@ -312,8 +1029,8 @@ qz_obj_t qz_error(qz_state_t* st, const char* msg, ...)
 
   va_end(ap);
 
-  qz_cell_t* cell = qz_make_cell(QZ_CT_ERROR, 0);
-  cell->value.pair.first = qz_make_string(msg);
+  qz_cell_t* cell = qz_make_cell(st, QZ_CT_ERROR, 0);
+  cell->value.pair.first = qz_make_string(st, msg);
   cell->value.pair.rest = irritants;
 
   st->error_obj = qz_from_cell(cell);
@@ -323,8 +1040,15 @@ qz_obj_t qz_error(qz_state_t* st, const char* msg, ...)
 
 void qz_push_safety(qz_state_t* st, qz_obj_t obj)
 {
-  assert(st->safety_buffer_size < QZ_SAFETY_BUFFER_CAPACITY);
+  if(st->safety_buffer_size == st->safety_buffer_capacity) {
+    st->safety_buffer_capacity = st->safety_buffer_capacity ? st->safety_buffer_capacity*2 : 64;
+    st->safety_buffer = (qz_obj_t*)realloc(st->safety_buffer, st->safety_buffer_capacity*sizeof(qz_obj_t));
+  }
+
   st->safety_buffer[st->safety_buffer_size++] = obj;
+
+  if(st->safety_buffer_size > st->safety_buffer_peak)
+    st->safety_buffer_peak = st->safety_buffer_size;
 }
 
 void qz_pop_safety(qz_state_t* st, size_t nobj)
@@ -3,52 +3,57 @@
 #include <stdarg.h>
 #include <string.h>
 
-static const char* type_name(char t)
+static const char* type_name(uint32_t mask)
 {
-  switch(t) {
-  case 'a': return "any";
-  case 'i': return "fixnum";
-  case 'f': return "cfun";
-  case 'n': return "sym";
-  case 'b': return "bool";
-  case 'c': return "char";
-  case 'p': return "pair";
-  case 'g': return "fun";
-  case 'q': return "promise";
-  case 'e': return "error";
-  case 's': return "string";
-  case 'v': return "vector";
-  case 'w': return "bytevector";
-  case 'h': return "hash";
-  case 't': return "record";
-  case 'd': return "port";
-  case 'r': return "real";
+  switch(mask) {
+  case QZ_T_ANY: return "any";
+  case QZ_T_FIXNUM: return "fixnum";
+  case QZ_T_CFUN: return "cfun";
+  case QZ_T_SYM: return "sym";
+  case QZ_T_BOOL: return "bool";
+  case QZ_T_CHAR: return "char";
+  case QZ_T_PAIR: return "pair";
+  case QZ_T_FUN: return "fun";
+  case QZ_T_PROMISE: return "promise";
+  case QZ_T_ERROR: return "error";
+  case QZ_T_STRING: return "string";
+  case QZ_T_VECTOR: return "vector";
+  case QZ_T_BYTEVECTOR: return "bytevector";
+  case QZ_T_HASH: return "hash";
+  case QZ_T_RECORD: return "record";
+  case QZ_T_PORT: return "port";
+  case QZ_T_REAL: return "real";
+  case QZ_T_TABLE: return "hash table";
+  case QZ_T_HAMT: return "hash map";
   }
 
   assert(0);
   return "unknown";
 }
 
-static int is_type(qz_obj_t obj, char t)
+/* the type mask for a qz_get_args type specifier */
+static uint32_t spec_type(char t)
 {
   switch(t) {
-  case 'a': return !qz_is_none(obj);
-  case 'i': return qz_is_fixnum(obj);
-  case 'f': return qz_is_cfun(obj);
-  case 'n': return qz_is_sym(obj);
-  case 'b': return qz_is_bool(obj);
-  case 'c': return qz_is_char(obj);
-  case 'p': return qz_is_pair(obj);
-  case 'g': return qz_is_fun(obj);
-  case 'q': return qz_is_promise(obj);
-  case 'e': return qz_is_error(obj);
-  case 's': return qz_is_string(obj);
-  case 'v': return qz_is_vector(obj);
-  case 'w': return qz_is_bytevector(obj);
-  case 'h': return qz_is_hash(obj);
-  case 't': return qz_is_record(obj);
-  case 'd': return qz_is_port(obj);
-  case 'r': return qz_is_real(obj);
+  case 'a': return QZ_T_ANY;
+  case 'i': return QZ_T_FIXNUM;
+  case 'f': return QZ_T_CFUN;
+  case 'n': return QZ_T_SYM;
+  case 'b': return QZ_T_BOOL;
+  case 'c': return QZ_T_CHAR;
+  case 'p': return QZ_T_PAIR;
+  case 'g': return QZ_T_FUN;
+  case 'q': return QZ_T_PROMISE;
+  case 'e': return QZ_T_ERROR;
+  case 's': return QZ_T_STRING;
+  case 'v': return QZ_T_VECTOR;
+  case 'w': return QZ_T_BYTEVECTOR;
+  case 'h': return QZ_T_HASH;
+  case 't': return QZ_T_RECORD;
+  case 'd': return QZ_T_PORT;
+  case 'r': return QZ_T_REAL;
+  case 'm': return QZ_T_TABLE;
+  case 'k': return QZ_T_HAMT;
   }
 
   assert(0);
@@ -65,7 +70,7 @@ void qz_get_args(qz_state_t* st, qz_obj_t* args, const char* spec, ...)
   {
     qz_obj_t* obj = va_arg(ap, qz_obj_t*);
 
-    int type_char = *s++;
+    uint32_t type = spec_type(*s++);
     int eval = (*s == '~') ? (s++, 0) : 1;
     int optional = (*s == '?') ? (s++, 1) : 0;
 
@@ -86,9 +91,9 @@ void qz_get_args(qz_state_t* st, qz_obj_t* args, const char* spec, ...)
       nargs++;
 
       /* check argument type */
-      if(!is_type(*obj, type_char)) {
+      if(!(qz_type_bit(*obj) & type)) {
         char msg[64];
-        sprintf(msg, "expected %s at argument %ld", type_name(type_char), nargs);
+        sprintf(msg, "expected %s at argument %zu", type_name(type), nargs);
         qz_error(st, msg, obj, NULL);
       }
     }
@@ -99,7 +104,7 @@ void qz_get_args(qz_state_t* st, qz_obj_t* args, const char* spec, ...)
         continue; /* missing optional argument */
       }
       char msg[64];
-      sprintf(msg, "missing %s at argument %ld", type_name(type_char), nargs);
+      sprintf(msg, "missing %s at argument %zu", type_name(type), nargs);
       qz_error(st, msg, NULL);
     }
     else {
@@ -111,10 +116,37 @@ void qz_get_args(qz_state_t* st, qz_obj_t* args, const char* spec, ...)
   va_end(ap);
 }
 
+void qz_check_args(qz_state_t* st, const qz_prim_t* prim, size_t argc, qz_obj_t* argv)
+{
+  if(argc > prim->max_args)
+    qz_error(st, "too many arguments", &argv[prim->max_args], NULL);
+
+  const uint32_t* type = prim->types;
+  const uint32_t* last_type = prim->types + QZ_PRIM_TYPES - 1;
+
+  for(size_t i = 0; i < argc; i++) {
+    if(!(qz_type_bit(argv[i]) & *type)) {
+      char msg[64];
+      sprintf(msg, "expected %s at argument %zu", type_name(*type), i + 1);
+      qz_error(st, msg, &argv[i], NULL);
+    }
+
+    /* the last type covers the remaining arguments */
+    if(type != last_type && type[1])
+      type++;
+  }
+
+  if(argc < prim->min_args) {
+    char msg[64];
+    sprintf(msg, "missing %s at argument %zu", type_name(*type), argc + 1);
+    qz_error(st, msg, NULL);
+  }
+}
+
 qz_obj_t qz_eval_list(qz_state_t* st, qz_obj_t list)
 {
   qz_obj_t result = QZ_NULL;
-  qz_obj_t elem;
+  qz_obj_t elem = QZ_NULL;
 
   while(qz_is_pair(list)) {
     /* grab argument */
@@ -127,7 +159,7 @@ qz_obj_t qz_eval_list(qz_state_t* st, qz_obj_t list)
     qz_pop_safety(st, 1);
 
     /* append to result */
-    inner_elem = qz_make_pair(inner_elem, QZ_NULL);
+    inner_elem = qz_make_pair(st, inner_elem, QZ_NULL);
     if(qz_is_null(result)) {
       result = elem = inner_elem;
     }
@@ -0,0 +1,746 @@
+#include "quuz.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* quuz-lib.c */
+qz_obj_t qz_apply(qz_state_t* st, size_t argc, qz_obj_t* argv);
+
+/* quuz-state.c */
+qz_obj_t qz_bind_arguments(qz_state_t* st, qz_obj_t fun, qz_obj_t args);
+qz_obj_t qz_call_cfun(qz_state_t* st, qz_obj_t fun, qz_obj_t args);
+qz_obj_t qz_call_prim(qz_state_t* st, qz_obj_t prim, size_t nargs);
+size_t qz_case_clause(qz_state_t* st, qz_node_t* node, qz_obj_t key);
+qz_obj_t* qz_find_var(qz_state_t* st, qz_node_t* node);
+qz_obj_t qz_make_frame(qz_state_t* st, qz_obj_t names);
+
+/* Analyzed code is compiled to a flat array of words, an opcode followed by its operands.
+ * Values live on st->stack and calls push st->frames instead of recursing in C,
+ * only cfuns (which get their arguments unevaluated) still nest. */
+
+#define VM_OPS(X) \
+  X(PUSH) /* obj: push it */ \
+  X(REF) /* node: push a variable's value */ \
+  X(SET) /* node: set a variable to the value on top, leaving none */ \
+  X(DEFINE) /* node: bind the value on top in the innermost frame, leaving none */ \
+  X(POP) \
+  X(JUMP) /* target */ \
+  X(JUMP_FALSE) /* target: pop, jumping if false */ \
+  X(AND_JUMP) /* target: jump if false keeping it, else pop */ \
+  X(OR_JUMP) /* target: jump if not false keeping it, else pop */ \
+  X(CASE) /* node, a target per clause, target: pop the key, jumping to the clause it matches or the last target */ \
+  X(LAMBDA) /* node: push a closure */ \
+  X(LET) /* node: pop the inits into a new frame and enter it */ \
+  X(LET_S) /* node: enter a new empty frame */ \
+  X(BIND) /* slot: pop into the innermost frame */ \
+  X(LEAVE) /* leave the frame entered by LET or LET_S */ \
+  X(NAMED_FUN) /* node: push the function of a named let */ \
+  X(FEXPR_CHECK) /* node, target: if the operator on top is a cfun, replace it with its result and jump */ \
+  X(FEXPR) /* node: call the operator on top with unevaluated arguments */ \
+  X(TAIL_FEXPR) /* node */ \
+  X(CALL) /* nargs: call the operator below the arguments */ \
+  X(TAIL_CALL) /* nargs */ \
+  X(RETURN)
+
+#define VM_ENUM(op) OP_##op,
+enum { VM_OPS(VM_ENUM) };
+
+/******************************************************************************
+ * compiler
+ ******************************************************************************/
+
+typedef struct compiler {
+  size_t* insns;
+  size_t size;
+  size_t capacity;
+} compiler_t;
+
+static size_t emit(compiler_t* c, size_t word)
+{
+  if(c->size == c->capacity) {
+    c->capacity = c->capacity ? c->capacity*2 : 32;
+    c->insns = (size_t*)realloc(c->insns, c->capacity*sizeof(size_t));
+  }
+
+  c->insns[c->size] = word;
+  return c->size++;
+}
+
+static void emit_node(compiler_t* c, size_t op, qz_node_t* node)
+{
+  emit(c, op);
+  emit(c, (size_t)node);
+}
+
+/* emit a jump, returns where to patch in the target */
+static size_t emit_jump(compiler_t* c, size_t op)
+{
+  emit(c, op);
+  return emit(c, 0);
+}
+
+/* point a jump at the next instruction */
+static void patch(compiler_t* c, size_t at)
+{
+  c->insns[at] = c->size;
+}
+
+static void compile(compiler_t* c, qz_node_t* node, int tail);
+
+/* compile a call, the operator is already pushed */
+static void compile_call(compiler_t* c, qz_node_t* node, size_t first_arg, int tail)
+{
+  for(size_t i = first_arg; i < node->nkids; i++)
+    compile(c, node->kids[i], 0);
+
+  emit(c, tail ? OP_TAIL_CALL : OP_CALL);
+  emit(c, node->nkids - first_arg);
+}
+
+static void compile(compiler_t* c, qz_node_t* node, int tail)
+{
+  switch(node->type)
+  {
+  case QZ_NT_CONST:
+    emit(c, OP_PUSH);
+    emit(c, node->obj.value);
+    break;
+  case QZ_NT_LOCAL_REF:
+  case QZ_NT_GLOBAL_REF:
+  case QZ_NT_FREE_REF:
+    emit_node(c, OP_REF, node);
+    break;
+  case QZ_NT_LOCAL_SET:
+  case QZ_NT_GLOBAL_SET:
+  case QZ_NT_FREE_SET:
+    compile(c, node->kids[0], 0);
+    emit_node(c, OP_SET, node);
+    break;
+  case QZ_NT_DEFINE:
+    compile(c, node->kids[0], 0);
+    emit_node(c, OP_DEFINE, node);
+    break;
+  case QZ_NT_IF:
+  {
+    compile(c, node->kids[0], 0);
+    size_t alternate = emit_jump(c, OP_JUMP_FALSE);
+
+    if(node->kids[1]) {
+      compile(c, node->kids[1], tail);
+    }
+    else {
+      emit(c, OP_PUSH);
+      emit(c, QZ_NONE.value);
+      if(tail)
+        emit(c, OP_RETURN);
+    }
+
+    /* a branch in tail position returns by itself */
+    size_t end = tail ? 0 : emit_jump(c, OP_JUMP);
+    patch(c, alternate);
+
+    if(node->kids[2]) {
+      compile(c, node->kids[2], tail);
+    }
+    else {
+      emit(c, OP_PUSH);
+      emit(c, QZ_NONE.value);
+      if(tail)
+        emit(c, OP_RETURN);
+    }
+
+    if(!tail)
+      patch(c, end);
+
+    return;
+  }
+  case QZ_NT_LAMBDA:
+    emit_node(c, OP_LAMBDA, node);
+    break;
+  case QZ_NT_SEQ:
+    if(node->nkids == 0) {
+      emit(c, OP_PUSH);
+      emit(c, QZ_NONE.value);
+      break;
+    }
+
+    for(size_t i = 0; i < node->nkids - 1; i++) {
+      compile(c, node->kids[i], 0);
+      emit(c, OP_POP);
+    }
+
+    compile(c, node->kids[node->nkids - 1], tail);
+    return;
+  case QZ_NT_AND:
+  case QZ_NT_OR:
+  {
+    int is_and = node->type == QZ_NT_AND;
+
+    if(node->nkids == 0) {
+      emit(c, OP_PUSH);
+      emit(c, qz_from_bool(is_and).value);
+      break;
+    }
+
+    /* all but the last test decide, jumping to the end */
+    size_t* ends = (size_t*)malloc(node->nkids*sizeof(size_t));
+
+    for(size_t i = 0; i < node->nkids - 1; i++) {
+      compile(c, node->kids[i], 0);
+      ends[i] = emit_jump(c, is_and ? OP_AND_JUMP : OP_OR_JUMP);
+    }
+
+    compile(c, node->kids[node->nkids - 1], tail);
+
+    for(size_t i = 0; i < node->nkids - 1; i++)
+      patch(c, ends[i]);
+
+    free(ends);
+    break;
+  }
+  case QZ_NT_CASE:
+  {
+    compile(c, node->kids[0], 0);
+    emit_node(c, OP_CASE, node);
+
+    size_t targets = c->size;
+    for(size_t i = 0; i < node->nkids; i++)
+      emit(c, 0);
+
+    /* clauses not in tail position jump to the end */
+    size_t* ends = (size_t*)malloc(node->nkids*sizeof(size_t));
+
+    for(size_t i = 1; i < node->nkids; i++) {
+      patch(c, targets + i - 1);
+      compile(c, node->kids[i], tail);
+      if(!tail)
+        ends[i - 1] = emit_jump(c, OP_JUMP);
+    }
+
+    /* no clause matched */
+    patch(c, targets + node->nkids - 1);
+    emit(c, OP_PUSH);
+    emit(c, QZ_NONE.value);
+
+    for(size_t i = 1; !tail && i < node->nkids; i++)
+      patch(c, ends[i - 1]);
+
+    free(ends);
+    break;
+  }
+  case QZ_NT_LET:
+    for(size_t i = 0; i < node->nkids - 1; i++)
+      compile(c, node->kids[i], 0);
+
+    emit_node(c, OP_LET, node);
+    compile(c, node->kids[node->nkids - 1], tail);
+
+    if(!tail)
+      emit(c, OP_LEAVE);
+
+    return;
+  case QZ_NT_LET_S:
+  {
+    emit_node(c, OP_LET_S, node);
+
+    for(size_t i = 0; i < node->nkids - 1; i++) {
+      compile(c, node->kids[i], 0);
+      emit(c, OP_BIND);
+      emit(c, i + 1);
+    }
+
+    compile(c, node->kids[node->nkids - 1], tail);
+
+    if(!tail)
+      emit(c, OP_LEAVE);
+
+    return;
+  }
+  case QZ_NT_NAMED_LET:
+    /* the inits become arguments to a call */
+    emit_node(c, OP_NAMED_FUN, node);
+    compile_call(c, node, 0, tail);
+    return;
+  case QZ_NT_CALL:
+  {
+    compile(c, node->kids[0], 0);
+
+    /* cfuns take the unevaluated arguments instead */
+    emit_node(c, OP_FEXPR_CHECK, node);
+    size_t after = emit(c, 0);
+
+    compile_call(c, node, 1, tail);
+    patch(c, after);
+    break;
+  }
+  case QZ_NT_FEXPR:
+    compile(c, node->kids[0], 0);
+    emit_node(c, tail ? OP_TAIL_FEXPR : OP_FEXPR, node);
+    break;
+  }
+
+  if(tail)
+    emit(c, OP_RETURN);
+}
+
+static const size_t* insns_of(qz_obj_t fun)
+{
+  qz_code_t* code = qz_fun_code(fun);
+
+  if(!code->insns) {
+    compiler_t c = {NULL, 0, 0};
+    compile(&c, code->body, 1);
+    code->insns = c.insns;
+  }
+
+  return code->insns;
+}
+
+/******************************************************************************
+ * vm
+ ******************************************************************************/
+
+static void push(qz_state_t* st, qz_obj_t obj)
+{
+  if(st->stack_size == st->stack_capacity) {
+    st->stack_capacity = st->stack_capacity ? st->stack_capacity*2 : 64;
+    st->stack = (qz_obj_t*)realloc(st->stack, st->stack_capacity*sizeof(qz_obj_t));
+  }
+
+  st->stack[st->stack_size++] = obj;
+}
+
+static qz_obj_t* top(qz_state_t* st)
+{
+  assert(st->stack_size > 0);
+  return &st->stack[st->stack_size - 1];
+}
+
+static qz_frame_t* top_frame(qz_state_t* st)
+{
+  assert(st->frames_size > 0);
+  return &st->frames[st->frames_size - 1];
+}
+
+/* enter a function's frame, stealing scope, the frame's reference to fun isn't counted */
+static void push_frame(qz_state_t* st, qz_obj_t fun, qz_obj_t scope)
+{
+  if(st->frames_size == st->frames_capacity) {
+    st->frames_capacity = st->frames_capacity ? st->frames_capacity*2 : 16;
+    st->frames = (qz_frame_t*)realloc(st->frames, st->frames_capacity*sizeof(qz_frame_t));
+  }
+
+  qz_frame_t* f = &st->frames[st->frames_size++];
+  f->fun = fun;
+  f->old_env = st->env;
+  f->env = qz_make_pair(st, scope, qz_ref(st, st->env));
+  f->pc = NULL;
+  f->base = st->stack_size;
+  st->env = f->env;
+}
+
+/* replace the current frame's function, stealing scope */
+static void replace_frame(qz_state_t* st, qz_obj_t fun, qz_obj_t scope)
+{
+  qz_frame_t* f = top_frame(st);
+  assert(st->stack_size == f->base);
+
+  qz_obj_t old_env = f->env;
+
+  f->fun = fun;
+  f->env = qz_make_pair(st, scope, qz_ref(st, f->old_env));
+  /* set st->env first, the previous environment mustn't be current when it's released */
+  st->env = f->env;
+
+  qz_unref(st, old_env);
+}
+
+static void pop_frame(qz_state_t* st)
+{
+  qz_frame_t* f = top_frame(st);
+  st->env = f->old_env;
+  st->frames_size--;
+  qz_unref(st, f->env);
+}
+
+static qz_obj_t* frame_slots(qz_obj_t frame)
+{
+  return QZ_CELL_DATA(qz_to_cell(frame), qz_obj_t);
+}
+
+/* the innermost frame of the current environment */
+static qz_obj_t* inner_slots(qz_state_t* st)
+{
+  return frame_slots(qz_first(qz_first(st->env)));
+}
+
+/* enter a new frame of the current function */
+static void enter_scope(qz_state_t* st, qz_obj_t frame)
+{
+  qz_frame_t* f = top_frame(st);
+  qz_obj_t old_env = f->env;
+
+  f->env = qz_make_pair(st, qz_make_pair(st, frame, qz_ref(st, qz_first(old_env))), qz_ref(st, old_env));
+  st->env = f->env;
+
+  qz_unref(st, old_env);
+}
+
+static void leave_scope(qz_state_t* st)
+{
+  qz_frame_t* f = top_frame(st);
+  qz_obj_t old_env = f->env;
+
+  f->env = qz_ref(st, qz_rest(old_env));
+  st->env = f->env;
+
+  qz_unref(st, old_env);
+}
+
+/* bind the nargs values on top of the stack to a function's parameters
+ * returns the scope the function's code is executed in */
+static qz_obj_t bind_stack(qz_state_t* st, qz_obj_t fun, size_t nargs)
+{
+  qz_obj_t params = qz_fun_formals(fun);
+  qz_obj_t* args = st->stack + st->stack_size - nargs;
+  size_t i = 0;
+
+  for(/**/; qz_is_pair(params); params = qz_rest(params), i++)
+  {
+    if(i == nargs)
+      qz_error(st, "not enough arguments to function", NULL);
+  }
+
+  /* arguments are all there, move them into a new frame */
+  qz_obj_t frame = qz_make_frame(st, qz_fun_code(fun)->names);
+  qz_obj_t* slots = frame_slots(frame);
+
+  params = qz_fun_formals(fun);
+  i = 0;
+
+  for(/**/; qz_is_pair(params); params = qz_rest(params), i++)
+    slots[i + 1] = qz_ref(st, args[i]);
+
+  if(qz_is_sym(params))
+  {
+    /* variable parameter, collect remaining arguments */
+    qz_obj_t rest_args = QZ_NULL;
+
+    for(size_t j = nargs; j > i; j--)
+      rest_args = qz_make_pair(st, qz_ref(st, args[j - 1]), rest_args);
+
+    slots[i + 1] = rest_args;
+  }
+
+  /* extra arguments are just dropped, the stack didn't count them */
+  st->stack_size -= nargs;
+
+  return qz_make_pair(st, frame, qz_ref(st, qz_first(fun)));
+}
+
+/* turn a call of apply on the stack into a call of the procedure it's given,
+ * with the elements of its last argument as the last arguments
+ * returns the number of arguments the procedure gets */
+static size_t spread_apply(qz_state_t* st, qz_obj_t apply, size_t nargs)
+{
+  qz_obj_t* argv = st->stack + st->stack_size - nargs;
+  qz_check_args(st, qz_to_prim(apply), nargs, argv);
+
+  qz_obj_t list = argv[nargs - 1];
+
+  for(qz_obj_t elem = list; !qz_is_null(elem); elem = qz_rest(elem)) {
+    if(!qz_is_pair(elem))
+      qz_error(st, "expected list", &list, NULL);
+  }
+
+  /* the procedure and the other arguments move down over apply, the list's elements replace it */
+  memmove(argv - 1, argv, (nargs - 1)*sizeof(qz_obj_t));
+  st->stack_size -= 2;
+  nargs -= 2;
+
+  for(qz_obj_t elem = list; !qz_is_null(elem); elem = qz_rest(elem), nargs++)
+    push(st, qz_first(elem));
+
+  return nargs;
+}
+
+qz_obj_t qz_vm_run(qz_state_t* st, qz_obj_t fun, qz_obj_t scope)
+{
+#ifdef __GNUC__
+# define VM_LABEL(op) __extension__ &&op_##op,
+  static void* const labels[] = { VM_OPS(VM_LABEL) };
+# define VM_CASE(op) op_##op
+# define VM_NEXT __extension__ ({ goto *labels[*pc++]; })
+#else
+# define VM_CASE(op) case OP_##op
+# define VM_NEXT goto dispatch
+#endif
+
+#define VM_OPERAND (*pc++)
+#define VM_NODE ((qz_node_t*)VM_OPERAND)
+#define VM_JUMP(target) (pc = insns + (target))
+
+  size_t entry_frames_size = st->frames_size;
+
+  push_frame(st, fun, scope);
+  qz_unref(st, fun);
+  const size_t* insns = insns_of(fun);
+  const size_t* pc = insns;
+
+#ifdef __GNUC__
+  VM_NEXT;
+#else
+dispatch:
+  switch(*pc++) {
+#endif
+
+  VM_CASE(PUSH):
+  {
+    qz_obj_t obj = { VM_OPERAND };
+    push(st, obj);
+    VM_NEXT;
+  }
+  VM_CASE(REF):
+  {
+    qz_node_t* node = VM_NODE;
+    qz_obj_t* slot = qz_find_var(st, node);
+
+    if(!slot)
+      return qz_error(st, "unbound variable", &node->sym, NULL);
+
+    push(st, *slot);
+    VM_NEXT;
+  }
+  VM_CASE(SET):
+  {
+    qz_node_t* node = VM_NODE;
+    qz_obj_t* slot = qz_find_var(st, node);
+
+    if(!slot)
+      return qz_error(st, "unbound variable in set!", &node->sym, NULL);
+
+    /* the value stays on the stack until it's counted */
+    qz_unref(st, *slot);
+    *slot = qz_ref(st, *top(st));
+    *top(st) = QZ_NONE;
+    VM_NEXT;
+  }
+  VM_CASE(DEFINE):
+  {
+    qz_obj_t* slot = inner_slots(st) + VM_NODE->index;
+    qz_unref(st, *slot);
+    *slot = qz_ref(st, *top(st));
+    *top(st) = QZ_NONE;
+    VM_NEXT;
+  }
+  VM_CASE(POP):
+    st->stack_size--;
+    VM_NEXT;
+  VM_CASE(JUMP):
+    VM_JUMP(*pc);
+    VM_NEXT;
+  VM_CASE(JUMP_FALSE):
+  {
+    qz_obj_t test = st->stack[--st->stack_size];
+    size_t target = VM_OPERAND;
+
+    if(qz_eq(test, QZ_FALSE))
+      VM_JUMP(target);
+
+    VM_NEXT;
+  }
+  VM_CASE(AND_JUMP):
+  VM_CASE(OR_JUMP):
+  {
+    int is_and = pc[-1] == OP_AND_JUMP;
+    size_t target = VM_OPERAND;
+
+    if(qz_eq(*top(st), QZ_FALSE) == is_and)
+      VM_JUMP(target);
+    else
+      st->stack_size--;
+
+    VM_NEXT;
+  }
+  VM_CASE(CASE):
+  {
+    qz_node_t* node = VM_NODE;
+    size_t i = qz_case_clause(st, node, *top(st));
+    st->stack_size--;
+
+    VM_JUMP(pc[i ? i - 1 : node->nkids - 1]);
+    VM_NEXT;
+  }
+  VM_CASE(LAMBDA):
+  {
+    qz_cell_t* cell = qz_make_cell(st, QZ_CT_FUN, 0);
+    cell->value.pair.first = qz_ref(st, qz_first(st->env));
+    cell->value.pair.rest = qz_ref(st, VM_NODE->obj);
+    push(st, qz_from_cell(cell));
+    qz_unref(st, qz_from_cell(cell));
+    VM_NEXT;
+  }
+  VM_CASE(LET):
+  {
+    qz_node_t* node = VM_NODE;
+    size_t ninits = node->nkids - 1;
+    qz_obj_t* inits = st->stack + st->stack_size - ninits;
+
+    qz_obj_t frame = qz_make_frame(st, node->names);
+
+    for(size_t i = 0; i < ninits; i++)
+      frame_slots(frame)[i + 1] = qz_ref(st, inits[i]);
+
+    st->stack_size -= ninits;
+    enter_scope(st, frame);
+    VM_NEXT;
+  }
+  VM_CASE(LET_S):
+    enter_scope(st, qz_make_frame(st, VM_NODE->names));
+    VM_NEXT;
+  VM_CASE(BIND):
+  {
+    inner_slots(st)[VM_OPERAND] = qz_ref(st, *top(st));
+    st->stack_size--;
+    VM_NEXT;
+  }
+  VM_CASE(LEAVE):
+    leave_scope(st);
+    VM_NEXT;
+  VM_CASE(NAMED_FUN):
+  {
+    qz_node_t* node = VM_NODE;
+
+    /* the function gets a frame of its own binding name, so it can call itself */
+    qz_obj_t fun_frame = qz_make_frame(st, node->names);
+    qz_obj_t fun_scope = qz_make_pair(st, fun_frame, qz_ref(st, qz_first(st->env)));
+
+    qz_cell_t* cell = qz_make_cell(st, QZ_CT_FUN, 0);
+    cell->value.pair.first = fun_scope;
+    cell->value.pair.rest = qz_ref(st, node->obj);
+
+    frame_slots(fun_frame)[1] = qz_from_cell(cell);
+    push(st, qz_from_cell(cell));
+    VM_NEXT;
+  }
+  VM_CASE(FEXPR_CHECK):
+  {
+    qz_node_t* node = VM_NODE;
+    size_t target = VM_OPERAND;
+    qz_obj_t op = *top(st);
+
+    if(qz_is_cfun(op)) {
+      top_frame(st)->pc = pc;
+      qz_obj_t result = qz_call_cfun(st, op, node->obj);
+      *top(st) = result;
+      qz_unref(st, result);
+      VM_JUMP(target);
+    }
+
+    VM_NEXT;
+  }
+  VM_CASE(FEXPR):
+  VM_CASE(TAIL_FEXPR):
+  {
+    int tail = pc[-1] == OP_TAIL_FEXPR;
+    qz_node_t* node = VM_NODE;
+    qz_obj_t op = *top(st);
+
+    if(qz_is_cfun(op) || qz_is_prim(op)) {
+      top_frame(st)->pc = pc;
+      qz_obj_t result = qz_call_cfun(st, op, node->obj);
+      *top(st) = result;
+      qz_unref(st, result);
+      VM_NEXT;
+    }
+
+    if(!qz_is_fun(op))
+      return qz_error(st, "uncallable value", &op, NULL);
+
+    top_frame(st)->pc = pc;
+    qz_obj_t call_scope = qz_bind_arguments(st, op, node->obj);
+    st->stack_size--;
+
+    if(tail)
+      replace_frame(st, op, call_scope);
+    else
+      push_frame(st, op, call_scope);
+
+    insns = pc = insns_of(op);
+    VM_NEXT;
+  }
+  VM_CASE(CALL):
+  VM_CASE(TAIL_CALL):
+  {
+    int tail = pc[-1] == OP_TAIL_CALL;
+    size_t nargs = VM_OPERAND;
+    qz_obj_t op = st->stack[st->stack_size - nargs - 1];
+
+    while(qz_is_prim(op) && qz_to_prim(op)->fun == qz_apply) {
+      nargs = spread_apply(st, op, nargs);
+      op = st->stack[st->stack_size - nargs - 1];
+    }
+
+    /* prims take the arguments from the stack and replace the operator with their result */
+    if(qz_is_prim(op)) {
+      qz_obj_t result = qz_call_prim(st, op, nargs);
+      *top(st) = result;
+      qz_unref(st, result);
+      VM_NEXT;
+    }
+
+    if(!qz_is_fun(op))
+      return qz_error(st, "uncallable value", &op, NULL);
+
+    qz_obj_t call_scope = bind_stack(st, op, nargs);
+    st->stack_size--;
+
+    if(tail) {
+      replace_frame(st, op, call_scope);
+    }
+    else {
+      top_frame(st)->pc = pc;
+      push_frame(st, op, call_scope);
+    }
+
+    insns = pc = insns_of(op);
+    VM_NEXT;
+  }
+  VM_CASE(RETURN):
+  {
+    /* the result stays on top, where the caller expects it, until the frame's gone */
+    assert(st->stack_size == top_frame(st)->base + 1);
+
+    pop_frame(st);
+
+    if(st->frames_size == entry_frames_size) {
+      qz_obj_t result = qz_ref(st, st->stack[--st->stack_size]);
+      if(st->stack_size == 0 && st->frames_size == 0)
+        qz_reconcile(st);
+      return result;
+    }
+
+    qz_frame_t* f = top_frame(st);
+    insns = insns_of(f->fun);
+    pc = f->pc;
+    VM_NEXT;
+  }
+
+#ifndef __GNUC__
+  }
+  assert(0); /* unknown opcode */
+  return QZ_NONE;
+#endif
+}
+
+void qz_vm_unwind(qz_state_t* st, size_t stack_size, size_t frames_size)
+{
+  while(st->frames_size > frames_size)
+    pop_frame(st);
+
+  if(st->stack_size > stack_size)
+    st->stack_size = stack_size;
+
+  if(st->stack_size == 0 && st->frames_size == 0)
+    qz_reconcile(st);
+}
@@ -28,6 +28,12 @@ static const char* type_name(qz_cell_type_t ct)
     return "port";
   case QZ_CT_REAL:
     return "real";
+  case QZ_CT_CODE:
+    return "code";
+  case QZ_CT_TABLE:
+    return "hash-table";
+  case QZ_CT_HAMT:
+    return "hamt";
   }
   return "unknown";
 }
@@ -88,6 +94,43 @@ static void write_pair(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int
   *need_space = 1;
 }
 
+/* write "key = value" of a hash or hash map, after a comma unless it's the first */
+static void write_entry(qz_state_t* st, qz_obj_t key, qz_obj_t value, FILE* fp, int human, int* need_space, int* first_pair)
+{
+  if(*first_pair) {
+    *first_pair = 0;
+  }
+  else {
+    fputc(',', fp);
+    *need_space = 1;
+  }
+
+  write_object(st, key, fp, human, need_space);
+
+  if(*need_space) fputc(' ', fp);
+  fputc('=', fp);
+  *need_space = 1;
+
+  write_object(st, value, fp, human, need_space);
+}
+
+/* child nodes are marked too, so clear_dirty() gets through them to the entries below */
+static void write_hamt(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int* need_space, int* first_pair)
+{
+  for(size_t i = 0; i < qz_hamt_entries(cell); i++) {
+    qz_hamt_entry_t* entry = QZ_CELL_DATA(cell, qz_hamt_entry_t) + i;
+
+    if(qz_is_none(entry->key)) {
+      qz_cell_t* child = qz_to_cell(entry->value);
+      qz_set_dirty(child, 1);
+      write_hamt(st, child, fp, human, need_space, first_pair);
+    }
+    else {
+      write_entry(st, entry->key, entry->value, fp, human, need_space, first_pair);
+    }
+  }
+}
+
 static void write_cell(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int* need_space)
 {
   if(!cell) {
@@ -97,14 +140,21 @@ static void write_cell(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int
     return;
   }
 
-  if(qz_dirty(cell)) {
-    if(*need_space) fputc(' ', fp);
-    fputs("...", fp);
-    *need_space = 1;
-    return;
-  }
+  /* cells holding no objects can't be part of a cycle, nor can immutable ones, which only hold older immutable ones
+   * they're often shared, interned strings and shared data especially, so they're always written */
+  qz_cell_type_t type = qz_type(cell);
+  int leaf = type == QZ_CT_STRING || type == QZ_CT_BYTEVECTOR || type == QZ_CT_REAL || type == QZ_CT_PORT || qz_immutable(cell);
 
-  qz_set_dirty(cell, 1);
+  if(!leaf) {
+    if(qz_dirty(cell)) {
+      if(*need_space) fputc(' ', fp);
+      fputs("...", fp);
+      *need_space = 1;
+      return;
+    }
+
+    qz_set_dirty(cell, 1);
+  }
 
 //#ifdef DEBUG_COLLECTOR
 //  describe(cell);
@@ -146,6 +196,10 @@ static void write_cell(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int
   {
     write_pair(st, cell, fp, human, need_space, "fun");
   }
+  else if(qz_type(cell) == QZ_CT_CODE)
+  {
+    write_pair(st, cell, fp, human, need_space, "code");
+  }
   else if(qz_type(cell) == QZ_CT_PROMISE)
   {
     write_pair(st, cell, fp, human, need_space, "promise");
@@ -218,30 +272,36 @@ static void write_cell(qz_state_t* st, qz_cell_t* cell, FILE* fp, int human, int
     *need_space = 0;
 
     int first_pair = 1;
-    for(size_t i = 0; i < cell->value.array.capacity; i++)
-    {
-      qz_pair_t* pair = QZ_CELL_DATA(cell, qz_pair_t) + i;
-      if(qz_is_none(pair->first))
-        continue;
+    size_t iter = 0;
+    qz_hash_slot_t* slot;
+    while((slot = qz_hash_next(qz_from_cell(cell), &iter)))
+      write_entry(st, slot->key, slot->value, fp, human, need_space, &first_pair);
 
-      if(first_pair) {
-        first_pair = 0;
-      }
-      else {
-        fputc(',', fp);
-        *need_space = 1;
-      }
+    fputc('}', fp);
+    *need_space = 1;
+  }
+  else if(qz_type(cell) == QZ_CT_TABLE)
+  {
+    if(*need_space) fputc(' ', fp);
+    fputs("[hash-table", fp);
+    *need_space = 1;
 
-      write_object(st, pair->first, fp, human, need_space);
+    write_object(st, cell->value.pair.rest, fp, human, need_space);
 
-      if(*need_space) fputc(' ', fp);
-      fputc('=', fp);
-      *need_space = 1;
+    fputc(']', fp);
+    *need_space = 1;
+  }
+  else if(qz_type(cell) == QZ_CT_HAMT)
+  {
+    if(*need_space) fputc(' ', fp);
 
-      write_object(st, pair->rest, fp, human, need_space);
-    }
+    fputs("[hash-map {", fp);
+    *need_space = 0;
 
-    fputc('}', fp);
+    int first_pair = 1;
+    write_hamt(st, cell, fp, human, need_space, &first_pair);
+
+    fputs("}]", fp);
     *need_space = 1;
   }
   else if(qz_type(cell) == QZ_CT_PORT)
@@ -282,18 +342,24 @@ static void write_object(qz_state_t* st, qz_obj_t obj, FILE* fp, int human, int*
     fprintf(fp, "[cfun %p]", (void*)(size_t)qz_to_cfun(obj));
     *need_space = 1;
   }
+  else if(qz_is_prim(obj))
+  {
+    if(*need_space) fputc(' ', fp);
+    fprintf(fp, "[prim %s]", qz_to_prim(obj)->name);
+    *need_space = 1;
+  }
   else if(qz_is_sym(obj))
   {
     if(*need_space) fputc(' ', fp);
 
     // translate identifier to string
-    qz_obj_t* name = NULL;
+    qz_obj_t name = QZ_NONE;
     if(st)
-      name = qz_hash_get(st, st->sym_name, obj);
+      name = qz_sym_name(st, obj);
 
-    if(name) {
+    if(!qz_is_none(name)) {
       /* TODO make this readable by qz_read() */
-      qz_cell_t* cell = qz_to_cell(*name);
+      qz_cell_t* cell = qz_to_cell(name);
       fwrite(QZ_CELL_DATA(cell, char), sizeof(char), cell->value.array.size, fp);
     }
     else {
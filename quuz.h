@@ -6,8 +6,14 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define QZ_ROOT_BUFFER_CAPACITY 16
-#define QZ_SAFETY_BUFFER_CAPACITY 16
+#define QZ_COLLECT_THRESHOLD 4096 /* default number of possible roots that trigger a collection */
+#define QZ_TRACE_RATIO 4 /* default fraction of the cells in use as possible roots that makes a collection trace the heap */
+#define QZ_COLLECT_BUDGET 256 /* cells an incremental collection step visits, for states that collect incrementally */
+#define QZ_ZCT_THRESHOLD 1024 /* cells waiting in the zero count table that trigger qz_reconcile() */
+#define QZ_SYM_THRESHOLD 1024 /* least number of symbols made that trigger reclaiming unused ones */
+#define QZ_SYM_HEAP_RATIO 8 /* most cells in use per symbol made that a reclaim of unused symbols walks */
+#define QZ_POOL_COUNT 7 /* size classes of cells, see quuz-object.c */
+#define QZ_SLAB_SIZE 32768 /* bytes carved into cells of one size class at a time */
 #define QZ_CELL_DATA(c, t) ((t*)((char*)(c) + sizeof(qz_cell_t)))
 #define QZ_UNUSED(x) (void)x
 
@@ -16,6 +22,7 @@
  *     010 cell (a NULL ptr indicates null, the empty list, ())
  *     011 c function
  *     100 odd fixnum (value is << 2)
+ *     101 primitive (points to a qz_prim_t)
  * 000 001 symbol (value is << 6)
  * 001 001 boolean (value is << 6)
  * 010 001 character (value is << 6)
@@ -28,6 +35,7 @@ typedef enum {
   QZ_PT_CELL = 2,
   QZ_PT_CFUN = 3,
   QZ_PT_ODD_FIXNUM = 4,
+  QZ_PT_PRIM = 5,
   QZ_PT_SYM = 1,
   QZ_PT_BOOL = 9,
   QZ_PT_CHAR = 17,
@@ -37,17 +45,20 @@ typedef enum {
 
 typedef enum {
   QZ_CT_PAIR, /* qz_pair_t */
-  QZ_CT_FUN, /* qz_pair_t, environment in first, formals & body in rest */
+  QZ_CT_FUN, /* qz_pair_t, environment in first, code in rest */
   QZ_CT_PROMISE, /* qz_pair_t, environment in first, expr in rest */
   QZ_CT_ERROR, /* qz_pair_t, message in first, irritants in rest */
   QZ_CT_STRING, /* qz_array_t with char elements follows qz_cell_t */
   QZ_CT_VECTOR, /* qz_array_t with qz_obj_t elements */
   QZ_CT_BYTEVECTOR, /* qz_array_t with uint8_t elements */
-  QZ_CT_HASH, /* qz_array_t with qz_pair_t elements */
+  QZ_CT_HASH, /* qz_array_t with qz_hash_slot_t elements */
   QZ_CT_RECORD, /* qz_record_t with qz_obj_t elements */
   QZ_CT_PORT, /* qz_port_t */
-  QZ_CT_REAL /* double */
-  /* 11 values, 4 bits */
+  QZ_CT_REAL, /* double */
+  QZ_CT_CODE, /* qz_pair_t, formals & body in first, owned code & names in rest, qz_code_t follows */
+  QZ_CT_TABLE, /* qz_pair_t, qz_hash_kind_t as a fixnum in first, hash in rest */
+  QZ_CT_HAMT /* qz_hamt_t with qz_hamt_entry_t elements */
+  /* 14 values, 4 bits */
 } qz_cell_type_t;
 
 typedef enum {
@@ -71,8 +82,43 @@ typedef struct qz_array {
   /* data follows */
 } qz_array_t;
 
+/* how a hash compares its keys */
+typedef enum {
+  QZ_HASH_EQUAL, /* with qz_equal(), strings by content, used by most internal hashes */
+  QZ_HASH_EQV, /* with qz_eqv(), cells by identity */
+  QZ_HASH_SHALLOW /* pairs and vectors by the identity of their elements, other cells like QZ_HASH_EQUAL */
+} qz_hash_kind_t;
+
+/* which parts of its entries a table doesn't keep alive, may be or'd together
+ * an entry is removed once a cell in a weak part of it is freed */
+typedef enum {
+  QZ_WEAK_NONE = 0,
+  QZ_WEAK_KEYS = 1,
+  QZ_WEAK_VALUES = 2
+} qz_weak_t;
+
+/* an entry of a hash, see quuz-hash.c */
+typedef struct qz_hash_slot {
+  qz_obj_t key; /* none if the slot is empty */
+  qz_obj_t value;
+  size_t hash; /* hash of key, compared before key itself */
+} qz_hash_slot_t;
+
+/* a node of a hash array mapped trie, see quuz-hash.c */
+typedef struct qz_hamt {
+  size_t bitmap; /* which of the 32 branches have an entry, 0 in a collision node */
+  size_t size; /* entries in the whole trie below the node */
+  /* entries follow, one per bit of bitmap, or size of them in a collision node */
+} qz_hamt_t;
+
+typedef struct qz_hamt_entry {
+  qz_obj_t key; /* none if value is a child node */
+  qz_obj_t value;
+} qz_hamt_entry_t;
+
 typedef struct qz_record {
   qz_obj_t name;
+  size_t size; /* number of fields */
   /* data follows */
 } qz_record_t;
 
@@ -81,21 +127,87 @@ typedef struct qz_port {
   const char* mode;
 } qz_port_t;
 
+typedef enum {
+  QZ_NT_CONST, /* obj */
+  QZ_NT_LOCAL_REF, /* sym in slot index of the frame depth frames up */
+  QZ_NT_GLOBAL_REF, /* sym in the toplevel */
+  QZ_NT_FREE_REF, /* sym searched for by name starting depth frames up */
+  QZ_NT_LOCAL_SET, /* like QZ_NT_LOCAL_REF, value in kids[0] */
+  QZ_NT_GLOBAL_SET, /* like QZ_NT_GLOBAL_REF, value in kids[0] */
+  QZ_NT_FREE_SET, /* like QZ_NT_FREE_REF, value in kids[0] */
+  QZ_NT_DEFINE, /* sym in slot index of the innermost frame, value in kids[0] */
+  QZ_NT_IF, /* test, consequent and alternate (may be NULL) in kids */
+  QZ_NT_LAMBDA, /* code in obj */
+  QZ_NT_SEQ, /* expressions in kids */
+  QZ_NT_AND, /* tests in kids */
+  QZ_NT_OR, /* tests in kids */
+  QZ_NT_CASE, /* key then a body per clause in kids, clauses in obj */
+  QZ_NT_LET, /* names of the frame in names, inits then body in kids */
+  QZ_NT_LET_S, /* same as QZ_NT_LET */
+  QZ_NT_NAMED_LET, /* name in sym, names of the frame binding it in names, code in obj, inits in kids */
+  QZ_NT_CALL, /* operator then arguments in kids, unevaluated arguments in obj */
+  QZ_NT_FEXPR /* operator in kids[0], unevaluated arguments in obj */
+} qz_node_type_t;
+
+/* a node of an analyzed expression */
+typedef struct qz_node {
+  qz_node_type_t type;
+  size_t depth;
+  size_t index;
+  qz_obj_t sym;
+  qz_obj_t obj;
+  qz_obj_t names;
+  struct qz_node* next; /* next node allocated for the same code */
+  size_t nkids;
+  struct qz_node* kids[];
+} qz_node_t;
+
+/* an analyzed lambda expression */
+typedef struct qz_code {
+  qz_node_t* body;
+  qz_obj_t names; /* names of the frame a call runs with */
+  qz_node_t* nodes; /* every node allocated for this code, freed with it */
+  size_t* insns; /* bytecode compiled from body on first use, see quuz-vm.c */
+} qz_code_t;
+
+typedef enum {
+  QZ_ENGINE_TREE, /* walk analyzed code */
+  QZ_ENGINE_VM /* compile analyzed code to bytecode, see quuz-vm.c */
+} qz_engine_t;
+
+/* a call frame of the bytecode vm */
+typedef struct qz_frame {
+  qz_obj_t fun; /* function being executed */
+  qz_obj_t env; /* current environment */
+  qz_obj_t old_env; /* environment to restore on return */
+  const size_t* pc; /* where to continue when a call returns */
+  size_t base; /* size of the value stack on entry */
+} qz_frame_t;
+
 typedef struct qz_cell {
   /*
    * contains four fields, lsb to msb
    * used by quuz-collector.c:
-   * refcount, sizeof(size_t)*CHAR_BIT - 8 bits
+   * refcount, sizeof(size_t)*CHAR_BIT - 16 bits
    * type, 4 bits, qz_cell_type_t
    * color, 2 bits, qz_cell_color_t
    * buffered, 1 bit
    * used by quuz-write.c:
    * dirty, 1 bit
+   * used by quuz-object.c:
+   * pool, 3 bits, size class the cell came from, QZ_POOL_COUNT if malloc'd
+   * immutable, 1 bit, set for interned strings and data shared by qz_read_shared()
+   * used by quuz-hash.c:
+   * weak, 2 bits, qz_weak_t, set on a weak table and its hash
+   * held, 1 bit, set once a weak table has stored the cell in a weak part of an entry
+   * used by quuz-collector.c:
+   * deferred, 1 bit, set while the cell is in the zero count table
    */
   size_t info;
   union {
     qz_pair_t pair;
     qz_array_t array;
+    qz_hamt_t hamt;
     qz_record_t record;
     qz_port_t port;
     double real;
@@ -103,14 +215,145 @@ typedef struct qz_cell {
   /* don't put anything beyond the union. qz_array_t is variable in size */
 } qz_cell_t;
 
+/* free cells of one size class */
+typedef struct qz_pool {
+  void* free_list; /* linked through the word after the info of each free cell */
+  char* unused; /* uncarved part of the newest slab */
+  char* unused_end;
+} qz_pool_t;
+
+/* when the cycle collector runs, see qz_set_collect_policy() */
+typedef enum {
+  QZ_COLLECT_COUNT, /* once threshold possible roots are buffered */
+  QZ_COLLECT_BYTES, /* once threshold bytes were allocated since the last collection */
+  QZ_COLLECT_MANUAL /* only when qz_collect() is called */
+} qz_collect_policy_t;
+
+/* how far an incremental collection is, see qz_collect_step() */
+typedef enum {
+  QZ_PHASE_IDLE, /* none is running */
+  QZ_PHASE_START, /* one starts with the possible roots at the next step */
+  QZ_PHASE_MARK, /* visiting the possible roots' subgraphs, less their references to each other */
+  QZ_PHASE_SCAN, /* finding what the cells still counted reach */
+  QZ_PHASE_RELEASE /* the garbage is freed, letting go of the cells visited */
+} qz_collect_phase_t;
+
+/* a cell an incremental collection visited */
+typedef struct {
+  qz_cell_t* cell; /* NULL in an empty slot */
+  size_t count; /* its references, less those from the other cells visited */
+  qz_cell_color_t color; /* its color in the collection, the cell's own is left to the mutator */
+} qz_trial_t;
+
 typedef struct qz_state {
-  /* array of possible roots */
+  /* array of possible roots, grown as needed */
   size_t root_buffer_size;
-  qz_cell_t* root_buffer[QZ_ROOT_BUFFER_CAPACITY];
-
-  /* array of objects to unref if a peval() fails */
+  size_t root_buffer_capacity;
+  qz_cell_t** root_buffer;
+
+  /* when to collect cycles */
+  qz_collect_policy_t collect_policy;
+  size_t collect_threshold;
+  size_t collect_bytes; /* bytes_allocated when the last collection finished */
+  size_t collections;
+
+  /* a collection traces the whole heap instead of the possible roots' subgraphs once they're
+   * at least 1/trace_ratio of the cells in use, 0 never traces, see qz_collect()
+   * tracing waits for a prim call to return, when no cell is half updated, trace_pending is set meanwhile */
+  size_t trace_ratio;
+  int trace_pending;
+  size_t traces;
+
+  /* a nonzero collect_budget collects incrementally and never traces, a step visits about that many cells
+   * steps are taken as prim calls return, see qz_collect_step() */
+  size_t collect_budget;
+  qz_collect_phase_t collect_phase;
+  size_t collect_index; /* the next root to mark or scan, or the next slot to release */
+  size_t black_base; /* where the cells left to blacken start on the work stack, SIZE_MAX if none */
+  size_t collect_steps;
+
+  /* array of the possible roots the incremental collection started with, NULL where it discarded one */
+  size_t trial_roots_size;
+  size_t trial_roots_capacity;
+  qz_cell_t** trial_roots;
+
+  /* the cells it visited, open addressed by address, half empty at least
+   * each has a reference more until the collection is done, so the mutator can't free it meanwhile */
+  size_t trial_size;
+  size_t trial_capacity;
+  qz_trial_t* trial;
+
+  /* the table before it last grew, NULL once its entries are all moved, those before trial_moved are */
+  size_t old_trial_capacity;
+  qz_trial_t* old_trial;
+  size_t trial_moved;
+
+  /* cells the collector's traversals have left to visit, grown as needed
+   * each traversal only pops what it pushed, so they can nest */
+  size_t work_stack_size;
+  size_t work_stack_capacity;
+  qz_cell_t** work_stack;
+
+  /* garbage found while collecting, freed once the traversal is done
+   * kept apart from the cells, so they're intact for qz_weak_release() until then */
+  size_t white_cells_size;
+  size_t white_cells_capacity;
+  qz_cell_t** white_cells;
+
+  /* set while qz_collect() runs, freeing cells can't start another collection */
+  int collecting;
+
+
+  /* the zero count table, cells whose count dropped to zero while the stack may hold them
+   * references from the stack and from frames to their functions aren't counted, see qz_reconcile() */
+  size_t zct_size;
+  size_t zct_capacity;
+  qz_cell_t** zct;
+
+  /* nonzero while those references are counted after all, so a cell at zero is garbage */
+  int stack_counted;
+
+  /* array of the weak tables alive, grown as needed, see qz_make_weak_table() */
+  size_t weak_tables_size;
+  size_t weak_tables_capacity;
+  qz_cell_t** weak_tables;
+
+  /* the other parts of entries weak tables removed while collecting, unrefed once it's done */
+  size_t weak_unrefs_size;
+  size_t weak_unrefs_capacity;
+  qz_obj_t* weak_unrefs;
+
+  /* cells are carved out of slabs, one pool per size class
+   * slabs is a list of every slab, linked through their first word
+   * cells too big for a pool are malloc'd, big_cells lists them through a header before each */
+  qz_pool_t pools[QZ_POOL_COUNT];
+  void* slabs;
+  void* big_cells;
+
+  /* allocation counters, never reset */
+  size_t cells_allocated;
+  size_t cells_freed;
+  size_t bytes_allocated;
+  size_t slabs_allocated;
+
+  /* how analyzed code is executed */
+  qz_engine_t engine;
+
+  /* value stack and call frames of the bytecode vm, prim arguments are passed on the stack too
+   * the stack's references and the frames' references to their functions aren't counted */
+  qz_obj_t* stack;
+  size_t stack_size;
+  size_t stack_capacity;
+  qz_frame_t* frames;
+  size_t frames_size;
+  size_t frames_capacity;
+
+  /* array of objects to unref if a peval() fails, grown as needed
+   * safety_buffer_peak is the most it has ever held */
   size_t safety_buffer_size;
-  qz_obj_t safety_buffer[QZ_SAFETY_BUFFER_CAPACITY];
+  size_t safety_buffer_capacity;
+  size_t safety_buffer_peak;
+  qz_obj_t* safety_buffer;
 
   /* state to restore when an error occurs */
   jmp_buf* peval_fail;
@@ -121,18 +364,34 @@ typedef struct qz_state {
   /* object describing the error that occurred */
   qz_obj_t error_obj;
 
+  /* tail evaluation requested by a special form, see qz_tail_eval()
+   * tail_expr is none when no request is pending */
+  qz_obj_t tail_expr;
+  int tail_body;
+  qz_obj_t tail_scope;
+
   /* variables bindings
-   * a list of a list of hashes
+   * a list of a list of frames
    * the outer list is a stack of environments for currently executing functions
-   * the inner list is a stack of frames for a particular function
-   * each hash maps symbols to values */
+   * the inner list is a stack of frames for a particular function, empty at the toplevel
+   * a frame is a hash mapping symbols to values, or for analyzed code, a vector
+   * holding the number of values, the values, then their names */
   qz_obj_t env;
 
+  /* values of global variables and names of symbols, both indexed by symbol number
+   * grown together as symbols are made, a slot holds none while unbound or unnamed */
+  qz_obj_t* globals;
+  qz_obj_t* sym_names;
+  size_t globals_capacity;
+
   /* a hash mapping names to symbols */
   qz_obj_t name_sym;
 
-  /* a hash mapping symbols to names */
-  qz_obj_t sym_name;
+  /* a table with weak keys, the interned strings, see qz_intern_string() */
+  qz_obj_t strings;
+
+  /* a table with weak keys, the data shared by qz_read_shared() */
+  qz_obj_t shared;
 
   /* default io ports */
   qz_obj_t input_port;
@@ -142,8 +401,30 @@ typedef struct qz_state {
   /* next number to assign to a symbol */
   size_t next_sym;
 
-  /* "begin" sym, used in "lambda" and "define" */
+  /* numbers of reclaimed symbols, reused before next_sym grows, see qz_make_unique_sym()
+   * the symbols qz_alloc() makes, below fixed_syms, are never reclaimed */
+  size_t free_syms_size;
+  size_t free_syms_capacity;
+  size_t* free_syms;
+  size_t fixed_syms;
+
+  /* symbols made since unused ones were last reclaimed, and how many have been in all */
+  size_t syms_made;
+  size_t syms_reclaimed;
+
+  /* which symbols are in use while reclaiming, indexed by symbol number */
+  unsigned char* sym_marks;
+
+  /* symbols embedders hold outside the heap, mapped to how many times each is pinned, see qz_pin_sym() */
+  qz_obj_t pinned_syms;
+
+  /* the frame of the outermost qz_peval() running, NULL if there is none
+   * the C stack up to it is searched for symbols in use while reclaiming */
+  void* c_stack_base;
+
+  /* "begin" and "define" syms, used when scanning bodies for definitions */
   qz_obj_t begin_sym;
+  qz_obj_t define_sym;
 
   /* "else" sym, used in "cond" */
   qz_obj_t else_sym;
@@ -168,6 +449,49 @@ typedef struct qz_named_cfun {
   const char* name;
 } qz_named_cfun_t;
 
+/* primitives get their arguments already evaluated, argv is borrowed */
+typedef qz_obj_t (*qz_prim_fun_t)(qz_state_t* st, size_t argc, qz_obj_t* argv);
+
+/* types of arguments, one bit per cell type and per immediate type
+ * an object matches a mask holding its qz_type_bit() */
+typedef enum {
+  QZ_T_PAIR = 1 << QZ_CT_PAIR,
+  QZ_T_FUN = 1 << QZ_CT_FUN,
+  QZ_T_PROMISE = 1 << QZ_CT_PROMISE,
+  QZ_T_ERROR = 1 << QZ_CT_ERROR,
+  QZ_T_STRING = 1 << QZ_CT_STRING,
+  QZ_T_VECTOR = 1 << QZ_CT_VECTOR,
+  QZ_T_BYTEVECTOR = 1 << QZ_CT_BYTEVECTOR,
+  QZ_T_HASH = 1 << QZ_CT_HASH,
+  QZ_T_RECORD = 1 << QZ_CT_RECORD,
+  QZ_T_PORT = 1 << QZ_CT_PORT,
+  QZ_T_REAL = 1 << QZ_CT_REAL,
+  QZ_T_TABLE = 1 << QZ_CT_TABLE,
+  QZ_T_HAMT = 1 << QZ_CT_HAMT,
+  QZ_T_NULL = 1 << 16,
+  QZ_T_FIXNUM = 1 << 17,
+  QZ_T_CFUN = 1 << 18,
+  QZ_T_PRIM = 1 << 19,
+  QZ_T_SYM = 1 << 20,
+  QZ_T_BOOL = 1 << 21,
+  QZ_T_CHAR = 1 << 22,
+  QZ_T_EOF = 1 << 23,
+  QZ_T_ANY = (1 << 24) - 1 /* anything but none */
+} qz_type_mask_t;
+
+#define QZ_PRIM_TYPES 4 /* most argument types a primitive lists */
+
+/* a primitive and the arguments it takes, checked before it's called
+ * types has a mask per argument, the last nonzero one repeating
+ * must be 8 byte aligned to fit the pointer tag */
+typedef struct qz_prim {
+  qz_prim_fun_t fun;
+  const char* name;
+  size_t min_args;
+  size_t max_args; /* SIZE_MAX for any number */
+  uint32_t types[QZ_PRIM_TYPES];
+} qz_prim_t;
+
 /******************************************************************************
  * quuz-object.c
  ******************************************************************************/
@@ -177,70 +501,40 @@ extern qz_obj_t const QZ_FALSE;
 extern qz_obj_t const QZ_EOF;
 extern qz_obj_t const QZ_NONE;
 
-int qz_is_null(qz_obj_t);
-int qz_is_fixnum(qz_obj_t);
-int qz_is_cell(qz_obj_t);
-int qz_is_cfun(qz_obj_t);
-int qz_is_sym(qz_obj_t);
-int qz_is_bool(qz_obj_t);
-int qz_is_char(qz_obj_t);
-int qz_is_eof(qz_obj_t);
-int qz_is_none(qz_obj_t);
-int qz_is_pair(qz_obj_t);
-int qz_is_fun(qz_obj_t);
-int qz_is_promise(qz_obj_t);
-int qz_is_error(qz_obj_t);
-int qz_is_string(qz_obj_t);
-int qz_is_vector(qz_obj_t);
-int qz_is_bytevector(qz_obj_t);
-int qz_is_hash(qz_obj_t);
-int qz_is_record(qz_obj_t);
-int qz_is_port(qz_obj_t);
-int qz_is_real(qz_obj_t);
-
-intptr_t qz_to_fixnum(qz_obj_t);
-qz_cell_t* qz_to_cell(qz_obj_t);
-qz_cfun_t qz_to_cfun(qz_obj_t);
-size_t qz_to_sym(qz_obj_t);
-int qz_to_bool(qz_obj_t);
-char qz_to_char(qz_obj_t);
-qz_pair_t* qz_to_pair(qz_obj_t);
-qz_pair_t* qz_to_fun(qz_obj_t);
-qz_pair_t* qz_to_promise(qz_obj_t);
-qz_port_t* qz_to_port(qz_obj_t);
-double qz_to_real(qz_obj_t);
-
-qz_obj_t qz_from_fixnum(intptr_t);
-qz_obj_t qz_from_cell(qz_cell_t*);
-qz_obj_t qz_from_cfun(qz_cfun_t);
-qz_obj_t qz_from_bool(int);
-qz_obj_t qz_from_char(char);
-
-size_t qz_refcount(qz_cell_t*);
-qz_cell_type_t qz_type(qz_cell_t*);
-qz_cell_color_t qz_color(qz_cell_t*);
-size_t qz_buffered(qz_cell_t*);
-size_t qz_dirty(qz_cell_t*);
-
-void qz_set_refcount(qz_cell_t* cell, size_t rc);
-void qz_set_type(qz_cell_t* cell, qz_cell_type_t ct);
-void qz_set_color(qz_cell_t* cell, qz_cell_color_t cc);
-void qz_set_buffered(qz_cell_t* cell, size_t bu);
-void qz_set_dirty(qz_cell_t* cell, size_t d);
-
-qz_cell_t* qz_make_cell(qz_cell_type_t type, size_t extra_size);
-qz_obj_t qz_make_string(const char* str);
-qz_obj_t qz_make_string_with_size(const char* str, size_t size);
-qz_obj_t qz_make_pair(qz_obj_t first, qz_obj_t rest);
+#include "quuz-object.h"
+
+qz_cell_t* qz_make_cell(qz_state_t* st, qz_cell_type_t type, size_t extra_size);
+
+/* return a cell's memory to its pool, see qz_obliterate() to free its contents too */
+void qz_free_cell(qz_state_t* st, qz_cell_t* cell);
+
+/* call func on every cell in use, including garbage and cells still being filled in */
+void qz_each_cell(qz_state_t* st, void (*func)(qz_state_t*, qz_cell_t*));
+
+/* free every slab, any cell still alive is gone */
+void qz_free_pools(qz_state_t* st);
+
+qz_obj_t qz_make_string(qz_state_t* st, const char* str);
+qz_obj_t qz_make_string_with_size(qz_state_t* st, const char* str, size_t size);
+qz_obj_t qz_make_pair(qz_state_t* st, qz_obj_t first, qz_obj_t rest);
 qz_obj_t qz_make_sym(qz_state_t* st, qz_obj_t name);
 
-/* returns the first member of a pair
- * qz_is_pair(obj) must be true */
-qz_obj_t qz_first(qz_obj_t);
+/* the interned string with the given contents, made if there isn't one yet
+ * interned strings are immutable, literals and symbol names are shared this way
+ * returns a new reference */
+qz_obj_t qz_intern_string(qz_state_t* st, const char* str, size_t size);
+
+/* create a symbol with no name, distinct from every other symbol
+ * inside qz_peval(), may first reclaim the symbols nothing uses and reuse their numbers */
+qz_obj_t qz_make_unique_sym(qz_state_t* st);
 
-/* returns the rest member of a pair
- * qz_is_pair(obj) must be true */
-qz_obj_t qz_rest(qz_obj_t);
+/* keep a symbol from being reclaimed until it is unpinned as many times as it was pinned */
+void qz_pin_sym(qz_state_t* st, qz_obj_t sym);
+void qz_unpin_sym(qz_state_t* st, qz_obj_t sym);
+
+/* the name of a symbol, none for a unique symbol
+ * the result is borrowed */
+qz_obj_t qz_sym_name(qz_state_t* st, qz_obj_t sym);
 
 qz_obj_t qz_required_arg(qz_state_t* st, qz_obj_t* obj);
 qz_obj_t qz_optional_arg(qz_state_t* st, qz_obj_t* obj);
@@ -257,12 +551,6 @@ qz_obj_t* qz_vector_tail_ptr(qz_obj_t obj);
 qz_obj_t qz_vector_head(qz_obj_t obj);
 qz_obj_t qz_vector_tail(qz_obj_t obj);
 
-/* scheme's eq? procedure */
-int qz_eq(qz_obj_t a, qz_obj_t b);
-
-/* scheme's eqv? procedure */
-int qz_eqv(qz_obj_t a, qz_obj_t b);
-
 /* scheme's equal? procedure */
 int qz_equal(qz_obj_t a, qz_obj_t b);
 
@@ -287,6 +575,8 @@ int qz_equal(qz_obj_t a, qz_obj_t b);
  * record: t (think tuple)
  * port: d (think descriptor)
  * real: r
+ * hash table: m (think map)
+ * hash map: k (think keyed)
  * the last specifier may be followed by:
  *  ? to make it optional
  *  ~ to not evaluate the object
@@ -295,6 +585,9 @@ int qz_equal(qz_obj_t a, qz_obj_t b);
  */
 void qz_get_args(qz_state_t* st, qz_obj_t* args, const char* spec, ...);
 
+/* check the number and types of a primitive's evaluated arguments */
+void qz_check_args(qz_state_t* st, const qz_prim_t* prim, size_t argc, qz_obj_t* argv);
+
 /* eval a list of objects into another list of objects
  * ex. ((+ 1 2) (* 3 4)) -> (3 12) */
 qz_obj_t qz_eval_list(qz_state_t* st, qz_obj_t list);
@@ -309,7 +602,7 @@ void qz_printf(qz_state_t* st, qz_obj_t port, const char* fmt, ...);
  ******************************************************************************/
 
 /* create a new hash */
-qz_obj_t qz_make_hash(void);
+qz_obj_t qz_make_hash(qz_state_t* st);
 
 /* retrieve a pointer to a slot in the hash object with the value for key
  * returns NULL if not found */
@@ -320,6 +613,58 @@ qz_obj_t* qz_hash_get(qz_state_t* st, qz_obj_t obj, qz_obj_t key);
  * obj may be rewritten if reallocated */
 void qz_hash_set(qz_state_t* st, qz_obj_t* obj, qz_obj_t key, qz_obj_t value);
 
+/* remove a key and its value from a hash object, returning zero if it wasn't there
+ * obj may be rewritten if reallocated */
+int qz_hash_delete(qz_state_t* st, qz_obj_t* obj, qz_obj_t key);
+
+/* find the entry whose key is a string with the given contents, or NULL
+ * the hash must compare keys with qz_equal() */
+qz_hash_slot_t* qz_hash_find_chars(qz_obj_t obj, const char* str, size_t size);
+
+/* iterate over the entries of a hash object
+ * start with *iter at zero, returns NULL once every entry has been seen
+ * the order is the same each time as long as the hash isn't changed in between */
+qz_hash_slot_t* qz_hash_next(qz_obj_t obj, size_t* iter);
+
+/* a hash table visible to scheme
+ * it wraps a hash it alone references, so the hash can be reallocated however many references the table has */
+qz_obj_t qz_make_table(qz_state_t* st, qz_hash_kind_t kind);
+
+/* a table that doesn't keep the cells in the weak parts of its entries alive
+ * storing one steals the reference as usual, but the table drops it right away
+ * symbols and other immediates are never freed, so their entries stay */
+qz_obj_t qz_make_weak_table(qz_state_t* st, qz_hash_kind_t kind, qz_weak_t weak);
+
+/* persistent hash maps, hash array mapped tries keyed like qz_hash_get()
+ * a map is never changed, setting or deleting a key makes a new map sharing most of its nodes */
+qz_obj_t qz_make_hamt(qz_state_t* st);
+
+/* the value stored under key, or NULL, borrowed like the map */
+qz_obj_t* qz_hamt_get(qz_obj_t hamt, qz_obj_t key);
+
+/* a map like hamt with key set to value, key and value are stolen, hamt is borrowed
+ * returns a new reference */
+qz_obj_t qz_hamt_set(qz_state_t* st, qz_obj_t hamt, qz_obj_t key, qz_obj_t value);
+
+/* a map like hamt without key, hamt and key are borrowed
+ * returns a new reference, to hamt itself if key wasn't there */
+qz_obj_t qz_hamt_delete(qz_state_t* st, qz_obj_t hamt, qz_obj_t key);
+
+/* iterate over the entries of a map like qz_hash_next() */
+qz_hamt_entry_t* qz_hamt_next(qz_obj_t hamt, size_t* iter);
+
+/* called by the collector before a cell is freed
+ * removes the entries of weak tables holding the cell, or forgets a weak table */
+void qz_weak_release(qz_state_t* st, qz_cell_t* cell);
+
+/* like qz_hash_get(), qz_hash_set() and qz_hash_delete(), comparing keys as the table's kind says */
+qz_obj_t* qz_table_get(qz_state_t* st, qz_obj_t table, qz_obj_t key);
+void qz_table_set(qz_state_t* st, qz_obj_t table, qz_obj_t key, qz_obj_t value);
+int qz_table_delete(qz_state_t* st, qz_obj_t table, qz_obj_t key);
+
+/* the entry whose key matches key, or NULL, so the stored key can stand in for key */
+qz_hash_slot_t* qz_table_find(qz_obj_t table, qz_obj_t key);
+
 /******************************************************************************
  * quuz-state.c
  ******************************************************************************/
@@ -331,6 +676,9 @@ qz_state_t* qz_alloc(void);
 void qz_free(qz_state_t* st);
 
 /* evaluate an object, catching thrown errors
+ * making symbols during it reclaims the ones nothing uses once enough have been made
+ * the C stack below it counts as using the symbols it holds, but a symbol an embedder keeps
+ * anywhere else across it must be pinned, in a cell or a global variable's value
  * returns the result of the evaluation */
 qz_obj_t qz_peval(qz_state_t* st, qz_obj_t obj);
 
@@ -338,10 +686,34 @@ qz_obj_t qz_peval(qz_state_t* st, qz_obj_t obj);
  * returns the result of the evaluation */
 qz_obj_t qz_eval(qz_state_t* st, qz_obj_t obj);
 
+/* evaluate an object without taking a reference where it can be avoided
+ * variables and constants are returned as they are, and *owned is set to none
+ * otherwise *owned is set to the result, which the caller must unref when done
+ * the result may only be inspected until anything else is evaluated */
+qz_obj_t qz_eval_borrowed(qz_state_t* st, qz_obj_t obj, qz_obj_t* owned);
+
+/* request that the calling qz_eval evaluate expr in place of returning
+ * used by special forms to evaluate expressions in tail position without growing the C stack
+ * the special form must return the result of this function */
+qz_obj_t qz_tail_eval(qz_state_t* st, qz_obj_t expr);
+
+/* like qz_tail_eval, but evaluates a list of expressions, the last in tail position
+ * if scope is not none, it is used as the frames of a new environment for the body
+ * steals a reference from scope */
+qz_obj_t qz_tail_body(qz_state_t* st, qz_obj_t body, qz_obj_t scope);
+
 /* find the slot for a variable in the current environment
  * returns NULL if the variable is unbound */
 qz_obj_t* qz_lookup(qz_state_t* st, qz_obj_t sym);
 
+/* find the slot for a global variable
+ * returns NULL if the variable is unbound */
+qz_obj_t* qz_lookup_global(qz_state_t* st, qz_obj_t sym);
+
+/* set a global variable, binding it if needed
+ * steals a reference from value */
+void qz_set_global(qz_state_t* st, qz_obj_t sym, qz_obj_t value);
+
 /* throw an error. doesn't return */
 qz_obj_t qz_error(qz_state_t* st, const char* msg, ...);
 
@@ -352,6 +724,22 @@ void qz_push_safety(qz_state_t* st, qz_obj_t obj);
 /* pop nobj objects from the safety buffer */
 void qz_pop_safety(qz_state_t* st, size_t nobj);
 
+/******************************************************************************
+ * quuz-analyze.c
+ ******************************************************************************/
+
+/* analyze a lambda expression's formals and body into code
+ * scope is the environment frames the code will run in
+ * returns a function closing over scope */
+qz_obj_t qz_make_fun(qz_state_t* st, qz_obj_t scope, qz_obj_t formals, qz_obj_t body);
+
+/* returns the analyzed code of a function
+ * qz_is_fun(obj) must be true */
+qz_code_t* qz_fun_code(qz_obj_t obj);
+
+/* returns the formals of a function */
+qz_obj_t qz_fun_formals(qz_obj_t obj);
+
 /******************************************************************************
  * quuz-read.c
  ******************************************************************************/
@@ -362,6 +750,14 @@ void qz_discard_hashbang(FILE* fp);
 /* scheme's read procedure */
 qz_obj_t qz_read(qz_state_t* st, FILE* fp);
 
+/* like qz_read(), but lists, vectors and bytevectors equal to ones read before are the same cells
+ * the data is immutable, strings are always shared this way and numbers need no cells */
+qz_obj_t qz_read_shared(qz_state_t* st, FILE* fp);
+
+/* drop the characters read ahead from a file but not parsed yet, call it before closing the file
+ * those are kept for the next read from the same file, even while other files are read */
+void qz_forget_read_ahead(FILE* fp);
+
 /******************************************************************************
  * quuz-write.c
  ******************************************************************************/
@@ -385,4 +781,25 @@ void qz_unref(qz_state_t* st, qz_obj_t obj);
 /* free an object without checking reference count or unreferencing children */
 void qz_obliterate(qz_state_t* st, qz_obj_t obj);
 
+/* free any garbage cycles among the possible roots
+ * with many possible roots, tracing the heap from the cells referenced from outside it finds them instead */
+void qz_collect(qz_state_t* st);
+
+/* free the cells in the zero count table that the stack doesn't hold
+ * done once the table fills up, whenever the stack empties, and before collecting */
+void qz_reconcile(qz_state_t* st);
+
+/* choose when cycles are collected
+ * threshold is a count of possible roots or of bytes, and is ignored by QZ_COLLECT_MANUAL
+ * possible roots are kept alive until they're collected, so a manual state must call qz_collect() */
+void qz_set_collect_policy(qz_state_t* st, qz_collect_policy_t policy, size_t threshold);
+
+/* collect cycles incrementally, in steps visiting about budget cells each
+ * 0 makes every collection run to completion at once, the default */
+void qz_set_collect_budget(qz_state_t* st, size_t budget);
+
+/* do one step of the incremental collection running, done whenever a prim call returns
+ * qz_collect() finishes it instead */
+void qz_collect_step(qz_state_t* st);
+
 #endif /* QUUZ_QUUZ_H */
@@ -97,3 +97,265 @@ foo
 6
 24
 120
+
+=== Tail calls
+--- input
+(define (count n acc)
+  (if (= n 0)
+    acc
+    (count (- n 1) (+ acc 1))))
+(write (count 100000 0))
+(newline)
+(write (let loop ((i 0))
+  (cond ((< i 100000) (loop (+ i 1)))
+        (else i))))
+--- expected
+100000
+100000
+
+=== Named let
+--- input
+(write (let loop ((i 0) (acc '()))
+  (if (= i 3)
+    acc
+    (loop (+ i 1) (cons i acc)))))
+--- expected
+(2 1 0)
+
+=== Closures
+--- input
+(define counter
+  (let ((n 0))
+    (lambda ()
+      (set! n (+ n 1))
+      n)))
+(counter)
+(write (counter))
+(newline)
+(define (outer x)
+  (define (inner y) (list x y))
+  (let* ((x (+ x 1)) (y x))
+    (inner y)))
+(write (outer 1))
+--- expected
+2
+(1 2)
+
+=== Frames
+--- input
+(define (f)
+  (let* ((x 1) (g (lambda () x)) (x (+ x 1)))
+    (define y (* x 10))
+    (list (g) x y)))
+(write (f))
+--- expected
+(1 2 20)
+
+=== Globals
+--- input
+(define (get) x)
+(define x 1)
+(define (bump) (set! x (+ x 1)))
+(bump)
+(write (get))
+--- expected
+2
+
+=== Primitives
+--- input
+(define (f x) (list (car x) (+ 1 2 3) (- 5) (procedure? car)))
+(write (f '(0)))
+--- expected
+(0 6 -5 #t)
+
+=== List, string and vector primitives
+--- input
+(define l (list 1 2 3))
+(list-set! l 1 'x)
+(write (list (reverse l) (list-tail l 1) (list-ref l 2) (list-copy '(1 2 . 3))))
+(write (list (memq 'b '(a b c)) (memv 4 '(1 2)) (member 2 '(1 2 3) <) (assq 'b '((a 1) (b 2))) (assoc 2 '((1 a) (2 b)) =)))
+(write (list (make-vector 2 'x) (list->vector '(1 2)) (substring "hello" 1 3) (list->string '(#\a #\b)) (make-bytevector 2 7)))
+(write (list (symbol->string 'abc) (string->symbol "abc") (char-alphabetic? #\a) (digit-value #\7) (textual-port? 1)))
+--- expected
+((3 x 1) (x 3) 3 (1 2 . 3))((b c) #f (3) (b 2) (2 b))(#(x x) #(1 2) "el" "ab" #u8(#x07 #x07))("abc" abc #t 7 #f)
+
+=== Deep recursion
+--- input
+(define (count n) (if (= n 0) 0 (+ 1 (count (- n 1)))))
+(write (count 1000))
+--- expected
+1000
+
+=== Hash tables
+--- input
+(define t (make-hash-table))
+(hash-table-set! t 'a 1)
+(hash-table-set! t '(b c) 2)
+(hash-table-update!/default t 'a (lambda (x) (+ x 10)) 0)
+(hash-table-delete! t '(b c))
+(write (list (hash-table-ref t 'a) (hash-table-ref/default t '(b c) 'gone) (hash-table-count t)))
+--- expected
+(11 gone 1)
+
+=== Large hash tables with deletions
+--- input
+(define t (make-hash-table))
+(define (fill i n) (when (< i n) (hash-table-set! t i (* i i)) (fill (+ i 1) n)))
+(define (drop i n) (when (< i n) (hash-table-delete! t i) (drop (+ i 1) n)))
+(define (churn i) (when (< i 20) (fill 1000 1500) (drop 1000 1500) (churn (+ i 1))))
+(fill 0 1000)
+(churn 0)
+(drop 0 500)
+(write (list (hash-table-count t) (hash-table-ref/default t 499 'gone) (hash-table-ref t 500) (hash-table-ref t 999)))
+--- expected
+(500 gone 250000 998001)
+
+=== Interned strings
+--- input
+(define s (make-string 2 #\a))
+(define sym (string->symbol s))
+(string-set! s 0 #\b)
+(write (list sym s (eq? "k" "k") (eq? (symbol->string 'k) "k")))
+--- expected
+(aa "ba" #t #t)
+
+=== Weak hash tables
+--- input
+(define t (make-weak-key-hash-table))
+(define k (list 1))
+(hash-table-set! t k 'kept)
+(hash-table-set! t (list 2) 'gone)
+(hash-table-set! t 'sym 'kept)
+(define before (hash-table-count t))
+(set! k #f)
+(write (list before (hash-table-count t)))
+--- expected
+(2 1)
+
+=== Hash maps
+--- input
+(define a (hash-map-set (make-hash-map) 'x 1))
+(define b (hash-map-set a 'y 2))
+(define c (hash-map-delete b 'x))
+(write (list (hash-map-count a) (hash-map-count b) (hash-map-ref b 'x) (hash-map-ref/default c 'x 'gone)
+             (equal? c (hash-map-set (make-hash-map) 'y 2))))
+--- expected
+(1 2 1 gone #t)
+
+=== Shared reads
+--- input
+(with-output-to-file "/tmp/quuz-read-shared" (lambda () (write '((a "b" #(1)) (a "b" #(1))))))
+(define x (with-input-from-file "/tmp/quuz-read-shared" read-shared))
+(define y (with-input-from-file "/tmp/quuz-read-shared" read))
+(delete-file "/tmp/quuz-read-shared")
+(write (list x (eq? (car x) (car (cdr x))) (eq? (car y) (car (cdr y))) (equal? x y)))
+--- expected
+(((a "b" #(1)) (a "b" #(1))) #t #f #t)
+
+=== Shared data can't be changed
+--- input
+(with-output-to-file "/tmp/quuz-read-shared" (lambda () (write '((a b) (a b) #u8(1 2)))))
+(define x (with-input-from-file "/tmp/quuz-read-shared" read-shared))
+(define (try thunk) (with-exception-handler (lambda (e) (write (error-object-message e))) thunk))
+(try (lambda () (list-set! (car x) 0 'c)))
+(try (lambda () (with-input-from-file "/tmp/quuz-read-shared" (lambda () (read-bytevector! (car (cdr (cdr x))) 0 1)))))
+(delete-file "/tmp/quuz-read-shared")
+(write x)
+--- expected
+"immutable object""immutable object"((a b) (a b) #u8(#x01 #x02))
+
+=== Reading files between reads of the program
+--- input
+(with-output-to-file "/tmp/quuz-read-ahead" (lambda () (write 'a) (write-char #\space) (write '(b)) (write-char #\space) (write 'c)))
+(define p (open-input-file "/tmp/quuz-read-ahead"))
+(define x (read p))
+(define y (read p))
+(define z (read p))
+(close-port p)
+(delete-file "/tmp/quuz-read-ahead")
+(write (list x y z))
+--- expected
+(a (b) c)
+
+=== Borrowed tests
+--- input
+(define x (list 1))
+(define y (or x 2))
+(define w (list 2))
+(define (f) (and #t w))
+(define z (f))
+(set! x #f)
+(set! w #f)
+(write (list y z (if y 'yes 'no) (when (pair? z) (car z))))
+--- expected
+((1) (2) yes 2)
+
+=== Garbage cycles found by tracing
+--- input
+(define t (make-weak-key-hash-table))
+(define (cycle i) (let ((p (list i))) (set-cdr! p p) (hash-table-set! t p i)))
+(define (rep i) (if (< i 20000) (begin (cycle i) (rep (+ i 1)))))
+(rep 0)
+(write (< (hash-table-count t) 4096))
+--- expected
+#t
+
+=== Long lists are freed and collected without recursion
+--- input
+(define l (make-list 300000 0))
+(set-cdr! (list-tail l 299999) l)
+(set! l #f)
+(define m (make-list 300000 0))
+(set! m #f)
+(write 'done)
+--- expected
+done
+
+=== Compound operators in a lambda body
+--- input
+(define v (list (lambda (x) (* x 2))))
+(define (mk n) (lambda () n))
+(define (f n) (list ((lambda (x) x) n) ((car v) n) ((mk n))))
+(write (f 5))
+--- expected
+(5 10 5)
+
+=== Unused symbols are reclaimed
+--- input
+(define (name r i j)
+  (let ((s (make-string 3 r)))
+    (string-set! s 0 (integer->char i))
+    (string-set! s 1 (integer->char j))
+    (string->symbol s)))
+(define (churn-row r i j) (when (< j 123) (name r i j) (churn-row r i (+ j 1))))
+(define (churn r i) (when (< i 123) (churn-row r i 65) (churn r (+ i 1))))
+(define l (list (name #\a 65 65)))
+(define t (make-hash-table))
+(hash-table-set! t (name #\b 65 65) (name #\c 65 65))
+(define (f) 'in-code)
+(churn #\x 65)
+(churn #\y 65)
+(churn #\z 65)
+(write (list l (hash-table->alist t) (f) (eq? (car l) (name #\a 65 65)) (eq? (f) (string->symbol "in-code"))))
+--- expected
+((AAa) ((AAb . AAc)) in-code #t #t)
+
+=== Symbols are reclaimed during an evaluation
+--- input
+(define (name r i j)
+  (let ((s (make-string 3 r)))
+    (string-set! s 0 (integer->char i))
+    (string-set! s 1 (integer->char j))
+    (string->symbol s)))
+(define (churn-row r i j) (when (< j 115) (name r i j) (churn-row r i (+ j 1))))
+(define (churn r i) (when (< i 115) (churn-row r i 65) (churn r (+ i 1))))
+(define (churn-all r) (when (char<? r #\{) (churn r 65) (churn-all (integer->char (+ (char->integer r) 1)))))
+(define t (make-hash-table))
+(define (f)
+  (let ((kept (name #\a 65 65)))
+    (hash-table-set! t (name #\b 65 65) 'in-code)
+    (let ((l (list (name #\c 65 65) (begin (churn-all #\u) kept) (hash-table->alist t))))
+      (list l (eq? (car l) (name #\c 65 65)) (eq? kept (name #\a 65 65))))))
+(write (f))
+--- expected
+((AAc AAa ((AAb . in-code))) #t #t)
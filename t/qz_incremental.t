@@ -0,0 +1,60 @@
+use strict;
+use warnings;
+use Test::Base;
+use Quuz::Filters;
+
+sub run_ {
+  my $data = shift;
+  my ($code, $stdout, $stderr) = with_valgrind($data, "./quuz", "-i", "-r");
+  die "expected success" if ($code != 0);
+  die "expected empty stderr" if ($stderr);
+  $stdout;
+}
+
+filters { input => 'run_', expected => 'chomp' };
+
+__END__
+
+=== Garbage cycles are collected in steps
+--- input
+(define t (make-weak-key-hash-table))
+(define (cycle i) (let ((p (list i))) (set-cdr! p p) (hash-table-set! t p i)))
+(define (rep i) (if (< i 20000) (begin (cycle i) (rep (+ i 1)))))
+(rep 0)
+(write (< (hash-table-count t) 4096))
+--- expected
+#t
+
+=== Cycles changed between steps
+--- input
+(define (ring n) (let ((l (make-list n 1))) (set-cdr! (list-tail l (- n 1)) l) l))
+(define keep (ring 1000))
+(define (churn i)
+  (if (< i 20000)
+    (let ((r (ring 3)))
+      (set-car! keep r)
+      (set-car! (cdr keep) (cdr r))
+      (set! keep (cdr keep))
+      (churn (+ i 1)))))
+(churn 0)
+(define (sum l n acc) (if (= n 0) acc (sum (cdr l) (- n 1) (+ acc (car (car l))))))
+(write (sum keep 1000 0))
+--- expected
+1000
+
+=== Hash tables resized between steps
+--- input
+(define (fill t i) (if (< i 40) (begin (hash-table-set! t i (list i)) (fill t (+ i 1)))))
+(define (empty t i) (if (< i 40) (begin (hash-table-delete! t i) (empty t (+ i 1)))))
+(define keep (make-hash-table eqv?))
+(define (churn n own)
+  (if (< n 2000)
+    (let ((t (if own (make-hash-table eqv?) keep)))
+      (fill t 0)
+      (empty t 0)
+      (churn (+ n 1) (not own)))))
+(churn 0 #f)
+(fill keep 0)
+(write (hash-table-count keep))
+--- expected
+40
@@ -0,0 +1,81 @@
+use strict;
+use warnings;
+use Test::Base;
+use Quuz::Filters;
+
+sub run_ {
+  my $data = shift;
+  my ($code, $stdout, $stderr) = with_valgrind($data, "./quuz", "-b", "-r");
+  die "expected success" if ($code != 0);
+  die "expected empty stderr" if ($stderr);
+  $stdout;
+}
+
+filters { input => 'run_', expected => 'chomp' };
+
+__END__
+
+=== Calls
+--- input
+(define (add a b) (+ a b))
+(write (add 1 (add 2 3)))
+--- expected
+6
+
+=== Tail calls
+--- input
+(define (count n acc) (if (= n 0) acc (count (- n 1) (+ acc 1))))
+(write (count 10000 0))
+--- expected
+10000
+
+=== Named let
+--- input
+(write (let loop ((i 0) (acc '())) (if (= i 3) acc (loop (+ i 1) (cons i acc)))))
+--- expected
+(2 1 0)
+
+=== Closures
+--- input
+(define (make-counter)
+  (let ((n 0))
+    (lambda () (set! n (+ n 1)) n)))
+(define c (make-counter))
+(c)
+(write (c))
+--- expected
+2
+
+=== And, or and let*
+--- input
+(define (f x) (and (or #f x) (let* ((y x) (z (+ y 1))) z)))
+(write (list (f 1) (f #f)))
+--- expected
+(2 #f)
+
+=== Values on the stack outlive their variables
+--- input
+(define g (list 1 2))
+(define (f) (cons g (begin (set! g #f) g)))
+(write (f))
+--- expected
+((1 2) . #f)
+
+=== Compound operators in a lambda body
+--- input
+(define v (list (lambda (x) (* x 2))))
+(define (mk n) (lambda () n))
+(define (f n) (list ((lambda (x) x) n) ((car v) n) ((mk n))))
+(write (f 5))
+--- expected
+(5 10 5)
+
+=== Recursion through case and apply doesn't nest in C
+--- input
+(define (f k) (case k ((1) 'a) ((2 3) 'b) (else 'c)))
+(write (list (f 1) (f 3) (f 9) (apply + 1 2 '(3 4))))
+(define (c n) (if (= n 0) 0 (+ 1 (case 1 ((1) (c (- n 1)))))))
+(define (a n) (if (= n 0) 0 (+ 1 (apply a (list (- n 1))))))
+(write (list (c 100000) (a 100000)))
+--- expected
+(a b c 10)(100000 100000)